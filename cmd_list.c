@@ -6,105 +6,439 @@
 #include <stdio.h>
 #include <stdlib.h>
 #include <string.h>
+#include <stdint.h>
+#include <errno.h>
+#include <unistd.h>
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
 
 #include "cmd_list.h"
 
-// Size of string buffers:
-#define BUFFER_SIZE 256
-// Line token delimiter:
-#define DELIMITER " "
+// Size of the blocks that entries and argument vectors are allocated from:
+#define ARENA_BLOCK_SIZE 65536
+// Alignment of allocations from a block:
+#define ARENA_ALIGN sizeof(long long)
+// Estimated run time of commands without "est=" (microseconds):
+#define DEFAULT_EST 1000000LL
+// Initial size of the read buffer of a stream:
+#define STREAM_BUFFER_SIZE 65536
+// Line token delimiters:
+#define IS_DELIMITER(c) ((c) == ' ' || (c) == '\t' || (c) == '\r')
 
-// List node struct:
-struct cmd_node_struct
+// List struct:
+struct cmd_list_struct
 {
-	struct cmd_node_struct *next;
-	struct cmd_entry_struct *entry;
+	struct cmd_entry_struct *head;
+	struct cmd_entry_struct *tail;
+	struct cmd_stream_struct *stream;	// NULL unless read lazily
 };
 
-// List struct:
-struct cmd_list_struct
+// Input of a list that is read lazily:
+struct cmd_stream_struct
+{
+	int fd;
+	int fd_flags;	// File status flags to restore, -1 if unchanged
+	int regular;	// Reading never blocks
+	int eof;	// No more input
+	int window;	// Maximum number of entries in the list
+	int count;	// Entries in the list
+	int seq;	// seq of the next entry read
+	int skipped;	// Malformed lines skipped
+	char *buffer;
+	size_t start;	// Start of the first line not parsed
+	size_t used;
+	size_t size;
+};
+
+// Block of memory in an arena:
+struct arena_block_struct
+{
+	struct arena_block_struct *next;
+	size_t used;
+	size_t size;
+	long long data[];
+};
+
+/* Storage shared by the entries read together: the mapped workload file, that
+ * the strings of the entries point into, and the blocks holding the entries
+ * and their argument vectors. Everything is freed when the last entry is. */
+struct cmd_arena_struct
+{
+	int refs;	// Entries not yet freed
+	char *map;	// Mapped file, NULL if none
+	size_t map_length;
+	struct arena_block_struct *blocks;
+};
+
+// Binary workload file format version and magic:
+#define WL_MAGIC "DFSW"
+#define WL_VERSION 1
+// String offset of optional strings that are not given:
+#define WL_NO_STRING 0xffffffffu
+// Initial number of slots in the string table used when writing:
+#define WL_STRING_SLOTS 1024
+
+// Header of a binary workload file. Offsets are from the start of the file:
+struct wl_header_struct
+{
+	char magic[4];
+	uint32_t version;
+	uint32_t entry_count;	// Records in the record table
+	uint32_t arg_count;	// Offsets in the argument table
+	uint32_t pool_size;	// Bytes in the string pool
+	uint32_t entry_offset;
+	uint32_t arg_offset;
+	uint32_t pool_offset;
+};
+
+// Record of a command in a binary workload file. Strings are given as offsets
+// into the string pool:
+struct wl_entry_struct
 {
-	struct cmd_node_struct *head;
-	struct cmd_node_struct *tail;
+	int64_t start_time;
+	int64_t est;
+	int64_t deadline;
+	int32_t class;
+	int32_t prio;
+	uint32_t dir;
+	uint32_t cmd;
+	uint32_t new_stdin;	// WL_NO_STRING if none, as are the following
+	uint32_t new_stdout;
+	uint32_t id;
+	uint32_t after;
+	uint32_t first_arg;	// Index of argv[0] in the argument table
+	uint32_t argc;	// Arguments, not counting the NULL-pointer
 };
 
+// Growing string pool with a table of the added strings, used when writing:
+struct wl_pool_struct
+{
+	char *data;
+	size_t size;
+	size_t capacity;
+	uint32_t *slots;	// Open addressing table of string offsets
+	size_t num_slots;
+	size_t count;
+};
+
+// Arena functions, see below:
+static struct cmd_arena_struct *create_arena(void);
+static void *arena_alloc(struct cmd_arena_struct *arena, size_t size);
+static int arena_reserve(struct cmd_arena_struct *arena, size_t size);
+static void arena_shrink(struct cmd_arena_struct *arena, void *ptr,
+		size_t size);
+static void release_arena(struct cmd_arena_struct *arena);
+
 // Parser function, see below:
-static struct cmd_entry_struct *parse_line(char *line);
+static int parse_line(struct cmd_arena_struct *arena,
+		struct cmd_entry_struct *entry, char *line, size_t length);
+static char *next_token(char **cursor);
+static long long parse_start_time(char *token);
+static int parse_option(struct cmd_entry_struct *entry, char *token);
+static struct cmd_entry_struct *merge_sort(struct cmd_entry_struct *head,
+		int (*before)(cmd_entry entry, cmd_entry other));
+
+// Stream function, see below:
+static void fill_stream(struct cmd_list_struct *list);
 
-// Free memory allocated for the node/entry, see below:
-static void free_node(struct cmd_node_struct *node);
+// Binary workload functions, see below:
+static int load_binary(struct cmd_list_struct *list,
+		struct cmd_arena_struct *arena);
+static int check_string(struct wl_header_struct *header, uint32_t offset);
+static char *get_string(char *pool, uint32_t offset);
+static int pool_add(struct wl_pool_struct *pool, char *string,
+		uint32_t *offset);
+static int pool_grow_slots(struct wl_pool_struct *pool);
+static uint32_t hash_string(char *string);
 
 // Create command list:
 struct cmd_list_struct *create_cmd_list(char *file_name)
 {
-	FILE *input_file;
 	struct cmd_list_struct *list;
-	struct cmd_node_struct *new_node;
-	struct cmd_entry_struct *new_entry;
-	char line_buf[BUFFER_SIZE];
+	struct cmd_arena_struct *arena;
+	struct cmd_entry_struct *entries;
+	struct stat file_stat;
+	char *line, *line_end, *line_copy, *map_end;
+	size_t line_count, length;
+	int fd, seq = 0, failed = 0;
 
-	// Open input file:
-	if ((input_file = fopen(file_name, "r")) == NULL )
+	// Allocate and init list struct and arena:
+	if ((list = create_empty_cmd_list()) == NULL )
 	{
 		return NULL ;
 	}
-	// Allocate and init list struct:
-	if ((list = malloc(sizeof(struct cmd_list_struct))) == NULL )
+	if ((arena = create_arena()) == NULL )
 	{
+		free(list);
 		return NULL ;
 	}
-	list->head = NULL;
-	list->tail = NULL;
-	// Read file line by line until EOF:
-	while (fgets(line_buf, BUFFER_SIZE, input_file) != NULL )
+	// Map input file, lines are parsed in place in a private copy:
+	if ((fd = open(file_name, O_RDONLY)) == -1)
 	{
-        // If line is empty or a comment, just read the next line
-        if (line_buf[0] == '#' || line_buf[0] == '\n') {
-            continue;
-        }
-		// Parse read line:
-		if ((new_entry = parse_line(line_buf)) == NULL )
+		release_arena(arena);
+		free(list);
+		return NULL ;
+	}
+	if (fstat(fd, &file_stat) != 0)
+	{
+		close(fd);
+		release_arena(arena);
+		free(list);
+		return NULL ;
+	}
+	if (file_stat.st_size == 0)
+	{
+		close(fd);
+		release_arena(arena);
+		return list;
+	}
+	arena->map = mmap(NULL, file_stat.st_size, PROT_READ | PROT_WRITE,
+			MAP_PRIVATE | MAP_POPULATE, fd, 0);
+	close(fd);
+	if (arena->map == MAP_FAILED)
+	{
+		arena->map = NULL;
+		release_arena(arena);
+		free(list);
+		return NULL ;
+	}
+	arena->map_length = file_stat.st_size;
+	// Binary workload files are used as they are:
+	if (arena->map_length >= sizeof(struct wl_header_struct)
+			&& memcmp(arena->map, WL_MAGIC, 4) == 0)
+	{
+		if ((seq = load_binary(list, arena)) <= 0)
 		{
-			return NULL ;
+			release_arena(arena);
 		}
-		// Allocated and init list node:
-		if ((new_node = malloc(sizeof(struct cmd_node_struct))) == NULL )
+		if (seq < 0)
 		{
+			free(list);
 			return NULL ;
 		}
-		new_node->next = NULL;
-		new_node->entry = new_entry;
-		// Insert node in list:
-		if (list->head != NULL )
+		return list;
+	}
+	map_end = arena->map + arena->map_length;
+	// Allocate all entries at once, one per line:
+	line_count = 1;
+	for (line = arena->map; (line = memchr(line, '\n', map_end - line)) != NULL ;
+			line++)
+	{
+		line_count++;
+	}
+	if ((entries = arena_alloc(arena,
+			line_count * sizeof(struct cmd_entry_struct))) == NULL )
+	{
+		release_arena(arena);
+		free(list);
+		return NULL ;
+	}
+	// Parse line by line until end of file:
+	for (line = arena->map; line < map_end; line = line_end + 1)
+	{
+		if ((line_end = memchr(line, '\n', map_end - line)) != NULL )
 		{
-			list->tail->next = new_node;
-			list->tail = new_node;
+			*line_end = '\0';
+			length = line_end - line;
 		}
 		else
 		{
-			list->head = new_node;
-			list->tail = new_node;
+			// Last line without line break, copy it to terminate it:
+			line_end = map_end;
+			length = line_end - line;
+			if ((line_copy = arena_alloc(arena, length + 1)) == NULL )
+			{
+				failed = 1;
+				break;
+			}
+			memcpy(line_copy, line, length);
+			line_copy[length] = '\0';
+			line = line_copy;
 		}
+		// If line is empty or a comment, just read the next line
+		if (line[0] == '#' || line[0] == '\0')
+		{
+			continue;
+		}
+		// Parse line into the next entry:
+		if (parse_line(arena, &entries[seq], line, length) != 0)
+		{
+			failed = 1;
+			break;
+		}
+		entries[seq].seq = seq;
+		add_last(list, &entries[seq]);
+		seq++;
+	}
+	// Free the arena with the entries, or right away if there are none:
+	if (seq == 0)
+	{
+		release_arena(arena);
+	}
+	if (failed)
+	{
+		destroy_cmd_list(list);
+		return NULL ;
+	}
+	return list;
+}
+
+// Create lazily read command list:
+struct cmd_list_struct *open_cmd_stream(char *file_name, int window)
+{
+	struct cmd_list_struct *list;
+	struct cmd_stream_struct *stream;
+	struct stat file_stat;
+
+	if (window <= 0 || (list = create_empty_cmd_list()) == NULL )
+	{
+		return NULL ;
+	}
+	if ((stream = malloc(sizeof(struct cmd_stream_struct))) == NULL )
+	{
+		free(list);
+		return NULL ;
+	}
+	if ((stream->buffer = malloc(STREAM_BUFFER_SIZE)) == NULL )
+	{
+		free(stream);
+		free(list);
+		return NULL ;
+	}
+	stream->fd = strcmp(file_name, "-") == 0 ?
+			STDIN_FILENO : open(file_name, O_RDONLY);
+	if (stream->fd == -1 || fstat(stream->fd, &file_stat) != 0)
+	{
+		if (stream->fd > STDIN_FILENO)
+		{
+			close(stream->fd);
+		}
+		free(stream->buffer);
+		free(stream);
+		free(list);
+		return NULL ;
+	}
+	// Anything but a regular file may block, e.g. a pipe:
+	stream->regular = S_ISREG(file_stat.st_mode);
+	stream->fd_flags = -1;
+	if (!stream->regular)
+	{
+		stream->fd_flags = fcntl(stream->fd, F_GETFL);
+		if (stream->fd_flags != -1 && (stream->fd_flags & O_NONBLOCK) == 0)
+		{
+			fcntl(stream->fd, F_SETFL, stream->fd_flags | O_NONBLOCK);
+		}
+		else
+		{
+			stream->fd_flags = -1;
+		}
+	}
+	stream->eof = 0;
+	stream->window = window;
+	stream->count = 0;
+	stream->seq = 0;
+	stream->skipped = 0;
+	stream->start = 0;
+	stream->used = 0;
+	stream->size = STREAM_BUFFER_SIZE;
+	list->stream = stream;
+	fill_stream(list);
+	return list;
+}
+
+// Get fd a stream is waiting for:
+int get_cmd_stream_fd(struct cmd_list_struct *list)
+{
+	struct cmd_stream_struct *stream = list->stream;
+
+	if (stream == NULL || stream->regular || stream->eof
+			|| stream->count >= stream->window)
+	{
+		return -1;
+	}
+	return stream->fd;
+}
+
+// Get number of skipped lines:
+int get_skipped_lines(struct cmd_list_struct *list)
+{
+	return list->stream != NULL ? list->stream->skipped : 0;
+}
+
+// Parse a single line:
+struct cmd_entry_struct *parse_cmd_line(char *line)
+{
+	struct cmd_arena_struct *arena;
+	struct cmd_entry_struct *entry;
+	char *line_copy;
+	size_t length;
+
+	if ((arena = create_arena()) == NULL )
+	{
+		return NULL ;
+	}
+	// Entry, line and tokens share one block of just the size needed:
+	length = strlen(line);
+	if (arena_reserve(arena, sizeof(struct cmd_entry_struct) + length + 1
+			+ sizeof(char*) * (length / 2 + 2) + 2 * ARENA_ALIGN) != 0)
+	{
+		release_arena(arena);
+		return NULL ;
+	}
+	entry = arena_alloc(arena, sizeof(struct cmd_entry_struct));
+	line_copy = arena_alloc(arena, length + 1);
+	if (entry == NULL || line_copy == NULL
+			|| parse_line(arena, entry, strcpy(line_copy, line), length) != 0)
+	{
+		release_arena(arena);
+		return NULL ;
+	}
+	entry->seq = 0;
+	return entry;
+}
+
+// Create empty command list:
+struct cmd_list_struct *create_empty_cmd_list(void)
+{
+	struct cmd_list_struct *list;
+
+	if ((list = malloc(sizeof(struct cmd_list_struct))) == NULL )
+	{
+		return NULL ;
 	}
+	list->head = NULL;
+	list->tail = NULL;
+	list->stream = NULL;
 	return list;
 }
 
 // Destroy list and free memory:
 void destroy_cmd_list(struct cmd_list_struct *list)
 {
-	struct cmd_node_struct *node, *next_node;
+	struct cmd_entry_struct *entry, *next_entry;
 
-	// Non-empty list:
-	if (list->head != NULL )
+	// Free all command entries:
+	entry = list->head;
+	while (entry != NULL )
+	{
+		next_entry = entry->next;
+		free_cmd_entry(entry);
+		entry = next_entry;
+	}
+	// Close the input of a stream:
+	if (list->stream != NULL )
 	{
-		node = list->head;
-		// Free all nodes and command entries:
-		while (node != NULL )
+		if (list->stream->fd_flags != -1)
 		{
-			next_node = node->next;
-			free_node(node);
-			node = next_node;
+			fcntl(list->stream->fd, F_SETFL, list->stream->fd_flags);
 		}
+		if (list->stream->fd != STDIN_FILENO)
+		{
+			close(list->stream->fd);
+		}
+		free(list->stream->buffer);
+		free(list->stream);
 	}
 	// Free list:
 	free(list);
@@ -113,144 +447,495 @@ void destroy_cmd_list(struct cmd_list_struct *list)
 // Get first entry in list:
 struct cmd_entry_struct *get_first(struct cmd_list_struct *list)
 {
-	// Return NULL if list is empty:
-	if (list->head == NULL )
+	if (list->stream != NULL && list->stream->count < list->stream->window)
 	{
-		return NULL ;
+		fill_stream(list);
 	}
-	// Return first entry:
-	return list->head->entry;
+	return list->head;
 }
 
 // Remove first entry in list:
 void remove_first(struct cmd_list_struct *list)
 {
-	struct cmd_node_struct *new_head;
+	struct cmd_entry_struct *entry;
 
-	// Do nothing if list is empty:
+	if ((entry = take_first(list)) != NULL )
+	{
+		free_cmd_entry(entry);
+	}
+}
+
+// Remove first entry in list without freeing it:
+struct cmd_entry_struct *take_first(struct cmd_list_struct *list)
+{
+	struct cmd_entry_struct *entry;
+
+	// Return NULL if list is empty:
 	if (list->head == NULL )
 	{
-		return;
+		return NULL ;
 	}
-	// Free head node:
-	new_head = list->head->next;
-	free_node(list->head);
-	list->head = new_head;
+	// Unlink head entry:
+	entry = list->head;
+	list->head = entry->next;
+	entry->next = NULL;
 	// Set tail NULL if list is now empty:
 	if (list->head == NULL )
 	{
 		list->tail = NULL;
 	}
+	// Read the next entry of a stream:
+	if (list->stream != NULL )
+	{
+		list->stream->count--;
+		fill_stream(list);
+	}
+	return entry;
 }
 
-// Free memory allocated to the node:
-static void free_node(struct cmd_node_struct *node)
+// Append entry to end of list:
+int add_last(struct cmd_list_struct *list, struct cmd_entry_struct *entry)
 {
-	int arg_index;
-
-	free(node->entry->dir);
-	free(node->entry->cmd);
-	// Free all arguments from argv:
-	arg_index = 0;
-	while (node->entry->argv[arg_index] != NULL )
+	entry->next = NULL;
+	if (list->stream != NULL )
 	{
-		free(node->entry->argv[arg_index]);
-		arg_index++;
+		list->stream->count++;
 	}
-	free(node->entry->argv);
-	free(node->entry);
-	free(node);
+	// Insert entry in list:
+	if (list->head != NULL )
+	{
+		list->tail->next = entry;
+		list->tail = entry;
+	}
+	else
+	{
+		list->head = entry;
+		list->tail = entry;
+	}
+	return 0;
 }
 
-// Parse contents of the specified line and create command entry:
-static struct cmd_entry_struct *parse_line(char *line)
+// Insert entry in sorted position:
+int insert_sorted(struct cmd_list_struct *list, struct cmd_entry_struct *entry,
+		int (*before)(cmd_entry entry, cmd_entry other))
 {
-	int token_count, arg_count, arg_index, str_length;
-	char *token, *line_break;
-	char parse_buf[BUFFER_SIZE];
-	struct cmd_entry_struct *new_entry;
+	struct cmd_entry_struct *prev_entry, *other;
 
-	// Copy line to parse buffer:
-	strcpy(parse_buf, line);
-	// Count number of tokens:
-	if (strtok(parse_buf, DELIMITER) != NULL )
+	// Append if the entry doesn't go before the last one (common case):
+	if (list->tail == NULL || !before(entry, list->tail))
+	{
+		return add_last(list, entry);
+	}
+	// Find first entry the entry goes before:
+	prev_entry = NULL;
+	other = list->head;
+	while (!before(entry, other))
+	{
+		prev_entry = other;
+		other = other->next;
+	}
+	// Insert entry in list:
+	entry->next = other;
+	if (list->stream != NULL )
 	{
-		token_count = 1;
+		list->stream->count++;
+	}
+	if (prev_entry != NULL )
+	{
+		prev_entry->next = entry;
 	}
 	else
 	{
-		return NULL ;
+		list->head = entry;
 	}
-	while (strtok(NULL, DELIMITER) != NULL )
+	return 0;
+}
+
+// Sort list:
+void sort_cmd_list(struct cmd_list_struct *list,
+		int (*before)(cmd_entry entry, cmd_entry other))
+{
+	struct cmd_entry_struct *entry;
+
+	// Nothing to do if the list is already sorted, e.g. a converted workload:
+	for (entry = list->head; entry != NULL && entry->next != NULL ;
+			entry = entry->next)
 	{
-		token_count++;
+		if (before(entry->next, entry))
+		{
+			break;
+		}
 	}
-	// A properly formatted line has at least 4 (incl. class) tokens:
-	if (token_count < 4)
+	if (entry == NULL || entry->next == NULL )
 	{
-		return NULL ;
+		return;
 	}
-	// Allocate entry struct:
-	if ((new_entry = malloc(sizeof(struct cmd_entry_struct))) == NULL )
+	list->head = merge_sort(list->head, before);
+	// Find new tail:
+	list->tail = list->head;
+	while (list->tail != NULL && list->tail->next != NULL )
 	{
-		return NULL ;
+		list->tail = list->tail->next;
 	}
-	// Copy line to parse buffer:
-	strcpy(parse_buf, line);
-	// Find and replace line break (if present):
-	if ((line_break = strchr(parse_buf, '\n')) != NULL )
+}
+
+/* Sorts the entries starting at head and returns the new head. On equal
+ * entries the left one is taken first, which keeps the sort stable. */
+static struct cmd_entry_struct *merge_sort(struct cmd_entry_struct *head,
+		int (*before)(cmd_entry entry, cmd_entry other))
+{
+	struct cmd_entry_struct *slow, *fast, *left, *right;
+	struct cmd_entry_struct merged, *tail;
+
+	if (head == NULL || head->next == NULL )
 	{
-		*line_break = '\0';
+		return head;
 	}
-	// Parse start time:
-	token = strtok(parse_buf, DELIMITER);
-	new_entry->start_time = atoi(token);
-	// Parse class
-	token = strtok(NULL, DELIMITER);
-	new_entry->class = atoi(token);
-	// Parse working dir:
-	token = strtok(NULL, DELIMITER);
-	str_length = strlen(token) + 1;
-	if ((new_entry->dir = malloc(sizeof(char) * str_length)) == NULL )
+	// Split list in the middle:
+	slow = head;
+	fast = head->next;
+	while (fast != NULL && fast->next != NULL )
 	{
-		return NULL ;
+		slow = slow->next;
+		fast = fast->next->next;
 	}
-	strcpy(new_entry->dir, token);
-	// Parse command:
-	token = strtok(NULL, DELIMITER);
-	str_length = strlen(token) + 1;
-	if ((new_entry->cmd = malloc(sizeof(char) * str_length)) == NULL )
+	right = merge_sort(slow->next, before);
+	slow->next = NULL;
+	left = merge_sort(head, before);
+	// Merge sorted halves:
+	tail = &merged;
+	while (left != NULL && right != NULL )
 	{
-		return NULL ;
+		if (before(right, left))
+		{
+			tail->next = right;
+			right = right->next;
+		}
+		else
+		{
+			tail->next = left;
+			left = left->next;
+		}
+		tail = tail->next;
 	}
-	strcpy(new_entry->cmd, token);
-	// Parse argv:
-	arg_count = token_count - 1;
-	if ((new_entry->argv = malloc(sizeof(char*) * arg_count)) == NULL )
+	tail->next = left != NULL ? left : right;
+	return merged.next;
+}
+
+// Write list to binary workload file:
+int write_binary_workload(struct cmd_list_struct *list, char *file_name)
+{
+	static const char padding[8];
+	struct wl_header_struct header;
+	struct wl_entry_struct *records;
+	struct wl_pool_struct pool;
+	struct cmd_entry_struct *entry;
+	uint32_t *args = NULL, *new_args;
+	size_t entry_count = 0, arg_count = 0, arg_capacity = 0, argc, n;
+	FILE *file;
+	int failed = 0;
+
+	// Count entries:
+	for (entry = list->head; entry != NULL ; entry = entry->next)
 	{
-		return NULL ;
+		entry_count++;
+	}
+	memset(&pool, 0, sizeof(pool));
+	if ((records = calloc(entry_count, sizeof(struct wl_entry_struct))) == NULL
+			|| pool_grow_slots(&pool) != 0)
+	{
+		free(records);
+		free(pool.slots);
+		return -1;
 	}
-	// argv[0] = command:
-	if ((new_entry->argv[0] = malloc(sizeof(char) * str_length)) == NULL )
+	// Build the records, the argument table and the string pool:
+	n = 0;
+	for (entry = list->head; entry != NULL && !failed ; entry = entry->next, n++)
+	{
+		records[n].start_time = entry->start_time;
+		records[n].est = entry->est;
+		records[n].deadline = entry->deadline;
+		records[n].class = entry->class;
+		records[n].prio = entry->prio;
+		for (argc = 0; entry->argv[argc] != NULL ; argc++)
+			;
+		if (arg_count + argc > arg_capacity)
+		{
+			arg_capacity = 2 * (arg_count + argc) + 64;
+			if ((new_args = realloc(args, arg_capacity * sizeof(uint32_t)))
+					== NULL )
+			{
+				failed = 1;
+				break;
+			}
+			args = new_args;
+		}
+		records[n].first_arg = arg_count;
+		records[n].argc = argc;
+		for (argc = 0; entry->argv[argc] != NULL ; argc++)
+		{
+			failed |= pool_add(&pool, entry->argv[argc], &args[arg_count++]);
+		}
+		failed |= pool_add(&pool, entry->dir, &records[n].dir);
+		failed |= pool_add(&pool, entry->cmd, &records[n].cmd);
+		failed |= pool_add(&pool, entry->new_stdin, &records[n].new_stdin);
+		failed |= pool_add(&pool, entry->new_stdout, &records[n].new_stdout);
+		failed |= pool_add(&pool, entry->id, &records[n].id);
+		failed |= pool_add(&pool, entry->after, &records[n].after);
+	}
+	// Header, records, argument table and pool, all 8-byte aligned:
+	memcpy(header.magic, WL_MAGIC, 4);
+	header.version = WL_VERSION;
+	header.entry_count = entry_count;
+	header.arg_count = arg_count;
+	header.pool_size = pool.size;
+	header.entry_offset = sizeof(struct wl_header_struct);
+	header.arg_offset = header.entry_offset
+			+ entry_count * sizeof(struct wl_entry_struct);
+	header.pool_offset = header.arg_offset
+			+ (arg_count * sizeof(uint32_t) + 7) / 8 * 8;
+	if (!failed && (file = fopen(file_name, "wb")) != NULL )
+	{
+		failed |= fwrite(&header, sizeof(header), 1, file) != 1;
+		failed |= fwrite(records, sizeof(struct wl_entry_struct), entry_count,
+				file) != entry_count;
+		failed |= fwrite(args, sizeof(uint32_t), arg_count, file) != arg_count;
+		n = header.pool_offset - header.arg_offset - arg_count * sizeof(uint32_t);
+		failed |= fwrite(padding, 1, n, file) != n;
+		failed |= fwrite(pool.data, 1, pool.size, file) != pool.size;
+		failed |= fclose(file) != 0;
+	}
+	else
+	{
+		failed = 1;
+	}
+	free(records);
+	free(args);
+	free(pool.data);
+	free(pool.slots);
+	return failed ? -1 : 0;
+}
+
+// Free memory allocated to the entry:
+void free_cmd_entry(struct cmd_entry_struct *entry)
+{
+	// The storage is freed with the last entry using it:
+	if (--entry->arena->refs == 0)
+	{
+		release_arena(entry->arena);
+	}
+}
+
+/* Reads entries into a stream list until its window is full, the input has
+ * ended or no more input can be read without blocking. */
+static void fill_stream(struct cmd_list_struct *list)
+{
+	struct cmd_stream_struct *stream = list->stream;
+	struct cmd_entry_struct *entry;
+	char *line, *line_end, *new_buffer;
+	ssize_t n;
+
+	while (stream->count < stream->window)
+	{
+		// Parse the next complete line in the buffer:
+		line = stream->buffer + stream->start;
+		if ((line_end = memchr(line, '\n', stream->used - stream->start))
+				!= NULL )
+		{
+			*line_end = '\0';
+			stream->start = line_end + 1 - stream->buffer;
+			if (line[0] == '#' || line[0] == '\0')
+			{
+				continue;
+			}
+			if ((entry = parse_cmd_line(line)) == NULL )
+			{
+				stream->skipped++;
+				continue;
+			}
+			entry->seq = stream->seq++;
+			add_last(list, entry);
+			continue;
+		}
+		if (stream->eof)
+		{
+			break;
+		}
+		// Move the partial line to the front, grow the buffer if it's full:
+		memmove(stream->buffer, line, stream->used - stream->start);
+		stream->used -= stream->start;
+		stream->start = 0;
+		if (stream->used == stream->size)
+		{
+			if ((new_buffer = realloc(stream->buffer, 2 * stream->size))
+					== NULL )
+			{
+				stream->eof = 1;
+				break;
+			}
+			stream->buffer = new_buffer;
+			stream->size *= 2;
+		}
+		n = read(stream->fd, stream->buffer + stream->used,
+				stream->size - stream->used);
+		if (n > 0)
+		{
+			stream->used += n;
+		}
+		else if (n < 0 && errno == EINTR)
+		{
+			continue;
+		}
+		else if (n < 0 && (errno == EAGAIN || errno == EWOULDBLOCK))
+		{
+			break;
+		}
+		else
+		{
+			// End of input, terminate a last line without line break:
+			stream->eof = 1;
+			if (stream->used > 0)
+			{
+				stream->buffer[stream->used++] = '\n';
+			}
+		}
+	}
+}
+
+// Allocate an empty arena:
+static struct cmd_arena_struct *create_arena(void)
+{
+	struct cmd_arena_struct *arena;
+
+	if ((arena = malloc(sizeof(struct cmd_arena_struct))) == NULL )
 	{
 		return NULL ;
 	}
-	strcpy(new_entry->argv[0], token);
-	// Parse remaining arguments (if any):
-	arg_index = 1;
-	while ((token = strtok(NULL, DELIMITER)) != NULL )
+	arena->refs = 0;
+	arena->map = NULL;
+	arena->map_length = 0;
+	arena->blocks = NULL;
+	return arena;
+}
+
+/* Allocates memory from the last block of an arena, or from a new block if it
+ * doesn't fit. Returns NULL on error. */
+static void *arena_alloc(struct cmd_arena_struct *arena, size_t size)
+{
+	struct arena_block_struct *block;
+	size_t block_size;
+
+	size = (size + ARENA_ALIGN - 1) / ARENA_ALIGN * ARENA_ALIGN;
+	block = arena->blocks;
+	if (block == NULL || block->size - block->used < size)
 	{
-		str_length = strlen(token) + 1;
-		if ((new_entry->argv[arg_index] = malloc(sizeof(char) * str_length))
-				== NULL )
+		block_size = size > ARENA_BLOCK_SIZE ? size : ARENA_BLOCK_SIZE;
+		if (arena_reserve(arena, block_size) != 0)
 		{
 			return NULL ;
 		}
-		strcpy(new_entry->argv[arg_index], token);
-		arg_index++;
+		block = arena->blocks;
 	}
-	// Set NULL-pointer at last index of argv:
-	new_entry->argv[arg_index] = NULL;
+	block->used += size;
+	return (char *) block->data + block->used - size;
+}
+
+/* Adds a block of the specified size to an arena, which following allocations
+ * are taken from. Returns 0 on success, otherwise -1. */
+static int arena_reserve(struct cmd_arena_struct *arena, size_t size)
+{
+	struct arena_block_struct *block;
+
+	if ((block = malloc(sizeof(struct arena_block_struct) + size)) == NULL )
+	{
+		return -1;
+	}
+	block->next = arena->blocks;
+	block->used = 0;
+	block->size = size;
+	arena->blocks = block;
+	return 0;
+}
+
+/* Shrinks the last allocation from an arena, at ptr, to the specified size. */
+static void arena_shrink(struct cmd_arena_struct *arena, void *ptr,
+		size_t size)
+{
+	size = (size + ARENA_ALIGN - 1) / ARENA_ALIGN * ARENA_ALIGN;
+	arena->blocks->used = (char *) ptr - (char *) arena->blocks->data + size;
+}
+
+// Free an arena, its blocks and its mapped file:
+static void release_arena(struct cmd_arena_struct *arena)
+{
+	struct arena_block_struct *block, *next_block;
+
+	for (block = arena->blocks; block != NULL ; block = next_block)
+	{
+		next_block = block->next;
+		free(block);
+	}
+	if (arena->map != NULL )
+	{
+		munmap(arena->map, arena->map_length);
+	}
+	free(arena);
+}
+
+/* Parses the specified line of the specified length in place into the
+ * specified entry, which then uses the arena. The strings of the entry point
+ * into the line. Returns 0 on success, -1 if the line is malformed. */
+static int parse_line(struct cmd_arena_struct *arena,
+		struct cmd_entry_struct *entry, char *line, size_t length)
+{
+	int token_count, token_index;
+	char **tokens, *cursor;
+
+	// Split the line into tokens in one pass. A line can't have more tokens
+	// than every other character, the array is shrunk afterwards:
+	if ((tokens = arena_alloc(arena, sizeof(char*) * (length / 2 + 2))) == NULL )
+	{
+		return -1;
+	}
+	token_count = 0;
+	cursor = line;
+	while ((tokens[token_count] = next_token(&cursor)) != NULL )
+	{
+		token_count++;
+	}
+	// The tail of the array, from the command on, becomes argv:
+	arena_shrink(arena, tokens, sizeof(char*) * (token_count + 1));
+	// A properly formatted line has at least 4 (incl. class) tokens:
+	if (token_count < 4)
+	{
+		return -1;
+	}
+	// Parse start time:
+	entry->start_time = parse_start_time(tokens[0]);
+	// Parse class
+	entry->class = atoi(tokens[1]);
+	// Parse optional dependency tokens:
+	entry->id = NULL;
+	entry->after = NULL;
+	entry->est = DEFAULT_EST;
+	entry->rank = DEFAULT_EST;
+	entry->prio = 0;
+	entry->deadline = -1;
+	token_index = 2;
+	while (token_index < token_count
+			&& parse_option(entry, tokens[token_index]) == 0)
+	{
+		token_index++;
+	}
+	// Parse working dir and command:
+	if (token_index + 2 > token_count)
+	{
+		return -1;
+	}
+	entry->dir = tokens[token_index];
+	entry->cmd = tokens[token_index + 1];
+	// argv[0] = command, followed by the arguments and a NULL-pointer:
+	entry->argv = &tokens[token_index + 1];
 
     /* This is some ugly code to redirect stdin/stdout.
      * It just makes it possible to do "$ cmd < input.txt".
@@ -258,21 +943,316 @@ static struct cmd_entry_struct *parse_line(char *line)
      *
      * Oh and you have to choose if you want to redirect stdin OR stdout!
      * */
-    if (*new_entry->argv[1] == '<' && new_entry->argv[2] != NULL) {
-        new_entry->new_stdin = new_entry->argv[2];
-        free(new_entry->argv[1]);
-        new_entry->argv[1] = NULL;
-    }
-    else if (*new_entry->argv[1] == '>' && new_entry->argv[2] != NULL) {
-        new_entry->new_stdout = new_entry->argv[2];
-        free(new_entry->argv[1]);
-        new_entry->argv[1] = NULL;
-    }
-    else {
-        new_entry->new_stdout = NULL;
-        new_entry->new_stdin = NULL;
+    entry->new_stdin = NULL;
+    entry->new_stdout = NULL;
+    if (entry->argv[1] != NULL && entry->argv[2] != NULL) {
+        if (*entry->argv[1] == '<') {
+            entry->new_stdin = entry->argv[2];
+            entry->argv[1] = NULL;
+        }
+        else if (*entry->argv[1] == '>') {
+            entry->new_stdout = entry->argv[2];
+            entry->argv[1] = NULL;
+        }
     }
 
-	// Return entry:
-	return new_entry;
+	// The entry now shares the arena:
+	entry->next = NULL;
+	entry->arena = arena;
+	arena->refs++;
+	return 0;
+}
+
+/* Returns the next token at the cursor, or NULL if there is none. The token is
+ * terminated in place and the cursor moved past it. */
+static char *next_token(char **cursor)
+{
+	char *token, *end;
+
+	for (token = *cursor; IS_DELIMITER(*token); token++)
+		;
+	if (*token == '\0')
+	{
+		*cursor = token;
+		return NULL ;
+	}
+	for (end = token; *end != '\0' && !IS_DELIMITER(*end); end++)
+		;
+	*cursor = *end != '\0' ? end + 1 : end;
+	*end = '\0';
+	return token;
+}
+
+// Parse a start time in seconds with optional fraction into microseconds:
+static long long parse_start_time(char *token)
+{
+	long long usec, scale;
+	int negative;
+	char *frac;
+
+	// The sign applies to the fraction as well, e.g. "-0.5":
+	negative = *token == '-';
+	usec = llabs(strtoll(token, &frac, 10)) * 1000000LL;
+	if (*frac == '.')
+	{
+		// Add fraction digits, any beyond microseconds are ignored:
+		frac++;
+		for (scale = 100000; scale > 0 && *frac >= '0' && *frac <= '9';
+				scale /= 10)
+		{
+			usec += (*frac - '0') * scale;
+			frac++;
+		}
+	}
+	return negative ? -usec : usec;
+}
+
+/* Parses an optional "key=value" token given before the working directory.
+ * Returns 0 if the token was an option, otherwise -1. */
+static int parse_option(struct cmd_entry_struct *entry, char *token)
+{
+	if (strncmp(token, "id=", 3) == 0)
+	{
+		entry->id = token + 3;
+	}
+	else if (strncmp(token, "after=", 6) == 0)
+	{
+		entry->after = token + 6;
+	}
+	else if (strncmp(token, "est=", 4) == 0)
+	{
+		entry->est = parse_start_time(token + 4);
+		entry->rank = entry->est;
+	}
+	else if (strncmp(token, "prio=", 5) == 0)
+	{
+		entry->prio = atoi(token + 5);
+	}
+	else if (strncmp(token, "deadline=", 9) == 0)
+	{
+		entry->deadline = parse_start_time(token + 9);
+	}
+	else
+	{
+		return -1;
+	}
+	return 0;
+}
+
+/* Creates the entries of a mapped binary workload file and appends them to the
+ * list. The strings of the entries point into the mapped file. Nothing is
+ * added unless the whole file is valid. Returns the number of entries added,
+ * or -1 on failure. */
+static int load_binary(struct cmd_list_struct *list,
+		struct cmd_arena_struct *arena)
+{
+	struct wl_header_struct *header = (struct wl_header_struct *) arena->map;
+	struct wl_entry_struct *records, *record;
+	struct cmd_entry_struct *entries;
+	uint32_t *args;
+	char *pool, **argv;
+	uint64_t argv_count = 0;
+	uint32_t n, i;
+
+	// Check that the tables are within the file and aligned:
+	if (header->version != WL_VERSION
+			|| header->entry_offset % 8 != 0 || header->arg_offset % 4 != 0
+			|| header->entry_offset + (uint64_t) header->entry_count
+					* sizeof(struct wl_entry_struct) > arena->map_length
+			|| header->arg_offset + (uint64_t) header->arg_count
+					* sizeof(uint32_t) > arena->map_length
+			|| header->pool_offset + (uint64_t) header->pool_size
+					> arena->map_length
+			|| header->entry_count > INT32_MAX)
+	{
+		return -1;
+	}
+	records = (struct wl_entry_struct *) (arena->map + header->entry_offset);
+	args = (uint32_t *) (arena->map + header->arg_offset);
+	pool = arena->map + header->pool_offset;
+	// Check that all strings are terminated and within the pool:
+	if (header->pool_size > 0 && pool[header->pool_size - 1] != '\0')
+	{
+		return -1;
+	}
+	for (i = 0; i < header->arg_count; i++)
+	{
+		if (args[i] >= header->pool_size)
+		{
+			return -1;
+		}
+	}
+	for (n = 0; n < header->entry_count; n++)
+	{
+		record = &records[n];
+		if (record->dir == WL_NO_STRING || record->cmd == WL_NO_STRING
+				|| record->argc == 0
+				|| record->first_arg + (uint64_t) record->argc > header->arg_count
+				|| check_string(header, record->dir) != 0
+				|| check_string(header, record->cmd) != 0
+				|| check_string(header, record->new_stdin) != 0
+				|| check_string(header, record->new_stdout) != 0
+				|| check_string(header, record->id) != 0
+				|| check_string(header, record->after) != 0)
+		{
+			return -1;
+		}
+		argv_count += record->argc + 1;
+	}
+	// Argument ranges may overlap, so the vectors must still fit in the room
+	// allocated for them, and the entries and vectors in a size_t on 32-bit
+	// targets:
+	if (argv_count > (uint64_t) header->arg_count + header->entry_count
+			|| header->entry_count * (uint64_t) sizeof(struct cmd_entry_struct)
+					+ argv_count * sizeof(char*) > SIZE_MAX)
+	{
+		return -1;
+	}
+	if (header->entry_count == 0)
+	{
+		return 0;
+	}
+	// Allocate all entries and argument vectors at once:
+	entries = arena_alloc(arena,
+			header->entry_count * sizeof(struct cmd_entry_struct));
+	argv = arena_alloc(arena, argv_count * sizeof(char*));
+	if (entries == NULL || argv == NULL )
+	{
+		return -1;
+	}
+	for (n = 0; n < header->entry_count; n++)
+	{
+		record = &records[n];
+		entries[n].start_time = record->start_time;
+		entries[n].seq = n;
+		entries[n].class = record->class;
+		entries[n].dir = get_string(pool, record->dir);
+		entries[n].cmd = get_string(pool, record->cmd);
+		entries[n].argv = argv;
+		for (i = 0; i < record->argc; i++)
+		{
+			*argv++ = pool + args[record->first_arg + i];
+		}
+		*argv++ = NULL;
+		entries[n].new_stdin = get_string(pool, record->new_stdin);
+		entries[n].new_stdout = get_string(pool, record->new_stdout);
+		entries[n].id = get_string(pool, record->id);
+		entries[n].after = get_string(pool, record->after);
+		entries[n].est = record->est;
+		entries[n].rank = record->est;
+		entries[n].prio = record->prio;
+		entries[n].deadline = record->deadline;
+		entries[n].arena = arena;
+		add_last(list, &entries[n]);
+	}
+	arena->refs = header->entry_count;
+	return header->entry_count;
+}
+
+/* Returns 0 if the string offset is within the pool or WL_NO_STRING,
+ * otherwise -1. */
+static int check_string(struct wl_header_struct *header, uint32_t offset)
+{
+	return (offset == WL_NO_STRING || offset < header->pool_size) ? 0 : -1;
+}
+
+/* Returns the string at the offset in the pool, or NULL for WL_NO_STRING. */
+static char *get_string(char *pool, uint32_t offset)
+{
+	return offset == WL_NO_STRING ? NULL : pool + offset;
+}
+
+/* Adds a string to the pool unless an equal string is already in it, and sets
+ * offset to its offset in the pool. A NULL-pointer gives WL_NO_STRING.
+ * Returns 0 on success, otherwise -1. */
+static int pool_add(struct wl_pool_struct *pool, char *string,
+		uint32_t *offset)
+{
+	size_t slot, length;
+	char *new_data;
+
+	if (string == NULL )
+	{
+		*offset = WL_NO_STRING;
+		return 0;
+	}
+	// Look for an equal string:
+	slot = hash_string(string) & (pool->num_slots - 1);
+	while (pool->slots[slot] != WL_NO_STRING)
+	{
+		if (strcmp(pool->data + pool->slots[slot], string) == 0)
+		{
+			*offset = pool->slots[slot];
+			return 0;
+		}
+		slot = (slot + 1) & (pool->num_slots - 1);
+	}
+	// Append the string:
+	length = strlen(string) + 1;
+	if (pool->size + length >= WL_NO_STRING)
+	{
+		return -1;
+	}
+	if (pool->size + length > pool->capacity)
+	{
+		pool->capacity = 2 * (pool->size + length) + 4096;
+		if ((new_data = realloc(pool->data, pool->capacity)) == NULL )
+		{
+			return -1;
+		}
+		pool->data = new_data;
+	}
+	memcpy(pool->data + pool->size, string, length);
+	*offset = pool->slots[slot] = pool->size;
+	pool->size += length;
+	// Keep the table at most half full:
+	if (++pool->count * 2 > pool->num_slots)
+	{
+		return pool_grow_slots(pool);
+	}
+	return 0;
+}
+
+/* Doubles the string table of the pool, or creates it. Returns 0 on success,
+ * otherwise -1. */
+static int pool_grow_slots(struct wl_pool_struct *pool)
+{
+	uint32_t *slots, *old_slots = pool->slots;
+	size_t num_slots, old_num_slots = pool->num_slots, slot, i;
+
+	num_slots = old_num_slots == 0 ? WL_STRING_SLOTS : 2 * old_num_slots;
+	if ((slots = malloc(num_slots * sizeof(uint32_t))) == NULL )
+	{
+		return -1;
+	}
+	memset(slots, 0xff, num_slots * sizeof(uint32_t));
+	for (i = 0; i < old_num_slots; i++)
+	{
+		if (old_slots[i] == WL_NO_STRING)
+		{
+			continue;
+		}
+		slot = hash_string(pool->data + old_slots[i]) & (num_slots - 1);
+		while (slots[slot] != WL_NO_STRING)
+		{
+			slot = (slot + 1) & (num_slots - 1);
+		}
+		slots[slot] = old_slots[i];
+	}
+	free(old_slots);
+	pool->slots = slots;
+	pool->num_slots = num_slots;
+	return 0;
+}
+
+/* FNV-1a hash of a string. */
+static uint32_t hash_string(char *string)
+{
+	uint32_t hash = 2166136261u;
+
+	while (*string != '\0')
+	{
+		hash = (hash ^ (unsigned char) *string++) * 16777619u;
+	}
+	return hash;
 }
@@ -5,7 +5,46 @@
  * contents of the input file.
  *
  * Each line of the input file should have the format below:
- * <START> <DIRECTORY> <COMMAND>
+ * <START> <CLASS> <DIRECTORY> <COMMAND> [ARGUMENTS]
+ *
+ * START is the offset from workload start in seconds and may have a fractional
+ * part, e.g. "12.125". It is stored with microsecond resolution.
+ *
+ * Optional dependency tokens may be given between CLASS and DIRECTORY:
+ *   id=NAME         names the command so that later lines can depend on it
+ *   after=A,B,...   the command is held until the named commands have
+ *                   finished, START then only gives the earliest start
+ *   est=SECONDS     estimated run time, used to rank commands by their
+ *                   critical path (default 1 second)
+ * A command can only depend on commands given on earlier lines.
+ *
+ * Optional scheduling tokens may be given in the same place:
+ *   prio=N          priority, higher is started first (default 0)
+ *   deadline=SECS   deadline as an offset from workload start, like START
+ * Which of rank, prio and deadline orders the ready queue is chosen when the
+ * scheduler is started (see ready_queue.h).
+ *
+ * Lines don't need to be sorted by START, see sort_cmd_list(). There is no
+ * limit on the length of a line.
+ *
+ * The file is mapped and parsed in place: the strings of an entry point into
+ * the mapped file, and all entries and argument vectors are allocated from a
+ * few large blocks. This storage is shared by the entries and freed when the
+ * last of them is freed. An entry is in at most one list at a time.
+ *
+ * The input file may also be a binary workload file as written by
+ * write_binary_workload(), which is detected by its magic and used without
+ * parsing. It has a fixed-size header followed by a table with one fixed-size
+ * record per command, a table of argument string offsets and a pool of
+ * null-terminated strings, in which equal strings (working dirs, commands,
+ * ...) are stored once. Numbers are in host byte order. The seq of an entry is
+ * its position in the record table. The files are made from text workloads
+ * with wlconv, or directly by wlgen -b.
+ *
+ * A text workload can also be read lazily as a stream, see open_cmd_stream().
+ * Only a bounded window of upcoming entries is then kept in the list, so
+ * memory doesn't grow with the length of the workload, and the input may be a
+ * pipe or stdin.
  * */
 
 #ifndef _CMD_LIST_H
@@ -14,16 +53,28 @@
 /* Struct representing a linked list of commands. */
 struct cmd_list_struct;
 
+/* Storage shared by entries, see above. */
+struct cmd_arena_struct;
+
 /* Struct representing each entry (command) in the list. */
 struct cmd_entry_struct
 {
-	int start_time;  // Command start time
+	long long start_time;  // Command start time (microseconds)
+	int seq;    // Position of the command in the input file, from 0
 	int class; // Class number, 0 for undefined
 	char *dir;  // Working directory
 	char *cmd;  // Command name
 	char **argv;    // Argument vector
     char *new_stdin;    // Redirect stdin?
     char *new_stdout;   // Redirect stdout?
+	char *id;   // Name for dependencies (id=), NULL if none
+	char *after;    // Names of parents (after=), NULL if none
+	long long est;  // Estimated run time (microseconds)
+	long long rank; // Longest estimated path from start to end of workload
+	int prio;   // Priority (prio=), higher first
+	long long deadline; // Deadline (microseconds), -1 if none
+	struct cmd_entry_struct *next;	// Next entry in the list
+	struct cmd_arena_struct *arena;	// Storage of the entry
 };
 
 /* Type definition of a command list. */
@@ -37,15 +88,73 @@ typedef struct cmd_entry_struct *cmd_entry;
  * success, otherwise NULL. */
 cmd_list create_cmd_list(char *file_name);
 
+/* Creates a new command list that reads the text workload file with the
+ * specified file name, or stdin if it is "-", as entries are taken from it.
+ * At most window entries are read ahead. Lines should be sorted by START,
+ * since only the entries in the window can be sorted. Malformed lines are
+ * skipped. Pipes are read without blocking, see get_cmd_stream_fd(). Returns a
+ * pointer to the created list on success, otherwise NULL. */
+cmd_list open_cmd_stream(char *file_name, int window);
+
+/* Returns the file descriptor that a stream list is waiting for input on: the
+ * window isn't full, but no more input could be read without blocking. The
+ * list is refilled by the next get_first() or take_first() after the
+ * descriptor has become readable. Returns -1 if the list isn't waiting, and
+ * always for lists that aren't streams or that read regular files. */
+int get_cmd_stream_fd(cmd_list list);
+
+/* Returns the number of malformed lines skipped by a stream list. */
+int get_skipped_lines(cmd_list list);
+
+/* Parses a single line in the input file format. The line is copied. Returns a
+ * new entry with seq set to 0, to be freed with free_cmd_entry(), or NULL if
+ * the line is malformed. */
+cmd_entry parse_cmd_line(char *line);
+
+/* Creates a new empty command list, e.g. for use as a queue of entries taken
+ * from another list. Returns a pointer to the created list on success,
+ * otherwise NULL. */
+cmd_list create_empty_cmd_list(void);
+
 /* Destroys the specified list and frees allocated memory for all remaining
  * entries. */
 void destroy_cmd_list(cmd_list list);
 
 /* Returns a pointer to the first entry in the list without removing it.
- * If the list is empty a NULL-pointer is returned. */
+ * If the list is empty a NULL-pointer is returned. A stream list is refilled
+ * first if its window isn't full. */
 cmd_entry get_first(cmd_list list);
 
 /* Removes the first command entry in the list and frees allocated memory. */
 void remove_first(cmd_list list);
 
+/* Removes the first command entry in the list without freeing it and returns
+ * it. The entry must later be freed with free_cmd_entry(). If the list is
+ * empty a NULL-pointer is returned. A stream list is refilled afterwards. */
+cmd_entry take_first(cmd_list list);
+
+/* Appends an entry returned by take_first() to the end of the list. The list
+ * takes over ownership of the entry. Always returns 0. */
+int add_last(cmd_list list, cmd_entry entry);
+
+/* Inserts an entry returned by take_first() in front of the first entry that
+ * it goes before according to the before() function, or last if there is no
+ * such entry. Entries that compare equal keep their order. The list takes
+ * over ownership of the entry. Always returns 0. */
+int insert_sorted(cmd_list list, cmd_entry entry,
+		int (*before)(cmd_entry entry, cmd_entry other));
+
+/* Sorts the list with a stable merge sort, so that entry comes before other
+ * if before(entry, other) is true. */
+void sort_cmd_list(cmd_list list,
+		int (*before)(cmd_entry entry, cmd_entry other));
+
+/* Writes the entries of the list, in list order, to a binary workload file
+ * with the specified file name. Returns 0 on success, otherwise -1. */
+int write_binary_workload(cmd_list list, char *file_name);
+
+/* Frees an entry returned by take_first(). Its storage is freed along with the
+ * last entry sharing it. */
+void free_cmd_entry(cmd_entry entry);
+
 #endif
@@ -0,0 +1,399 @@
+/*
+ * dag.c
+ *
+ * Implementation of the dag module.
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "dag.h"
+
+#define START_NODES 64
+#define START_IDS 64
+
+/* A command in the DAG, found by its seq number (see get_node()). */
+struct dag_node_struct {
+    int waiting;        // Parents not yet finished
+    int finished;
+    int num_children;
+    int max_children;
+    int *children;      // seq numbers of the children
+    long long est;
+    long long rank;
+    char *id;           // Key of the command in the id table, or NULL
+    cmd_entry cmd;      // Set while the command is held (or not yet ranked)
+};
+
+/* Slot in the open-addressing table from id to seq number. */
+struct dag_id_struct {
+    char *id;           // NULL for an empty slot
+    int seq;
+};
+
+struct dag_struct {
+    int base;           // seq number of the first node kept
+    int first;          // Index of the first node kept, nodes before it are
+                        // pruned
+    int num_nodes;      // Nodes kept, from base on
+    int max_nodes;
+    int num_ranked;     // Commands below this seq number have their rank set
+    struct dag_node_struct *nodes;
+    int num_ids;
+    int max_ids;        // Always a power of two
+    struct dag_id_struct *ids;
+    int held;
+    int unknown_finished;   // Unknown parents are taken to be pruned
+};
+
+static struct dag_node_struct *get_node(dag d, int seq);
+static int grow_nodes(dag d, int end_seq);
+static int add_child(struct dag_node_struct *node, int child_seq);
+static int find_id(dag d, char *id);
+static char *insert_id(dag d, char *id, int seq);
+static void remove_id(dag d, char *id);
+static unsigned int hash_id(char *id);
+
+dag create_dag(void) {
+    dag d;
+
+    if ((d = malloc(sizeof(struct dag_struct))) == NULL) {
+        return NULL;
+    }
+    d->base = 0;
+    d->first = 0;
+    d->num_nodes = 0;
+    d->num_ranked = 0;
+    d->max_nodes = START_NODES;
+    d->num_ids = 0;
+    d->max_ids = START_IDS;
+    d->held = 0;
+    d->unknown_finished = 0;
+    d->nodes = malloc(sizeof(struct dag_node_struct) * d->max_nodes);
+    d->ids = calloc(d->max_ids, sizeof(struct dag_id_struct));
+    if (d->nodes == NULL || d->ids == NULL) {
+        free(d->nodes);
+        free(d->ids);
+        free(d);
+        return NULL;
+    }
+    return d;
+}
+
+void destroy_dag(dag d) {
+    if (d == NULL) {
+        return;
+    }
+    for (int i=d->first;i<d->first+d->num_nodes;i++) {
+        free(d->nodes[i].children);
+        if (d->nodes[i].waiting > 0 && d->nodes[i].cmd != NULL) {
+            free_cmd_entry(d->nodes[i].cmd);
+        }
+    }
+    for (int i=0;i<d->max_ids;i++) {
+        free(d->ids[i].id);
+    }
+    free(d->nodes);
+    free(d->ids);
+    free(d);
+}
+
+int add_dag_command(dag d, cmd_entry cmd) {
+    struct dag_node_struct *node;
+    int *parents = NULL;
+    int num_parents = 0, linked = 0;
+    int old_num_nodes = d->num_nodes;
+    char *names, *name, *save, *id = NULL;
+    int parent;
+
+    if (cmd->seq < d->base + d->num_nodes
+            || (cmd->id != NULL && find_id(d, cmd->id) >= 0)) {
+        return -1;
+    }
+    // Check all parents before anything is changed, finished ones are left
+    // out
+    if (cmd->after != NULL) {
+        if ((names = malloc(strlen(cmd->after) + 1)) == NULL
+                || (parents = malloc(sizeof(int) * (strlen(cmd->after) / 2 + 1))) == NULL) {
+            free(names);
+            return -1;
+        }
+        strcpy(names, cmd->after);
+        for (name = strtok_r(names, ",", &save); name != NULL;
+                name = strtok_r(NULL, ",", &save)) {
+            if ((parent = find_id(d, name)) < 0 && d->unknown_finished) {
+                continue;
+            }
+            if (parent < 0) {
+                printf("unknown dependency %s\n", name);
+                free(names);
+                free(parents);
+                return -1;
+            }
+            if (!get_node(d, parent)->finished) {
+                parents[num_parents++] = parent;
+            }
+        }
+        free(names);
+    }
+    // Link the command to its parents first, every step is undone if a later
+    // one fails
+    while (linked < num_parents && add_child(get_node(d, parents[linked]), cmd->seq) == 0) {
+        linked++;
+    }
+    if (linked < num_parents || grow_nodes(d, cmd->seq + 1) != 0
+            || (cmd->id != NULL && (id = insert_id(d, cmd->id, cmd->seq)) == NULL)) {
+        while (linked > 0) {
+            get_node(d, parents[--linked])->num_children--;
+        }
+        d->num_nodes = old_num_nodes;
+        free(parents);
+        return -1;
+    }
+    free(parents);
+    node = get_node(d, cmd->seq);
+    node->finished = 0;
+    node->est = cmd->est;
+    node->rank = cmd->est;
+    node->id = id;
+    node->cmd = cmd;
+    node->waiting = num_parents;
+    if (node->waiting > 0) {
+        d->held++;
+        return 1;
+    }
+    return 0;
+}
+
+void rank_dag_commands(dag d) {
+    struct dag_node_struct *node;
+    long long longest;
+
+    // Children always have higher seq numbers than their parents, and the
+    // ranks of commands added earlier don't change
+    for (int seq=d->base+d->num_nodes-1;seq>=d->num_ranked && seq>=d->base;seq--) {
+        node = get_node(d, seq);
+        longest = 0;
+        for (int j=0;j<node->num_children;j++) {
+            if (get_node(d, node->children[j])->rank > longest) {
+                longest = get_node(d, node->children[j])->rank;
+            }
+        }
+        node->rank = node->est + longest;
+        if (node->cmd != NULL) {
+            node->cmd->rank = node->rank;
+            // Commands that aren't held now belong to the command list
+            if (node->waiting == 0) {
+                node->cmd = NULL;
+            }
+        }
+    }
+    d->num_ranked = d->base + d->num_nodes;
+}
+
+int finish_dag_command(dag d, int seq, cmd_list released) {
+    struct dag_node_struct *node, *child;
+    int num_released = 0;
+
+    if (seq < d->base || seq >= d->base + d->num_nodes || get_node(d, seq)->finished) {
+        return 0;
+    }
+    node = get_node(d, seq);
+    node->finished = 1;
+    for (int i=0;i<node->num_children;i++) {
+        child = get_node(d, node->children[i]);
+        if (--child->waiting == 0 && child->cmd != NULL) {
+            add_last(released, child->cmd);
+            child->cmd = NULL;
+            d->held--;
+            num_released++;
+        }
+    }
+    // Finished commands are never ranked again
+    free(node->children);
+    node->children = NULL;
+    node->num_children = node->max_children = 0;
+    return num_released;
+}
+
+int prune_dag(dag d) {
+    struct dag_node_struct *node;
+    int pruned = 0;
+
+    while (d->num_nodes > 0 && (node = get_node(d, d->base))->finished) {
+        if (node->id != NULL) {
+            remove_id(d, node->id);
+        }
+        d->base++;
+        d->first++;
+        d->num_nodes--;
+        pruned++;
+    }
+    return pruned;
+}
+
+void set_unknown_parents_finished(dag d, int enable) {
+    d->unknown_finished = enable;
+}
+
+int get_held_count(dag d) {
+    return d->held;
+}
+
+/*
+ * Returns the node of a command that is kept.
+ */
+static struct dag_node_struct *get_node(dag d, int seq) {
+    return &d->nodes[d->first + seq - d->base];
+}
+
+/*
+ * Grows the node array to hold the nodes up to end_seq. The new nodes are
+ * cleared and marked finished, so that seq numbers without a command never
+ * hold up pruning. Returns 0 on success, otherwise -1.
+ */
+static int grow_nodes(dag d, int end_seq) {
+    struct dag_node_struct *nodes;
+    int max_nodes = d->max_nodes;
+    int min_nodes = end_seq - d->base;
+
+    // When the array is full, move the kept nodes to the front if the pruned
+    // ones take up the larger part of it, otherwise grow it
+    if (d->first + min_nodes > d->max_nodes && d->first >= d->num_nodes) {
+        memmove(d->nodes, &d->nodes[d->first], sizeof(struct dag_node_struct) * d->num_nodes);
+        d->first = 0;
+    }
+    while (max_nodes < d->first + min_nodes) {
+        max_nodes *= 2;
+    }
+    if (max_nodes != d->max_nodes) {
+        if ((nodes = realloc(d->nodes, sizeof(struct dag_node_struct) * max_nodes)) == NULL) {
+            return -1;
+        }
+        d->nodes = nodes;
+        d->max_nodes = max_nodes;
+    }
+    memset(&d->nodes[d->first + d->num_nodes], 0,
+            sizeof(struct dag_node_struct) * (min_nodes - d->num_nodes));
+    for (int i=d->num_nodes;i<min_nodes;i++) {
+        d->nodes[d->first + i].finished = 1;
+    }
+    d->num_nodes = min_nodes;
+    return 0;
+}
+
+/*
+ * Appends a child to a node. Returns 0 on success, otherwise -1.
+ */
+static int add_child(struct dag_node_struct *node, int child_seq) {
+    int *children;
+
+    if (node->num_children == node->max_children) {
+        node->max_children = node->max_children ? node->max_children * 2 : 4;
+        if ((children = realloc(node->children, sizeof(int) * node->max_children)) == NULL) {
+            return -1;
+        }
+        node->children = children;
+    }
+    node->children[node->num_children++] = child_seq;
+    return 0;
+}
+
+/*
+ * Returns the seq number of the command with the given id, or -1 if there is
+ * none.
+ */
+static int find_id(dag d, char *id) {
+    unsigned int mask = d->max_ids - 1;
+
+    for (unsigned int i=hash_id(id) & mask;d->ids[i].id != NULL;i=(i+1) & mask) {
+        if (strcmp(d->ids[i].id, id) == 0) {
+            return d->ids[i].seq;
+        }
+    }
+    return -1;
+}
+
+/*
+ * Adds an id that isn't in the table yet, growing the table to keep it at
+ * most half full. Returns the copy of the id kept in the table, or NULL on
+ * failure.
+ */
+static char *insert_id(dag d, char *id, int seq) {
+    struct dag_id_struct *old_ids = d->ids;
+    int old_max = d->max_ids;
+    unsigned int i, mask;
+    char *copy;
+
+    if (2 * (d->num_ids + 1) > d->max_ids) {
+        if ((d->ids = calloc(2 * old_max, sizeof(struct dag_id_struct))) == NULL) {
+            d->ids = old_ids;
+            return NULL;
+        }
+        d->max_ids = 2 * old_max;
+        mask = d->max_ids - 1;
+        for (int j=0;j<old_max;j++) {
+            if (old_ids[j].id != NULL) {
+                for (i=hash_id(old_ids[j].id) & mask;d->ids[i].id != NULL;i=(i+1) & mask) {
+                }
+                d->ids[i] = old_ids[j];
+            }
+        }
+        free(old_ids);
+    }
+    if ((copy = malloc(strlen(id) + 1)) == NULL) {
+        return NULL;
+    }
+    strcpy(copy, id);
+    mask = d->max_ids - 1;
+    for (i=hash_id(id) & mask;d->ids[i].id != NULL;i=(i+1) & mask) {
+    }
+    d->ids[i].id = copy;
+    d->ids[i].seq = seq;
+    d->num_ids++;
+    return copy;
+}
+
+/*
+ * Removes an id from the table and frees it. The entries after it in the
+ * same probe run are moved back, so that no lookup stops early.
+ */
+static void remove_id(dag d, char *id) {
+    unsigned int mask = d->max_ids - 1;
+    unsigned int i, j, home;
+
+    for (i=hash_id(id) & mask;d->ids[i].id != NULL;i=(i+1) & mask) {
+        if (strcmp(d->ids[i].id, id) == 0) {
+            break;
+        }
+    }
+    if (d->ids[i].id == NULL) {
+        return;
+    }
+    free(d->ids[i].id);
+    d->ids[i].id = NULL;
+    d->num_ids--;
+    for (j=(i+1) & mask;d->ids[j].id != NULL;j=(j+1) & mask) {
+        // An entry may fill the hole if its home slot isn't between the
+        // hole and itself
+        home = hash_id(d->ids[j].id) & mask;
+        if (((j - home) & mask) >= ((j - i) & mask)) {
+            d->ids[i] = d->ids[j];
+            d->ids[j].id = NULL;
+            i = j;
+        }
+    }
+}
+
+/*
+ * FNV-1a hash of an id.
+ */
+static unsigned int hash_id(char *id) {
+    unsigned int hash = 2166136261u;
+
+    while (*id != '\0') {
+        hash = (hash ^ (unsigned char) *id++) * 16777619u;
+    }
+    return hash;
+}
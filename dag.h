@@ -0,0 +1,66 @@
+/* dag.h
+ *
+ * Dependencies between the commands of a workload.
+ *
+ * Commands form a directed acyclic graph: id= names a command and after= adds
+ * edges from the named parents (see cmd_list.h). Parents are always given
+ * before their children, so commands are added in topological order and the
+ * graph is built in a single pass over the command list.
+ *
+ * Commands with parents are held by the DAG until their last parent has
+ * finished. Every command is ranked by the longest chain of estimated run
+ * times from its own start to the end of the workload, so that the ready
+ * commands on the critical path can be started first.
+ *
+ * Commands are identified by their seq number.
+ * */
+
+#ifndef _DAG_H
+#define _DAG_H
+
+#include "cmd_list.h"
+
+/* Each DAG instance is represented by a dag_struct. */
+struct dag_struct;
+
+/* Typedef for a user handle to a DAG instance. */
+typedef struct dag_struct *dag;
+
+/* Creates an empty DAG. On success a handle is returned, otherwise NULL. */
+dag create_dag(void);
+
+/* Frees allocated memory, including all commands still held. */
+void destroy_dag(dag d);
+
+/* Adds a command taken from a command list. Returns 1 if the command has
+ * unfinished parents and is now held by the DAG, 0 if it may be started at its
+ * start time, and -1 if a parent is unknown, the id is already used or memory
+ * runs out. The DAG is unchanged if -1 is returned. */
+int add_dag_command(dag d, cmd_entry cmd);
+
+/* Sets the rank of every command added since the last call. Called once a
+ * batch of commands is added, before any of them is started. Commands are
+ * only ranked by children added in the same or an earlier batch. */
+void rank_dag_commands(dag d);
+
+/* Marks the command with the given seq number as finished. Commands whose last
+ * parent it was are released to the end of the released list. Returns the
+ * number of released commands. */
+int finish_dag_command(dag d, int seq, cmd_list released);
+
+/* Forgets the finished commands that only follow finished commands, by seq
+ * number, and frees their nodes and ids. Their ids can't be named by after=
+ * any more. Used by long-running schedulers, e.g. a daemon, to keep memory
+ * bounded. Returns the number of commands forgotten. */
+int prune_dag(dag d);
+
+/* With enable set, an after= name that isn't known is taken to be a command
+ * forgotten by prune_dag(), which has finished, instead of an error. Only
+ * valid if commands can only name commands added before them, e.g. when a
+ * workload is added line by line. */
+void set_unknown_parents_finished(dag d, int enable);
+
+/* Returns the number of commands held by the DAG. */
+int get_held_count(dag d);
+
+#endif
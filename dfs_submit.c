@@ -0,0 +1,92 @@
+/*
+ * dfs_submit.c
+ *
+ * Client for submitting processes to a DFS scheduler running in daemon mode.
+ *
+ * usage: ./dfs_submit <socket> [workloadfile]
+ *
+ * Sends all lines of workloadfile, or of stdin if no file is given, as one
+ * batch and prints the reply of the scheduler. START is the delay from the
+ * time of submission. Exits with 0 if the whole batch was accepted.
+ */
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <fcntl.h>
+#include <sys/socket.h>
+#include <sys/un.h>
+
+#define BUFFER_SIZE 4096
+
+int write_all(int fd, char *buf, size_t length);
+
+int main(int argc, char *argv[]) {
+    struct sockaddr_un addr;
+    char buf[BUFFER_SIZE];
+    char reply[256];
+    size_t reply_length = 0;
+    ssize_t n;
+    int sock, input = 0;
+
+    if (argc < 2 || argc > 3) {
+        printf("usage: %s <socket> [workloadfile]\n", argv[0]);
+        return 1;
+    }
+    if (argc == 3 && (input = open(argv[2], O_RDONLY)) == -1) {
+        printf("Failed to open %s\n", argv[2]);
+        return 1;
+    }
+    if (strlen(argv[1]) >= sizeof(addr.sun_path)) {
+        printf("Socket path too long: %s\n", argv[1]);
+        return 1;
+    }
+    memset(&addr, 0, sizeof(addr));
+    addr.sun_family = AF_UNIX;
+    strcpy(addr.sun_path, argv[1]);
+    if ((sock = socket(AF_UNIX, SOCK_STREAM, 0)) == -1
+            || connect(sock, (struct sockaddr *) &addr, sizeof(addr)) != 0) {
+        printf("Failed to connect to %s\n", argv[1]);
+        return 1;
+    }
+
+    // Send the batch, the end of it is marked by shutting down our side
+    while ((n = read(input, buf, sizeof(buf))) > 0) {
+        if (write_all(sock, buf, n) != 0) {
+            printf("Failed to send batch\n");
+            return 1;
+        }
+    }
+    shutdown(sock, SHUT_WR);
+
+    // Wait for the reply
+    while (reply_length < sizeof(reply) - 1
+            && (n = read(sock, reply + reply_length, sizeof(reply) - 1 - reply_length)) > 0) {
+        reply_length += n;
+    }
+    reply[reply_length] = '\0';
+    close(sock);
+    if (reply_length == 0) {
+        printf("No reply from scheduler\n");
+        return 1;
+    }
+    printf("%s", reply);
+    return strncmp(reply, "accepted", 8) == 0 ? 0 : 1;
+}
+
+/*
+ * Writes length bytes to fd.
+ * Returns 0 on success, otherwise -1.
+ */
+int write_all(int fd, char *buf, size_t length) {
+    ssize_t n;
+
+    while (length > 0) {
+        if ((n = write(fd, buf, length)) <= 0) {
+            return -1;
+        }
+        buf += n;
+        length -= n;
+    }
+    return 0;
+}
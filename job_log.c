@@ -0,0 +1,82 @@
+/*
+ * job_log.c
+ *
+ * Implementation of the job log module.
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <sys/wait.h>
+
+#include "job_log.h"
+
+// Size of the stdio buffer of the log file:
+#define JOB_LOG_BUFFER_SIZE 65536
+
+struct job_log_struct {
+    FILE *file;
+    char *buffer;
+};
+
+static long long timeval_usec(struct timeval *tv);
+
+job_log create_job_log(char *file_name) {
+    job_log log;
+
+    if ((log = malloc(sizeof(struct job_log_struct))) == NULL) {
+        return NULL;
+    }
+    if ((log->buffer = malloc(JOB_LOG_BUFFER_SIZE)) == NULL) {
+        free(log);
+        return NULL;
+    }
+    if ((log->file = fopen(file_name, "we")) == NULL) {
+        free(log->buffer);
+        free(log);
+        return NULL;
+    }
+    setvbuf(log->file, log->buffer, _IOFBF, JOB_LOG_BUFFER_SIZE);
+    fprintf(log->file, "seq,pid,class,arrival,launch,exit,tiles_visited,"
+            "utime,stime,maxrss,nvcsw,nivcsw,exit_code\n");
+    return log;
+}
+
+void destroy_job_log(job_log log) {
+    if (log == NULL) {
+        return;
+    }
+    fclose(log->file);
+    free(log->buffer);
+    free(log);
+}
+
+int write_job_record(job_log log, pid_t pid, int class,
+        struct job_info_struct *info, long long exit_time, int status,
+        struct rusage *usage) {
+    int exit_code;
+
+    if (WIFEXITED(status)) {
+        exit_code = WEXITSTATUS(status);
+    }
+    else if (WIFSIGNALED(status)) {
+        exit_code = 128 + WTERMSIG(status);
+    }
+    else {
+        exit_code = -1;
+    }
+    if (fprintf(log->file, "%i,%i,%i,%lld,%lld,%lld,%i,%lld,%lld,%ld,%ld,%ld,%i\n",
+            info->seq, pid, class, info->arrival, info->launch, exit_time,
+            info->tiles_visited, timeval_usec(&usage->ru_utime),
+            timeval_usec(&usage->ru_stime), usage->ru_maxrss, usage->ru_nvcsw,
+            usage->ru_nivcsw, exit_code) < 0) {
+        return -1;
+    }
+    return 0;
+}
+
+/*
+ * Converts a timeval to microseconds.
+ */
+static long long timeval_usec(struct timeval *tv) {
+    return tv->tv_sec * 1000000LL + tv->tv_usec;
+}
@@ -0,0 +1,43 @@
+/* job_log.h
+ *
+ * Completion records of finished processes.
+ *
+ * One record is written for every reaped process, as a line of CSV with the
+ * columns below. Times are in microseconds, arrival, launch and exit relative
+ * to the start of the workload. maxrss is in kilobytes. exit_code is the exit
+ * status of the process, or 128 + the signal number if it was killed.
+ *
+ * seq,pid,class,arrival,launch,exit,tiles_visited,utime,stime,maxrss,
+ * nvcsw,nivcsw,exit_code
+ *
+ * Records are buffered and reach the file in large writes.
+ * */
+
+#ifndef _JOB_LOG_H
+#define _JOB_LOG_H
+
+#include <unistd.h>
+#include <sys/resource.h>
+#include "proc_table.h"
+
+/* Each log instance is represented by a job_log_struct. */
+struct job_log_struct;
+
+/* Typedef for a user handle to a log instance. */
+typedef struct job_log_struct *job_log;
+
+/* Creates the file and writes the header line. On success a handle to the log
+ * is returned, otherwise NULL. */
+job_log create_job_log(char *file_name);
+
+/* Flushes and closes the file and frees allocated memory. */
+void destroy_job_log(job_log log);
+
+/* Writes the record of a reaped process, with the job info kept while it ran,
+ * its exit time, its wait status and the resource usage from wait4().
+ * On success 0 is returned, otherwise -1. */
+int write_job_record(job_log log, pid_t pid, int class,
+        struct job_info_struct *info, long long exit_time, int status,
+        struct rusage *usage);
+
+#endif
@@ -0,0 +1,323 @@
+/*
+ * launcher.c
+ *
+ * Implementation of the launcher module.
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <fcntl.h>
+#include <signal.h>
+#include <pthread.h>
+#include <sys/socket.h>
+
+// Tilera
+#include <tmc/cpus.h>
+#include <tmc/task.h>
+
+#include "launcher.h"
+
+struct launcher_struct {
+    int num_threads;
+    pthread_t *threads;
+    sigset_t child_mask;        // Signal mask of started jobs (empty)
+
+    pthread_mutex_t lock;
+    pthread_cond_t work_cond;   // Signalled when a batch is submitted
+    pthread_cond_t done_cond;   // Signalled when a batch is finished
+    struct launch_job_struct *jobs;
+    int num_jobs;
+    int next_job;               // Next job in batch to hand out
+    int jobs_left;              // Jobs in batch not yet started
+    int started;                // Jobs in batch successfully started
+    int shutdown;
+};
+
+static void *launcher_thread(void *arg);
+static pid_t start_job(launcher l, struct launch_job_struct *job);
+static int open_relative(cmd_entry cmd, char *file, int flags);
+static void send_events(int fd, int *fds);
+static int receive_events(int fd, int *fds);
+
+launcher create_launcher(int num_threads) {
+    launcher l;
+    sigset_t all_signals, old_mask;
+
+    if (num_threads <= 0) {
+        return NULL;
+    }
+    if ((l = malloc(sizeof(struct launcher_struct))) == NULL) {
+        return NULL;
+    }
+    if ((l->threads = malloc(sizeof(pthread_t) * num_threads)) == NULL) {
+        free(l);
+        return NULL;
+    }
+    l->num_threads = num_threads;
+    l->jobs = NULL;
+    l->num_jobs = 0;
+    l->next_job = 0;
+    l->jobs_left = 0;
+    l->started = 0;
+    l->shutdown = 0;
+    pthread_mutex_init(&l->lock, NULL);
+    pthread_cond_init(&l->work_cond, NULL);
+    pthread_cond_init(&l->done_cond, NULL);
+
+    // Launcher threads never handle signals, those belong to the scheduler.
+    // Started jobs get an empty mask, whatever the scheduler has blocked.
+    sigemptyset(&l->child_mask);
+    sigfillset(&all_signals);
+    pthread_sigmask(SIG_BLOCK, &all_signals, &old_mask);
+    for (int i=0;i<num_threads;i++) {
+        if (pthread_create(&l->threads[i], NULL, launcher_thread, l) != 0) {
+            pthread_sigmask(SIG_SETMASK, &old_mask, NULL);
+            l->num_threads = i;
+            destroy_launcher(l);
+            return NULL;
+        }
+    }
+    pthread_sigmask(SIG_SETMASK, &old_mask, NULL);
+    return l;
+}
+
+void destroy_launcher(launcher l) {
+    if (l == NULL) {
+        return;
+    }
+    pthread_mutex_lock(&l->lock);
+    l->shutdown = 1;
+    pthread_cond_broadcast(&l->work_cond);
+    pthread_mutex_unlock(&l->lock);
+    for (int i=0;i<l->num_threads;i++) {
+        pthread_join(l->threads[i], NULL);
+    }
+    pthread_cond_destroy(&l->done_cond);
+    pthread_cond_destroy(&l->work_cond);
+    pthread_mutex_destroy(&l->lock);
+    free(l->threads);
+    free(l);
+}
+
+int launch_processes(launcher l, struct launch_job_struct *jobs, int num_jobs) {
+    int started;
+
+    if (num_jobs <= 0) {
+        return 0;
+    }
+    pthread_mutex_lock(&l->lock);
+    l->jobs = jobs;
+    l->num_jobs = num_jobs;
+    l->next_job = 0;
+    l->jobs_left = num_jobs;
+    l->started = 0;
+    pthread_cond_broadcast(&l->work_cond);
+    while (l->jobs_left > 0) {
+        pthread_cond_wait(&l->done_cond, &l->lock);
+    }
+    started = l->started;
+    l->jobs = NULL;
+    l->num_jobs = 0;
+    pthread_mutex_unlock(&l->lock);
+    return started;
+}
+
+/*
+ * Thread function. Picks jobs from the current batch until the launcher is
+ * shut down.
+ */
+static void *launcher_thread(void *arg) {
+    launcher l = (launcher) arg;
+    struct launch_job_struct *job;
+    pid_t pid;
+
+    pthread_mutex_lock(&l->lock);
+    while (1) {
+        while (!l->shutdown && (l->jobs == NULL || l->next_job >= l->num_jobs)) {
+            pthread_cond_wait(&l->work_cond, &l->lock);
+        }
+        if (l->shutdown) {
+            break;
+        }
+        job = &l->jobs[l->next_job++];
+        pthread_mutex_unlock(&l->lock);
+
+        pid = start_job(l, job);
+        clock_gettime(CLOCK_MONOTONIC, &job->launched);
+
+        pthread_mutex_lock(&l->lock);
+        job->pid = pid;
+        if (pid > 0) {
+            l->started++;
+        }
+        if (--l->jobs_left == 0) {
+            pthread_cond_signal(&l->done_cond);
+        }
+    }
+    pthread_mutex_unlock(&l->lock);
+    return NULL;
+}
+
+/*
+ * Starts a single job. Everything that can be done before vfork() is done here
+ * in the launcher thread, so the child only restores its signal mask, changes
+ * directory, redirects stdin, stdout and stderr and execs. A counted job opens
+ * its events right before exec and passes them back over a socket, so the
+ * counters start with the job.
+ * Returns the pid of the started job or -1 on failure.
+ */
+static pid_t start_job(launcher l, struct launch_job_struct *job) {
+    cmd_entry cmd = job->cmd;
+    int stdin_fd = -1;
+    int stdout_fd = job->out_fds[0];
+    int stderr_fd = job->out_fds[1];
+    int sock[2] = {-1, -1};
+    int event_fds[JOB_EVENTS];
+    pid_t pid;
+
+    job->counters = NULL;
+
+    // The child inherits the affinity of this thread. The cpu may have left
+    // the cpu set since the job was placed.
+    if (tmc_cpus_set_my_cpu(job->cpu) < 0) {
+        printf("failed to set cpu %i for %s\n", job->cpu, cmd->cmd);
+        return -1;
+    }
+    if (cmd->new_stdin != NULL
+            && (stdin_fd = open_relative(cmd, cmd->new_stdin, O_RDONLY)) == -1) {
+        printf("failed to open %s while redirecting stdin\n", cmd->new_stdin);
+        return -1;
+    }
+    // Without capture the redirection is opened here, with capture the
+    // output thread writes the file
+    if (stdout_fd == -1 && cmd->new_stdout != NULL) {
+        stdout_fd = open_relative(cmd, cmd->new_stdout, O_WRONLY | O_CREAT | O_TRUNC);
+        if (stdout_fd == -1) {
+            printf("failed to open %s while redirecting stdout\n", cmd->new_stdout);
+            if (stdin_fd != -1) {
+                close(stdin_fd);
+            }
+            return -1;
+        }
+    }
+
+    if (job->count && socketpair(AF_UNIX, SOCK_DGRAM | SOCK_CLOEXEC, 0, sock) != 0) {
+        sock[0] = sock[1] = -1;
+    }
+
+    pid = vfork();
+    if (pid == 0) { // Child process, must only call async-signal-safe functions
+        sigprocmask(SIG_SETMASK, &l->child_mask, NULL);
+        if (chdir(cmd->dir) != 0) {
+            _exit(127);
+        }
+        if (stdin_fd != -1 && dup2(stdin_fd, 0) == -1) {
+            _exit(127);
+        }
+        if (stdout_fd != -1 && dup2(stdout_fd, 1) == -1) {
+            _exit(127);
+        }
+        if (stderr_fd != -1 && dup2(stderr_fd, 2) == -1) {
+            _exit(127);
+        }
+        if (sock[1] != -1 && open_exec_events(0, event_fds) == 0) {
+            send_events(sock[1], event_fds);
+        }
+        execv(cmd->cmd, (char **)cmd->argv);
+        _exit(127);
+    }
+    // The events are queued on the socket by the time vfork() returns
+    if (sock[0] != -1) {
+        if (pid > 0 && receive_events(sock[0], event_fds) == 0) {
+            job->counters = adopt_job_counters(event_fds);
+        }
+        close(sock[0]);
+        close(sock[1]);
+    }
+    if (stdin_fd != -1) {
+        close(stdin_fd);
+    }
+    if (stdout_fd != job->out_fds[0]) {
+        close(stdout_fd);
+    }
+    if (pid < 0) {
+        printf("vfork failed for %s\n", cmd->cmd);
+        return -1;
+    }
+    return pid;
+}
+
+/*
+ * Opens a redirection of a command, relative to its working directory. The
+ * descriptor is close-on-exec so it doesn't leak into jobs started in
+ * parallel, dup2() clears the flag on the job's own stdin/stdout.
+ */
+static int open_relative(cmd_entry cmd, char *file, int flags) {
+    char path[512];
+
+    if (file[0] == '/') {
+        return open(file, flags | O_CLOEXEC, 0644);
+    }
+    if (snprintf(path, sizeof(path), "%s/%s", cmd->dir, file) >= sizeof(path)) {
+        return -1;
+    }
+    return open(path, flags | O_CLOEXEC, 0644);
+}
+
+/*
+ * Sends the job events of a vfork() child over fd. Async-signal-safe.
+ */
+static void send_events(int fd, int *fds) {
+    char control[CMSG_SPACE(JOB_EVENTS * sizeof(int))];
+    char byte = 0;
+    struct msghdr mh;
+    struct iovec iov;
+    struct cmsghdr *cmsg;
+
+    memset(&mh, 0, sizeof(mh));
+    memset(control, 0, sizeof(control));
+    iov.iov_base = &byte;
+    iov.iov_len = 1;
+    mh.msg_iov = &iov;
+    mh.msg_iovlen = 1;
+    mh.msg_control = control;
+    mh.msg_controllen = sizeof(control);
+    cmsg = CMSG_FIRSTHDR(&mh);
+    cmsg->cmsg_level = SOL_SOCKET;
+    cmsg->cmsg_type = SCM_RIGHTS;
+    cmsg->cmsg_len = CMSG_LEN(JOB_EVENTS * sizeof(int));
+    memcpy(CMSG_DATA(cmsg), fds, JOB_EVENTS * sizeof(int));
+    sendmsg(fd, &mh, MSG_NOSIGNAL);
+}
+
+/*
+ * Receives the job events sent by a child, if any, without waiting.
+ * Returns 0 on success, -1 if none were sent.
+ */
+static int receive_events(int fd, int *fds) {
+    char control[CMSG_SPACE(JOB_EVENTS * sizeof(int))];
+    char byte;
+    struct msghdr mh;
+    struct iovec iov;
+    struct cmsghdr *cmsg;
+
+    memset(&mh, 0, sizeof(mh));
+    iov.iov_base = &byte;
+    iov.iov_len = 1;
+    mh.msg_iov = &iov;
+    mh.msg_iovlen = 1;
+    mh.msg_control = control;
+    mh.msg_controllen = sizeof(control);
+    if (recvmsg(fd, &mh, MSG_DONTWAIT | MSG_CMSG_CLOEXEC) != 1) {
+        return -1;
+    }
+    cmsg = CMSG_FIRSTHDR(&mh);
+    if (cmsg == NULL || cmsg->cmsg_level != SOL_SOCKET || cmsg->cmsg_type != SCM_RIGHTS
+            || cmsg->cmsg_len != CMSG_LEN(JOB_EVENTS * sizeof(int))) {
+        return -1;
+    }
+    memcpy(fds, CMSG_DATA(cmsg), JOB_EVENTS * sizeof(int));
+    return 0;
+}
@@ -0,0 +1,58 @@
+/* launcher.h
+ *
+ * A small pool of launcher threads used to start workload processes.
+ *
+ * Each launcher thread pins itself to the tile chosen for a job and starts the
+ * job with vfork(), so the child inherits the affinity and only has to change
+ * directory and exec. The stdin and stdout redirections are opened by the
+ * launcher before vfork(). Since vfork() only suspends the calling thread, a burst of jobs is
+ * spread over the pool and started in parallel.
+ * */
+
+#ifndef _LAUNCHER_H
+#define _LAUNCHER_H
+
+#include <sched.h>
+#include <unistd.h>
+#include <time.h>
+#include "cmd_list.h"
+#include "perfcount.h"
+
+/* A job handed to the launcher: the command to run, the logical tile to run
+ * it on and the cpu the tile was bound to when the job was placed. out_fds are used as stdout (0) and stderr (1) of the job, -1 means
+ * the job inherits the scheduler's, unless stdout is redirected in the
+ * workload. If count is set the job's cache misses are counted from its exec
+ * on (see perfcount.h). On return pid holds the process ID of the started job,
+ * or -1 if it could not be started, launched the CLOCK_MONOTONIC time the pid
+ * came back and counters the job's counter session, or NULL if it isn't
+ * counted. */
+struct launch_job_struct
+{
+    cmd_entry cmd;
+    int tile_num;
+    int cpu;
+    int out_fds[2];
+    int count;
+    pid_t pid;
+    struct timespec launched;
+    job_counters counters;
+};
+
+/* Each launcher instance is represented by a launcher_struct. */
+struct launcher_struct;
+
+/* Typedef for a user handle to a launcher instance. */
+typedef struct launcher_struct *launcher;
+
+/* Creates a launcher with the specified number of threads.
+ * On success a handle to the launcher is returned, otherwise NULL. */
+launcher create_launcher(int num_threads);
+
+/* Stops all launcher threads and frees allocated memory. */
+void destroy_launcher(launcher l);
+
+/* Starts all num_jobs jobs in the array and waits until every job has been
+ * exec'd (or has failed). Returns the number of jobs successfully started. */
+int launch_processes(launcher l, struct launch_job_struct *jobs, int num_jobs);
+
+#endif
@@ -4,6 +4,7 @@
  */
 #include <stdio.h>
 #include <stdlib.h>
+#include <stdint.h>
 #include <unistd.h>
 #include <sys/wait.h>
 #include <sys/types.h>
@@ -14,6 +15,11 @@
 #include <pthread.h>
 #include <fcntl.h>
 #include <sys/stat.h>
+#include <sys/epoll.h>
+#include <sys/signalfd.h>
+#include <sys/timerfd.h>
+#include <sys/eventfd.h>
+#include <sys/resource.h>
 
 // Tilera
 #include <tmc/cpus.h>
@@ -26,111 +32,456 @@
 #include "migrate.h"
 #include "perfcount.h"
 #include "proc_table.h"
+#include "launcher.h"
+#include "zygote.h"
+#include "output.h"
+#include "job_log.h"
+#include "dag.h"
+#include "ready_queue.h"
+#include "submit.h"
+#include "topology.h"
+#include "page_mover.h"
 
-#define NUM_OF_CPUS 16
 #define TABLE_SIZE 8
+#define LAUNCHER_THREADS 4
+#define LAUNCH_BATCH_SIZE 64
+#define MAX_EVENTS 8
+#define STREAM_WINDOW 1024
+#define PROPOSAL_RING_SIZE 64
+#define SYSFS_ROOT "/sys"
 
-// RTS handlers:
-void start_handler(int, siginfo_t*, void*);
-void end_handler(int, siginfo_t*, void*);
+// Event loop handlers:
+void handle_arrival(void);
+void handle_child_exit(void);
+void handle_monitor(void);
+void handle_submissions(void);
+void update_cpus(void);
+void update_job_metrics(void);
 
 // Functions that probably shouldn't be defined in main
+int hold_dependent_processes(void);
+int hold_streamed_process(cmd_entry cmd);
+void watch_stream(void);
 int start_process(void);
+void release_processes(void);
+int start_ready_processes(void);
+int launch_batch(struct launch_job_struct *batch,
+        struct job_output_struct *batch_outputs, int batch_size);
 int children_is_still_alive(void);
+long long elapsed_usec(void);
+long long usec_since_epoch(struct timespec *time);
+int start_time_before(cmd_entry cmd, cmd_entry other);
 
 // Global values:
-int counter = 0;
+struct timespec workload_epoch;  // CLOCK_MONOTONIC time of workload start
 proc_table table;
-float wr_miss_rates[NUM_OF_CPUS] = {1.0};
-float drd_miss_rates[NUM_OF_CPUS] = {1.0};
+topology topo = NULL;          // Contention domains, NULL if flat (-T none)
+page_mover mover = NULL;       // Only used when moving memory (-m)
+int count_jobs = 0;            // Counter session per job (-A)
+float *wr_miss_rates;
+float *drd_miss_rates;
 cmd_list list;
-cpu_set_t cpus;
+ready_queue ready;      // Arrived processes waiting for a tile with room
+dag deps;               // Dependencies, holds processes until parents finish
+cmd_list released;      // Processes whose last parent has just finished
+launcher launch_pool;
+zygote_pool zygotes = NULL;    // Only used in zygote mode (-z)
+output_mux outputs = NULL;     // Only used when capturing output (-o/-O)
+job_log records = NULL;        // Only used when writing job records (-r)
+submit_server server = NULL;   // Only used in daemon mode (-s)
+spsc_ring proposals;           // Migrations proposed by the polling thread
+int next_seq = 0;              // seq number of the next process added
+int streaming = 0;             // Workload read lazily (-w or "-")
+int stream_fd = -1;            // Input of the workload stream being watched
+cpu_set_t cpus;                // cpus the tiles are bound to
 int last_program_started = 0;
+int live_jobs = 0;
+int arrival_fd;
+int child_fd;
+int monitor_fd;
+int epoll_fd;
 
 /**
  * Main function.
  *
- * usage: ./main <workloadfile> [logfile]
+ * usage: ./main [-z] [-j max_jobs_per_tile] [-c max_class_value]
+ *              [-o output_dir | -O output_log] [-r record_file]
+ *              [-p fifo|rank|prio|edf] [-a aging_period] [-s socket]
+ *              [-w window] [-T sysfs_root] [-m move_rate] [-A]
+ *              <workloadfile> [logfile]
+ *
+ * -j and -c limit the number of processes and the total class value on each
+ * tile. Processes that arrive when no tile has room wait in a ready queue.
+ * -z starts processes through pre-forked zygotes, one per tile.
+ * -o captures stdout/stderr of every process into output_dir/<pid>.out and
+ * output_dir/<pid>.err, -O into one multiplexed log (see output.h).
+ * -r writes a completion record for every process to record_file (see
+ * job_log.h).
+ *
+ * Processes with after= dependencies are held until their parents have
+ * finished (see cmd_list.h and dag.h).
+ *
+ * -p orders the ready queue by arrival, critical path (default), prio= or
+ * deadline= (see ready_queue.h). With prio, -a raises the priority of a
+ * waiting process by one level every aging_period seconds. The other orders
+ * don't age, so -a is rejected without -p prio.
+ *
+ * -s runs the scheduler as a daemon that also accepts processes submitted
+ * to the Unix socket at the given path (see submit.h and dfs_submit.c). The
+ * workload file is then optional. The daemon stops accepting on SIGTERM or
+ * SIGINT and exits once all processes have finished, a second signal kills
+ * it right away. Finished processes are forgotten by the DAG once all
+ * processes before them have finished too, so after= can only name processes
+ * that are still known (see prune_dag()).
+ *
+ * -w reads the workload file lazily, with at most window processes read
+ * ahead, so that memory doesn't grow with the length of the workload. A
+ * workloadfile of "-" reads stdin this way. The file should then be sorted by
+ * start time, and dependencies are added to the DAG as processes arrive.
+ * Finished processes are forgotten as in a daemon, and after= naming a
+ * process that isn't known any more is taken to name a finished one. -w
+ * can't be combined with -s.
+ *
+ * -T reads the cpu topology from another sysfs tree than /sys, or not at all
+ * if sysfs_root is "none". Tiles are then placed and cooled down by their
+ * contention score, which also counts the misses of the tiles they share a
+ * core, cache or node with (see topology.h). Without a readable topology all
+ * tiles are independent.
+ *
+ * -m moves the memory of a migrated process to the node of its new tile, at
+ * most move_rate MiB per second over all processes (see page_mover.h). It
+ * needs the topology.
+ *
+ * -A counts the cache misses of every process from its exec on, and of the
+ * threads and children it creates, wherever it runs (see perfcount.h). The
+ * events are opened by the launcher's child or on the zygote before the job
+ * execs. Tiles are then placed, and hot tiles picked, by the sum of the miss
+ * rates of their processes, and the process with the highest miss rate is
+ * the one moved off a hot tile. Needs the perf counter backend.
+ *
+ * The scheduler uses the cpus of its affinity mask. The mask is checked on
+ * every wakeup of the polling thread: tiles on cpus that have been removed
+ * are taken offline and their processes moved to other tiles, and added cpus
+ * are bound to offline tiles (see proc_table.h).
  */
 int main(int argc, char *argv[]) {
 
-	// RTS actions:
-    struct sigaction start_action;
-    //struct sigaction end_action;
+    sigset_t child_signal;
+    struct epoll_event event, events[MAX_EVENTS];
+    int opt;
+    int max_jobs_per_tile = 0;
+    int max_class_value = 0;
+    int use_zygotes = 0;
+    char *output_dir = NULL;
+    char *output_log = NULL;
+    char *record_file = NULL;
+    int policy = READY_RANK;
+    long long aging_period = 0;
+    char *socket_path = NULL;
+    int min_args = 1;
+    int stream_window = 0;
+    char *sysfs_root = SYSFS_ROOT;
+    long long move_rate = 0;
 
     // Save starting time
     long long int start_time = time(NULL);
     printf("Start time is: %lld\n", start_time);
     // Check command line arguments
-    if (argc < 2 || argc > 3) {
-        printf("usage: %s <inputfile> [logfile]\n", argv[0]);
+    while ((opt = getopt(argc, argv, "zj:c:o:O:r:p:a:s:w:T:m:A")) != -1) {
+        switch (opt) {
+        case 'z':
+            use_zygotes = 1;
+            break;
+        case 'j':
+            max_jobs_per_tile = atoi(optarg);
+            break;
+        case 'c':
+            max_class_value = atoi(optarg);
+            break;
+        case 'o':
+            output_dir = optarg;
+            break;
+        case 'O':
+            output_log = optarg;
+            break;
+        case 'r':
+            record_file = optarg;
+            break;
+        case 'p':
+            if (strcmp(optarg, "fifo") == 0) {
+                policy = READY_FIFO;
+            }
+            else if (strcmp(optarg, "rank") == 0) {
+                policy = READY_RANK;
+            }
+            else if (strcmp(optarg, "prio") == 0) {
+                policy = READY_PRIORITY;
+            }
+            else if (strcmp(optarg, "edf") == 0) {
+                policy = READY_DEADLINE;
+            }
+            else {
+                optind = argc + 1;
+            }
+            break;
+        case 'a':
+            aging_period = atof(optarg) * 1000000;
+            break;
+        case 's':
+            socket_path = optarg;
+            min_args = 0;
+            break;
+        case 'w':
+            stream_window = atoi(optarg);
+            break;
+        case 'T':
+            sysfs_root = optarg;
+            break;
+        case 'A':
+            count_jobs = 1;
+            break;
+        case 'm':
+            if ((move_rate = atof(optarg) * 1024 * 1024) <= 0) {
+                optind = argc + 1;
+            }
+            break;
+        default:
+            optind = argc + 1; // Force usage message
+        }
+    }
+    streaming = optind < argc && (stream_window > 0 || strcmp(argv[optind], "-") == 0);
+    if (argc - optind < min_args || argc - optind > 2 || (output_dir && output_log)
+            || (streaming && socket_path)
+            || (aging_period > 0 && policy != READY_PRIORITY)) {
+        printf("usage: %s [-z] [-j max_jobs_per_tile] [-c max_class_value] "
+               "[-o output_dir | -O output_log] [-r record_file] "
+               "[-p fifo|rank|prio|edf] [-a aging_period] [-s socket] "
+               "[-w window] [-T sysfs_root] [-m move_rate] [-A] <inputfile> [logfile]\n",
+               argv[0]);
         return 1; // Error!
     }
-    else if (argc == 2) {
+    else if (argc - optind <= 1) {
         printf("DFS scheduler initalized, writing output to stdout\n");
     }
-    else if (argc == 3) {
-        char *logfile = argv[2];
+    else {
+        char *logfile = argv[optind+1];
         printf("DFS scheduler initalized, writing output to %s\n", logfile);
         freopen(logfile, "a+", stdout);
     }
+    char *inputfile = optind < argc ? argv[optind] : NULL;
 
     // Initialize cpu set
     if (tmc_cpus_get_my_affinity(&cpus) != 0) {
         tmc_task_die("Failure in 'tmc_cpus_get_my_affinity()'.");
     }
     printf("cpus_count is: %i\n", tmc_cpus_count(&cpus));
-    if (tmc_cpus_count(&cpus) != NUM_OF_CPUS) {
-        tmc_task_die("Got wrong number of cpus: %i requested, got %i", NUM_OF_CPUS, tmc_cpus_count(&cpus));
+    if (tmc_cpus_count(&cpus) == 0) {
+        tmc_task_die("Got no cpus");
+    }
+    // There is a tile for every cpu that could join the set later
+    int num_tiles = sysconf(_SC_NPROCESSORS_CONF);
+    if (num_tiles < tmc_cpus_count(&cpus)) {
+        num_tiles = tmc_cpus_count(&cpus);
+    }
+
+    // Initialize proc_table, with the first tiles bound to the cpus of the set
+    if ((table = create_proc_table(num_tiles)) == NULL) {
+        printf("Failed to create proc table\n");
+        return 1;
+    }
+    for (int i=0;i<num_tiles;i++) {
+        set_tile_cpu(table, i, i < tmc_cpus_count(&cpus) ? tmc_cpus_find_nth_cpu(&cpus, i) : -1);
+    }
+    set_tile_limits(table, max_jobs_per_tile, max_class_value);
+    if (strcmp(sysfs_root, "none") != 0) {
+        if ((topo = create_topology(sysfs_root)) == NULL) {
+            printf("No cpu topology in %s, tiles are independent\n", sysfs_root);
+        }
+        else {
+            printf("Read topology of %i cpus from %s\n", get_topology_cpus(topo), sysfs_root);
+            set_topology(table, topo);
+        }
+    }
+    if (move_rate > 0 && topo == NULL) {
+        printf("Memory can't be moved without a cpu topology\n");
+    }
+    else if (move_rate > 0 && (mover = create_page_mover(move_rate)) == NULL) {
+        printf("Failed to create page mover\n");
+        return 1;
+    }
+    set_page_mover(mover);
+    if (count_jobs) {
+        // Try a session on the scheduler itself
+        job_counters probe = open_job_counters(getpid());
+        if (probe == NULL) {
+            printf("Processes can't be counted, tiles are scored by their counters\n");
+            count_jobs = 0;
+        }
+        else {
+            close_job_counters(probe);
+            use_job_metrics(table, 1);
+        }
+    }
+    wr_miss_rates = malloc(sizeof(float) * num_tiles);
+    drd_miss_rates = malloc(sizeof(float) * num_tiles);
+    if (wr_miss_rates == NULL || drd_miss_rates == NULL) {
+        printf("Failed to allocate miss rates\n");
+        return 1;
+    }
+    for (int i=0;i<num_tiles;i++) {
+        wr_miss_rates[i] = drd_miss_rates[i] = 1.0;
+    }
+    // Fork the zygotes while the scheduler is still small and single threaded
+    if (use_zygotes && (zygotes = create_zygote_pool(&cpus, num_tiles)) == NULL) {
+        printf("Failed to create zygote pool\n");
+        return 1;
+    }
+    // Parse the file and set next to first entry in file. A daemon may
+    // start without a file.
+    if (inputfile == NULL) {
+        list = create_empty_cmd_list();
+    }
+    else if (streaming) {
+        if ((list = open_cmd_stream(inputfile,
+                stream_window > 0 ? stream_window : STREAM_WINDOW)) == NULL) {
+            printf("Failed to open workload stream: %s\n", inputfile);
+            return 1;
+        }
+    }
+    else if ((list = create_cmd_list(inputfile)) == NULL) {
+        printf("Failed to create command list from file: %s\n", inputfile);
+        return 1;
+    }
+    if ((ready = create_ready_queue(policy, aging_period)) == NULL
+            || (released = create_empty_cmd_list()) == NULL) {
+        printf("Failed to create ready queue\n");
+        return 1;
+    }
+    if (hold_dependent_processes() != 0) {
+        printf("Invalid dependencies in file: %s\n", inputfile);
+        return 1;
+    }
+
+    // SIGCHLD is read from a signalfd, block it before any thread is
+    // created so it is blocked in all of them. A daemon also reads the
+    // signals that stop it from there.
+    sigemptyset(&child_signal);
+    sigaddset(&child_signal, SIGCHLD);
+    if (socket_path != NULL) {
+        sigaddset(&child_signal, SIGTERM);
+        sigaddset(&child_signal, SIGINT);
+    }
+    if (sigprocmask(SIG_BLOCK, &child_signal, NULL) != 0) {
+        tmc_task_die("Failed to block SIGCHLD");
+    }
+
+    // Set up the event sources: process arrivals, child exits and monitor
+    // wakeups.
+    if ((arrival_fd = timerfd_create(CLOCK_MONOTONIC, TFD_CLOEXEC)) == -1
+            || (child_fd = signalfd(-1, &child_signal, SFD_CLOEXEC)) == -1
+            || (monitor_fd = eventfd(0, EFD_CLOEXEC)) == -1
+            || (epoll_fd = epoll_create(MAX_EVENTS)) == -1) {
+        tmc_task_die("Failed to set up event loop");
+    }
+    int fds[] = {arrival_fd, child_fd, monitor_fd};
+    for (int i=0;i<3;i++) {
+        event.events = EPOLLIN;
+        event.data.fd = fds[i];
+        if (epoll_ctl(epoll_fd, EPOLL_CTL_ADD, fds[i], &event) != 0) {
+            tmc_task_die("Failed to add fd to epoll set");
+        }
+    }
+    if (mover != NULL) {
+        event.events = EPOLLIN;
+        event.data.fd = get_page_mover_fd(mover);
+        if (epoll_ctl(epoll_fd, EPOLL_CTL_ADD, event.data.fd, &event) != 0) {
+            tmc_task_die("Failed to add fd to epoll set");
+        }
+    }
+    if (socket_path != NULL) {
+        if ((server = create_submit_server(socket_path)) == NULL) {
+            printf("Failed to listen on socket: %s\n", socket_path);
+            return 1;
+        }
+        event.events = EPOLLIN;
+        event.data.fd = get_submit_fd(server);
+        if (epoll_ctl(epoll_fd, EPOLL_CTL_ADD, event.data.fd, &event) != 0) {
+            tmc_task_die("Failed to add fd to epoll set");
+        }
     }
 
-    // Initialize proc_table
-    table = create_proc_table(NUM_OF_CPUS);
-    // Parse the file and set next to first entry in file.
-    if ((list = create_cmd_list(argv[1])) == NULL) {
-        printf("Failed to create command list from file: %s\n", argv[1]);
+    if (record_file && (records = create_job_log(record_file)) == NULL) {
+        printf("Failed to create record file: %s\n", record_file);
+        return 1;
+    }
+
+    // Start the output thread before any process can write
+    if ((output_dir || output_log)
+            && (outputs = create_output_mux(output_dir, output_log)) == NULL) {
+        printf("Failed to set up output capture\n");
+        return 1;
+    }
+
+    // Start the launcher threads
+    if ((launch_pool = create_launcher(LAUNCHER_THREADS)) == NULL) {
+        printf("Failed to create launcher threads\n");
         return 1;
     }
 
     // Define a struct containing data to be sent to thread
     struct poll_thread_struct *data = malloc(sizeof(struct poll_thread_struct));
     data->proctable = table;
-    data->cpus = &cpus;
     data->wr_miss_rates = wr_miss_rates;
     data->drd_miss_rates = drd_miss_rates;
+    data->wakeup_fd = monitor_fd;
+    if ((data->proposals = proposals = create_spsc_ring(PROPOSAL_RING_SIZE,
+            sizeof(struct migration_proposal_struct))) == NULL) {
+        printf("Failed to create migration proposal ring\n");
+        return 1;
+    }
 
     // Start the threads that polls the PMC registers
     pthread_t poll_pmcs_thread;
     pthread_create(&poll_pmcs_thread, NULL, poll_pmcs, (void*)data);
 
-    // Init RTS for process start:
-    start_action.sa_handler = NULL;
-    start_action.sa_flags = SA_SIGINFO;
-    start_action.sa_sigaction = start_handler;
-    // Install handler (blocking SIGALRM/SIGSCHLD during handler execution):
-    if (sigemptyset(&start_action.sa_mask) != 0
-    		|| sigaddset(&start_action.sa_mask, SIGALRM) != 0
-    		|| sigaddset(&start_action.sa_mask, SIGCHLD) != 0
-    		|| sigaction(SIGALRM, &start_action, NULL) != 0) {
-    	printf("Failed to setup handler for SIGALRM\n");
-    }
-
-    // Start the first process(es) in file and setup timers and stuff.
+    // Start times are offsets from here. Start the first process(es) in file
+    // and setup timers and stuff.
+    clock_gettime(CLOCK_MONOTONIC, &workload_epoch);
     start_process();
 
-    // While the last process hasn't started and children is still alive,
-    // reap the dying children.
-    int child_pid;
-    int child_tile_num;
-    while(children_is_still_alive() || last_program_started == 0) {
+    // Run until the last process has started and all children are reaped.
+    while(children_is_still_alive() || last_program_started == 0
+            || get_ready_count(ready) > 0 || get_held_count(deps) > 0
+            || get_first(released) != NULL || server != NULL) {
+
+        // Processes released by a failed launch
+        if (get_first(released) != NULL) {
+            release_processes();
+            continue;
+        }
 
         //print_processes(table);
 
-        // Reap child
-        child_pid = wait(NULL);
-        if (child_pid > 0) {
-            child_tile_num = get_tile_num(table, child_pid);
-            remove_pid(table, child_pid);
+        int num_events = epoll_wait(epoll_fd, events, MAX_EVENTS, -1);
+        for (int i=0;i<num_events;i++) {
+            if (events[i].data.fd == child_fd) {
+                handle_child_exit();
+            }
+            else if (events[i].data.fd == arrival_fd) {
+                handle_arrival();
+            }
+            else if (events[i].data.fd == monitor_fd) {
+                handle_monitor();
+            }
+            else if (server != NULL && events[i].data.fd == get_submit_fd(server)) {
+                handle_submissions();
+            }
+            else if (events[i].data.fd == stream_fd) {
+                start_process();
+            }
+            else if (mover != NULL && events[i].data.fd == get_page_mover_fd(mover)) {
+                run_page_mover(mover);
+            }
         }
     }
 
@@ -142,108 +493,582 @@ int main(int argc, char *argv[]) {
     total_time = end_time - start_time;
     printf("Workload finished!\n");
     printf("Time elapsed: %lld\n", total_time);
+    if (get_skipped_lines(list) > 0) {
+        printf("Skipped %i malformed lines in %s\n", get_skipped_lines(list), inputfile);
+    }
+
+    // Stop the polling thread before its proposal ring goes away
+    pthread_cancel(poll_pmcs_thread);
+    pthread_join(poll_pmcs_thread, NULL);
+    destroy_spsc_ring(proposals);
+    free(data);
 
+    destroy_launcher(launch_pool);
+    destroy_zygote_pool(zygotes);
+    destroy_page_mover(mover);
+    destroy_output_mux(outputs);
+    destroy_job_log(records);
+    destroy_dag(deps);
+    destroy_cmd_list(list);
     return 0;
 }
 
 /*
- * Handles the SIGALRM sent by the timer.
+ * Handles expiry of the arrival timer.
  * Calls start_process()
  */
-void start_handler(int signo, siginfo_t *info, void *context) {
+void handle_arrival() {
+    uint64_t expirations;
+
+    if (read(arrival_fd, &expirations, sizeof(expirations)) > 0) {
+        start_process();
+    }
+}
+
+/*
+ * Handles SIGCHLD. Signals are coalesced, so every exited child is reaped
+ * without blocking until there are none left. Reaping frees room on tiles,
+ * so waiting processes are started afterwards, after the processes whose
+ * last parent has finished. If enabled, a completion record is written for
+ * every reaped process. In daemon mode SIGTERM and SIGINT also arrive here,
+ * and stop the submission server. They are unblocked then, so that another
+ * one ends the scheduler. Finished processes are pruned from the DAG while
+ * the daemon accepts submissions.
+ */
+void handle_child_exit() {
+    struct signalfd_siginfo info;
+    struct rusage usage;
+    sigset_t stop_signals;
+    proc_record rec;
+    int child_pid, status, seq;
+
+    // Only one SIGCHLD can be pending, consume it
+    read(child_fd, &info, sizeof(info));
+    if (info.ssi_signo != SIGCHLD) {
+        printf("Got signal %i, no longer accepting submissions\n", info.ssi_signo);
+        destroy_submit_server(server);
+        server = NULL;
+        // Only the main thread has them unblocked, their default action ends
+        // the process
+        sigemptyset(&stop_signals);
+        sigaddset(&stop_signals, SIGCHLD);
+        signalfd(child_fd, &stop_signals, 0);
+        sigemptyset(&stop_signals);
+        sigaddset(&stop_signals, SIGTERM);
+        sigaddset(&stop_signals, SIGINT);
+        sigprocmask(SIG_UNBLOCK, &stop_signals, NULL);
+        return;
+    }
+    while ((child_pid = wait4(-1, &status, WNOHANG, &usage)) > 0) {
+        if ((rec = get_proc_record(table, child_pid)) == NULL) {
+            continue;
+        }
+        if (records != NULL) {
+            write_job_record(records, child_pid, rec->class, &rec->info,
+                    elapsed_usec(), status, &usage);
+        }
+        seq = rec->info.seq;
+        // The pid may be reused from now on
+        if (mover != NULL) {
+            cancel_page_move(mover, child_pid);
+        }
+        close_job_counters(rec->counters);
+        if (remove_pid(table, child_pid) == 0) {
+            live_jobs--;
+        }
+        finish_dag_command(deps, seq, released);
+    }
+    if (server != NULL || streaming) {
+        prune_dag(deps);
+    }
+    if (get_first(released) != NULL) {
+        release_processes();
+    }
+    else {
+        start_ready_processes();
+    }
+}
+
+/*
+ * Handles a wakeup from the thread polling the PMCs. The miss rates it has
+ * sampled are applied to the proc table here, and the migrations it has
+ * proposed are done here and not in the polling thread, so they never race
+ * with process starts or with reaping (a reaped pid can't be migrated after
+ * reuse).
+ */
+void handle_monitor() {
+    uint64_t sweeps;
+
+    if (read(monitor_fd, &sweeps, sizeof(sweeps)) > 0) {
+        update_cpus();
+        update_job_metrics();
+        update_miss_counts(table);
+        apply_migrations(table, proposals);
+    }
+}
+
+/*
+ * Reads the counter sessions of all processes and sets their job metrics to
+ * their miss rates since the last wakeup, in misses per millisecond.
+ */
+void update_job_metrics() {
+    long long misses, accesses, nsecs;
+    proc_record rec;
+    int pid_count;
+
+    if (!count_jobs) {
+        return;
+    }
+    for (int i=0;i<table->num_tiles;i++) {
+        pid_count = get_pid_count(table, i);
+        pid_t pids[pid_count > 0 ? pid_count : 1];
+        pid_count = get_pid_vector(table, i, pids, pid_count);
+        for (int j=0;j<pid_count;j++) {
+            if ((rec = get_proc_record(table, pids[j])) != NULL && rec->counters != NULL
+                    && read_job_counters(rec->counters, &misses, &accesses, &nsecs) == 0
+                    && nsecs > 0) {
+                set_job_metric(table, pids[j], misses * 1000000.0 / nsecs);
+            }
+        }
+    }
+}
+
+/*
+ * Follows changes of the cpu set the scheduler runs in, e.g. when its cpuset
+ * is resized. Tiles whose cpu has been removed are taken offline and their
+ * processes are moved to online tiles. Added cpus are bound to offline tiles.
+ */
+void update_cpus() {
+    cpu_set_t current;
+    int cpu, tile;
+
+    if (tmc_cpus_get_my_affinity(&current) != 0 || tmc_cpus_count(&current) == 0
+            || memcmp(&current, &cpus, sizeof(cpu_set_t)) == 0) {
+        return;
+    }
+    // Take the tiles of removed cpus offline first, so no process is moved
+    // to them
+    for (int i=0;i<table->num_tiles;i++) {
+        if ((cpu = get_tile_cpu(table, i)) >= 0 && !tmc_cpus_has_cpu(&current, cpu)) {
+            printf("Cpu %i removed, logical tile %i offline\n", cpu, i);
+            set_tile_cpu(table, i, -1);
+            if (zygotes != NULL) {
+                set_zygote_cpu(zygotes, i, -1);
+            }
+        }
+    }
+    // Bind added cpus to offline tiles
+    tile = 0;
+    for (cpu = tmc_cpus_find_first_cpu(&current); cpu >= 0;
+            cpu = tmc_cpus_find_next_cpu(&current, cpu)) {
+        if (tmc_cpus_has_cpu(&cpus, cpu)) {
+            continue;
+        }
+        while (tile < table->num_tiles && get_tile_cpu(table, tile) >= 0) {
+            tile++;
+        }
+        if (tile == table->num_tiles) {
+            break;
+        }
+        printf("Cpu %i added as logical tile %i\n", cpu, tile);
+        set_tile_cpu(table, tile, cpu);
+        if (zygotes != NULL) {
+            set_zygote_cpu(zygotes, tile, cpu);
+        }
+    }
+    // Move the processes off the offline tiles
+    for (int i=0;i<table->num_tiles;i++) {
+        if (get_tile_cpu(table, i) < 0 && get_pid_count(table, i) > 0) {
+            evacuate_tile(table, i);
+        }
+    }
+    cpus = current;
+}
+
+/*
+ * Handles I/O on the submission socket. Every complete batch is parsed and
+ * added like the lines of the workload file, with start times relative to
+ * now. A batch is added up to its first invalid line, the client is told how
+ * many lines were accepted.
+ */
+void handle_submissions() {
+    cmd_list submitted;
+    cmd_entry cmd;
+    char reply[64];
+    char *text, *line, *next;
+    int conn, line_num, accepted, held;
+    long long now;
+
+    if (poll_submissions(server) == 0 || (submitted = create_empty_cmd_list()) == NULL) {
+        return;
+    }
+    while ((text = next_submission(server, &conn)) != NULL) {
+        now = elapsed_usec();
+        line_num = 0;
+        accepted = 0;
+        snprintf(reply, sizeof(reply), "accepted %i\n", 0);
+        for (line = text; line != NULL && *line != '\0'; line = next) {
+            if ((next = strchr(line, '\n')) != NULL) {
+                *next++ = '\0';
+            }
+            line_num++;
+            // Skip empty lines and comments
+            if (line[0] == '#' || line[0] == '\0') {
+                continue;
+            }
+            if ((cmd = parse_cmd_line(line)) == NULL) {
+                snprintf(reply, sizeof(reply), "rejected line %i, accepted %i\n",
+                        line_num, accepted);
+                break;
+            }
+            cmd->seq = next_seq;
+            cmd->start_time += now;
+            if ((held = add_dag_command(deps, cmd)) < 0) {
+                free_cmd_entry(cmd);
+                snprintf(reply, sizeof(reply), "rejected line %i, accepted %i\n",
+                        line_num, accepted);
+                break;
+            }
+            next_seq++;
+            if (held == 0) {
+                add_last(submitted, cmd);
+            }
+            snprintf(reply, sizeof(reply), "accepted %i\n", ++accepted);
+        }
+        reply_submission(server, conn, reply);
+    }
+    rank_dag_commands(deps);
+    while ((cmd = take_first(submitted)) != NULL) {
+        insert_sorted(list, cmd, start_time_before);
+    }
+    destroy_cmd_list(submitted);
     start_process();
 }
 
 /*
- * Starts all processes with start_time less than or equal to the current
- * time/counter. Derps with the pid table, allocates a specific tile
- * to the process(es) and forks child process(es). Also keeps track of the
- * next set of program to start.
+ * Moves all processes with dependencies from the command list to the DAG,
+ * ranks all processes by their critical path and sorts the rest by start
+ * time.
+ * Returns 0 on success, -1 on invalid dependencies.
+ */
+int hold_dependent_processes() {
+    cmd_list timed;
+    cmd_entry cmd;
+    int held;
+
+    if ((deps = create_dag()) == NULL) {
+        return -1;
+    }
+    // A stream is added as it arrives, see hold_streamed_process(). Its
+    // finished processes are pruned, so a parent that isn't known any more
+    // has finished.
+    if (streaming) {
+        set_unknown_parents_finished(deps, 1);
+        return 0;
+    }
+    if ((timed = create_empty_cmd_list()) == NULL) {
+        return -1;
+    }
+    while ((cmd = take_first(list)) != NULL) {
+        if ((held = add_dag_command(deps, cmd)) < 0) {
+            return -1;
+        }
+        if (held == 0) {
+            add_last(timed, cmd);
+        }
+        next_seq = cmd->seq + 1;
+    }
+    destroy_cmd_list(list);
+    list = timed;
+    rank_dag_commands(deps);
+    // The file is in dependency order, arrivals need start time order
+    sort_cmd_list(list, start_time_before);
+    return 0;
+}
+
+/*
+ * Moves all processes with start_time less than or equal to the time
+ * elapsed since the workload started to the ready queue and starts as many
+ * of them as there is room for. Also keeps track of the next set of program
+ * to start.
  */
 int start_process() {
 
-    struct itimerval timer;
-    struct timeval timeout;
+    struct itimerspec timer;
+    long long now = elapsed_usec();
+    long long deadline;
     cmd_entry cmd;
 
-    while ((cmd = get_first(list)) != NULL && cmd->start_time <= counter) {
-        // Try to get an empty tile (or the tile with least contention)
-        int tile_num = get_tile(&cpus, table);
-
-        // The shepherd avoids creating a debugger until exec has run
-        // No idea if this a good thing and/or an improvement in performance
-        //tmc_task_assume_impending_exec(1);
-
-        int pid = fork();
-        if (pid < 0) {
-            return 1; // Fork failed
-        }
-        else if (pid == 0) { // Child process
-            if (tmc_cpus_set_my_cpu(tmc_cpus_find_nth_cpu(&cpus, tile_num)) < 0) {
-                tmc_task_die("failure in 'tmc_set_my_cpu'");
-            }
-            //int mypid = getpid();
-            //int mycurcpu = tmc_cpus_get_my_current_cpu();
-            //printf("Pid #%i: Physical #%i, Logical #%i. Processes on tile: %i, tile-miss-counter: %f\n",
-//                   mypid, mycurcpu, tile_num, get_pid_count(table, tile_num)+1, table->miss_counters[tile_num]);
-
-            // Change working directory
-            chdir(cmd->dir);
-
-            // Redirect stdin
-            if (cmd->new_stdin != NULL) {
-                char path[512];
-                strcpy(path, cmd->dir);
-                strcpy(path, cmd->new_stdin);
-                int fd = open(path, O_RDONLY);
-                if (fd == -1) {
-                    printf("failed to open file while redirecting stdin\n");
-                    return 1;
-                }
-                dup2(fd, 0);
-            }
-
-            int status = execv(cmd->cmd, (char **)cmd->argv);
-            printf("execvp failed with status %d\n", status);
-            return 1;
-        }
-        else {
-            // Add pid to proc table
-            add_pid(table, pid, tile_num, cmd->class);
+    while ((cmd = get_first(list)) != NULL && cmd->start_time <= now) {
+        cmd = take_first(list);
+        if (!streaming || hold_streamed_process(cmd) == 0) {
+            push_ready(ready, cmd);
         }
-        remove_first(list);
     }
+    start_ready_processes();
+    watch_stream();
 
     if (cmd != NULL) {
-        timeout.tv_sec = (cmd->start_time)-counter;
-        timeout.tv_usec = 0;
-        timer.it_interval = timeout;
-        timer.it_value = timeout;
-        counter = cmd->start_time;
-        setitimer(ITIMER_REAL, &timer, NULL);
+        // Arm the timer on the absolute deadline of the next start, so
+        // launch time and timer latency never accumulate into drift.
+        deadline = workload_epoch.tv_sec * 1000000LL
+                + workload_epoch.tv_nsec / 1000 + cmd->start_time;
+        timer.it_value.tv_sec = deadline / 1000000;
+        timer.it_value.tv_nsec = (deadline % 1000000) * 1000;
+        timer.it_interval.tv_sec = 0;
+        timer.it_interval.tv_nsec = 0;
+        timerfd_settime(arrival_fd, TFD_TIMER_ABSTIME, &timer, NULL);
+        // Released processes may refill an empty list
+        last_program_started = 0;
     }
     else {
-        last_program_started = 1;
+        // A stream may still be waiting for input
+        last_program_started = stream_fd == -1;
     }
     return 0;
 }
 
+/*
+ * Adds a process taken from a workload stream to the DAG if it has
+ * dependencies. Unlike the processes of a file, it is only ranked by the
+ * children that arrived before it. Processes released by the DAG are
+ * already in it and are left alone.
+ * Returns 1 if the process is now held, or was invalid and freed, otherwise 0.
+ */
+int hold_streamed_process(cmd_entry cmd) {
+    int held;
+
+    if (cmd->seq < next_seq) {
+        return 0;
+    }
+    next_seq = cmd->seq + 1;
+    if (cmd->id == NULL && cmd->after == NULL) {
+        return 0;
+    }
+    if ((held = add_dag_command(deps, cmd)) < 0) {
+        printf("Invalid dependencies, skipping process %i\n", cmd->seq);
+        free_cmd_entry(cmd);
+        return 1;
+    }
+    rank_dag_commands(deps);
+    return held;
+}
+
+/*
+ * Adds the input of the workload stream to the epoll set while the stream is
+ * waiting for it, and removes it otherwise, so that a full window doesn't
+ * keep waking the event loop.
+ */
+void watch_stream() {
+    struct epoll_event event;
+    int fd = get_cmd_stream_fd(list);
+
+    if (fd == stream_fd) {
+        return;
+    }
+    if (stream_fd != -1) {
+        epoll_ctl(epoll_fd, EPOLL_CTL_DEL, stream_fd, NULL);
+    }
+    if (fd != -1) {
+        event.events = EPOLLIN;
+        event.data.fd = fd;
+        if (epoll_ctl(epoll_fd, EPOLL_CTL_ADD, fd, &event) != 0) {
+            tmc_task_die("Failed to add fd to epoll set");
+        }
+    }
+    stream_fd = fd;
+}
+
+/*
+ * Hands released processes back to the command list. Processes whose start
+ * time has passed arrive now, the others at their start time.
+ */
+void release_processes() {
+    long long now = elapsed_usec();
+    cmd_entry cmd;
+
+    while ((cmd = take_first(released)) != NULL) {
+        if (cmd->start_time < now) {
+            cmd->start_time = now;
+        }
+        insert_sorted(list, cmd, start_time_before);
+    }
+    start_process();
+}
+
+/*
+ * Starts processes from the ready queue, in order, until it is empty or no
+ * tile has room for the first one. Allocates a specific tile to each process
+ * and hands them to the launcher threads in batches.
+ * Returns the number of started processes.
+ */
+int start_ready_processes() {
+    struct launch_job_struct batch[LAUNCH_BATCH_SIZE];
+    struct job_output_struct batch_outputs[LAUNCH_BATCH_SIZE];
+    int batch_size = 0;
+    int started = 0;
+    int tile_num;
+    cmd_entry cmd;
+
+    while ((cmd = peek_ready(ready)) != NULL) {
+        // Try to get an empty tile (or the tile with least contention).
+        // The tile stays reserved until the process is in the proc table,
+        // so the rest of the batch sees it as occupied.
+        if ((tile_num = get_tile(table, cmd->class)) < 0) {
+            break;
+        }
+        reserve_tile(table, tile_num, cmd->class);
+
+        batch[batch_size].cmd = pop_ready(ready);
+        batch[batch_size].tile_num = tile_num;
+        batch[batch_size].cpu = get_tile_cpu(table, tile_num);
+        batch[batch_size].pid = -1;
+        batch[batch_size].count = count_jobs;
+        batch[batch_size].counters = NULL;
+        batch[batch_size].out_fds[0] = -1;
+        batch[batch_size].out_fds[1] = -1;
+        if (outputs != NULL) {
+            if (open_job_output(&batch_outputs[batch_size]) == 0) {
+                batch[batch_size].out_fds[0] = batch_outputs[batch_size].child_fds[0];
+                batch[batch_size].out_fds[1] = batch_outputs[batch_size].child_fds[1];
+            }
+            else {
+                printf("failed to create output pipes for %s\n", cmd->cmd);
+            }
+        }
+        if (++batch_size == LAUNCH_BATCH_SIZE) {
+            started += launch_batch(batch, batch_outputs, batch_size);
+            batch_size = 0;
+        }
+    }
+    started += launch_batch(batch, batch_outputs, batch_size);
+    return started;
+}
+
+/*
+ * Starts a batch of placed processes in parallel and adds the ones that
+ * started to the proc table. In zygote mode processes are handed to the
+ * zygotes first, the launcher threads start those that have no zygote.
+ * Captured output of started processes is handed to the output thread.
+ * Returns the number of started processes.
+ */
+int launch_batch(struct launch_job_struct *batch,
+        struct job_output_struct *batch_outputs, int batch_size) {
+    struct launch_job_struct *rest[LAUNCH_BATCH_SIZE];
+    struct launch_job_struct rest_batch[LAUNCH_BATCH_SIZE];
+    struct job_info_struct job;
+    proc_record rec;
+    int rest_size = 0;
+    int started = 0;
+
+    if (batch_size == 0) {
+        return 0;
+    }
+    if (zygotes != NULL) {
+        for (int i=0;i<batch_size;i++) {
+            batch[i].pid = zygote_launch(zygotes, batch[i].tile_num,
+                    batch[i].cmd, batch[i].out_fds,
+                    batch[i].count ? &batch[i].counters : NULL);
+            clock_gettime(CLOCK_MONOTONIC, &batch[i].launched);
+            if (batch[i].pid > 0) {
+                started++;
+            }
+            else {
+                rest[rest_size] = &batch[i];
+                rest_batch[rest_size++] = batch[i];
+            }
+        }
+        started += launch_processes(launch_pool, rest_batch, rest_size);
+        for (int i=0;i<rest_size;i++) {
+            rest[i]->pid = rest_batch[i].pid;
+            rest[i]->launched = rest_batch[i].launched;
+            rest[i]->counters = rest_batch[i].counters;
+        }
+    }
+    else {
+        started = launch_processes(launch_pool, batch, batch_size);
+    }
+
+    for (int i=0;i<batch_size;i++) {
+        release_tile(table, batch[i].tile_num, batch[i].cmd->class);
+        if (batch[i].pid > 0) {
+            // Add pid to proc table
+            add_pid(table, batch[i].pid, batch[i].tile_num, batch[i].cmd->class);
+            // Counted from exec on, unless the events couldn't be opened
+            // before it: then threads and children started before now
+            // aren't counted
+            if (count_jobs && batch[i].counters == NULL) {
+                batch[i].counters = open_job_counters(batch[i].pid);
+            }
+            if ((rec = get_proc_record(table, batch[i].pid)) != NULL) {
+                rec->counters = batch[i].counters;
+            }
+            else {
+                close_job_counters(batch[i].counters);
+            }
+            job.seq = batch[i].cmd->seq;
+            job.arrival = batch[i].cmd->start_time;
+            job.launch = usec_since_epoch(&batch[i].launched);
+            set_job_info(table, batch[i].pid, &job);
+            live_jobs++;
+        }
+        else {
+            // Never reaped, so release its children now
+            finish_dag_command(deps, batch[i].cmd->seq, released);
+        }
+        if (batch[i].out_fds[0] != -1) {
+            if (batch[i].pid > 0) {
+                attach_job_output(outputs, &batch_outputs[i], batch[i].pid, batch[i].cmd);
+            }
+            else {
+                discard_job_output(&batch_outputs[i]);
+            }
+        }
+        free_cmd_entry(batch[i].cmd);
+    }
+    // Replace used zygotes now that the batch is running
+    if (zygotes != NULL) {
+        refill_zygote_pool(zygotes);
+    }
+    return started;
+}
+
+/*
+ * Returns the number of microseconds since the workload started.
+ */
+long long elapsed_usec() {
+    struct timespec now;
+
+    clock_gettime(CLOCK_MONOTONIC, &now);
+    return usec_since_epoch(&now);
+}
+
+/*
+ * Returns the number of microseconds from the start of the workload to a
+ * CLOCK_MONOTONIC time.
+ */
+long long usec_since_epoch(struct timespec *time) {
+    return (time->tv_sec - workload_epoch.tv_sec) * 1000000LL
+            + (time->tv_nsec - workload_epoch.tv_nsec) / 1000;
+}
+
+/*
+ * Orders the command list by start time.
+ */
+int start_time_before(cmd_entry cmd, cmd_entry other) {
+    return cmd->start_time < other->start_time;
+}
+
 /*
  * Checks if there are running child processes.
  * Returns 1 if any children is still alive.
- * Isn't it a syscall for this?
  */
 int children_is_still_alive() {
-    for (int i=0;i<NUM_OF_CPUS;i++) {
-        if (get_pid_count(table, i) != 0) {
-            return 1;
-        }
-    }
-    return 0;
+    return live_jobs > 0;
 }
 
 void print_processes(proc_table table) {
-    for (int i=0;i<NUM_OF_CPUS;i++) {
+    for (int i=0;i<table->num_tiles;i++) {
         printf("Logical tile %i: %i processes, Miss-value: %f\n",
                i, get_pid_count(table, i), table->miss_counters[i]);
 
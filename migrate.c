@@ -5,7 +5,10 @@
 #include <stdio.h>
 #include <stdint.h>
 #include <stdlib.h>
+#include <string.h>
 #include <unistd.h>
+#include <time.h>
+#include <pthread.h>
 #include <arch/cycle.h>
 
 #include <tmc/cpus.h>
@@ -17,27 +20,57 @@
 #include "migrate.h"
 
 #define POLLING_INTERVAL 10
+// Time the samplers have after a tick to publish their samples
+#define SAMPLE_GRACE_MS 50
+#define SAMPLER_STACK_SIZE (64 * 1024)
 
-cpu_set_t *cpus_ptr;
-int num_of_cpus;
 float *write_miss_rates;
 float *read_miss_rates;
+page_mover pages = NULL;    // Moves memory along with processes (-m)
+
+// Samplers and buffers of poll_pmcs(), released when it is cancelled
+struct poll_state_struct {
+    float *miss_counters;
+    sample_slots slots;
+    struct sampler_thread_struct *samplers;
+    pthread_t *threads;
+    int num_threads;        // Samplers started so far
+};
+
+static void wait_for_tick(struct timespec *epoch, uint64_t tick, long delay_ms);
+static void release_poll_state(void *arg);
 
 /*
- * "Thread-function" that polls the performance registers every
- * POLLING_INTERVAL seconds.
+ * "Thread-function" that samples the performance registers every
+ * POLLING_INTERVAL seconds. After every sweep the tiles that should be cooled
+ * down are posted to the proposals ring, and the main thread is woken up
+ * through wakeup_fd to apply the sampled miss rates and the proposals.
+ *
+ * The counters are read by one sampler thread per tile (see sample_tile()),
+ * all at the same tick, and published into sample slots. This thread wakes
+ * up SAMPLE_GRACE_MS after each tick and only reads the slots, so it never
+ * moves between cpus and a sweep takes one tick however many tiles there are.
+ * A tile whose sample isn't in by then keeps its last miss counter, offline
+ * tiles and tiles whose cpu changed since the tick count 0.
+ *
+ * Runs until it is cancelled, which also stops the samplers.
  *
  * Takes a struct containing the needed arguments:
- * - a pointer to a cpu_set_t
  * - an array of floats where it saves write miss rates
  * - an array of floats where it saves read miss rates
  * - an array of ints with pids per tile
  * - a proc_table struct
+ * - an eventfd to wake up the main thread
  */
 void *poll_pmcs(void *struct_with_all_args) {
-    int wr_miss, wr_cnt, drd_miss, drd_cnt;
-    float all_misses, wr_drd_cnt;
+    struct sample_struct sample;
+    struct timespec epoch;
+    float all_misses, wr_drd_cnt, miss_rate;
+    uint64_t wakeup = 1;
     proc_table table;
+    struct poll_state_struct state = {NULL, NULL, NULL, NULL, 0};
+    float *miss_counters;
+    pthread_attr_t attr;
 
     struct poll_thread_struct *data;
     data = (struct poll_thread_struct *) struct_with_all_args;
@@ -45,68 +78,237 @@ void *poll_pmcs(void *struct_with_all_args) {
     table = data->proctable;
     write_miss_rates = data->wr_miss_rates;
     read_miss_rates = data->drd_miss_rates;
-    cpus_ptr = data->cpus;
 
-    num_of_cpus = tmc_cpus_count(cpus_ptr);
-    printf("\nNUMBER OF CPUS: %i\n", num_of_cpus);
+    printf("\nNUMBER OF TILES: %i\n", table->num_tiles);
+
+    pthread_cleanup_push(release_poll_state, &state);
 
-    // Setup all performance counters on every initialized tile
-    if (setup_all_counters(cpus_ptr) != 0) {
-        printf("setup_all_counters failed\n");
-        return (void *) -1;
+    // Miss counters of this thread, smoothed like those of the proc table
+    miss_counters = state.miss_counters = calloc(table->num_tiles, sizeof(float));
+    state.slots = create_sample_slots(table->num_tiles);
+    state.samplers = malloc(sizeof(struct sampler_thread_struct) * table->num_tiles);
+    state.threads = malloc(sizeof(pthread_t) * table->num_tiles);
+    if (miss_counters == NULL || state.slots == NULL || state.samplers == NULL
+            || state.threads == NULL) {
+        printf("Failed to allocate miss counters\n");
+        pthread_exit((void *) -1);
     }
 
-    // Read counters and update table every POLLING_INTERVAL seconds
-    while(1) {
-        for(int i=0;i<num_of_cpus;i++) {
-            // Switch to tile i
-            if (tmc_cpus_set_my_cpu(tmc_cpus_find_nth_cpu(cpus_ptr, i)) < 0) {
-                tmc_task_die("failure in 'tmc_set_my_cpu'");
-                return (void*) -1;
+    // Start a sampler for every tile, offline ones included since the cpu
+    // set may grow. Samplers only need a small stack.
+    clock_gettime(CLOCK_MONOTONIC, &epoch);
+    pthread_attr_init(&attr);
+    pthread_attr_setstacksize(&attr, SAMPLER_STACK_SIZE);
+    for (int i=0;i<table->num_tiles;i++) {
+        state.samplers[i].proctable = table;
+        state.samplers[i].slots = state.slots;
+        state.samplers[i].tile = i;
+        state.samplers[i].epoch = epoch;
+        if (pthread_create(&state.threads[i], &attr, sample_tile, &state.samplers[i]) != 0) {
+            printf("Failed to start the sampler of tile %i\n", i);
+            pthread_attr_destroy(&attr);
+            pthread_exit((void *) -1);
+        }
+        state.num_threads++;
+    }
+    pthread_attr_destroy(&attr);
+
+    // Collect the samples of every tick
+    for (uint64_t tick=1;;tick++) {
+        wait_for_tick(&epoch, tick, SAMPLE_GRACE_MS);
+        for(int i=0;i<table->num_tiles;i++) {
+            read_sample(state.slots, i, &sample);
+            // The cpu may have left the cpu set, or the tile moved to another
+            // cpu whose counters have just been set up
+            if (sample.cpu < 0 || sample.cpu != get_tile_cpu(table, i)) {
+                miss_counters[i] = 0;
+                continue;
+            }
+            if (sample.tick != tick) {
+                continue;
             }
-            // Read counters
-            read_counters(&wr_miss, &wr_cnt, &drd_miss, &drd_cnt);
 
-            // Update miss counters. Gives the new miss rate to miss_count.
-            all_misses = wr_miss+drd_miss;
-            wr_drd_cnt = wr_cnt + drd_cnt;
-			modify_miss_count(table, i, all_misses/wr_drd_cnt);
+            // Publish the new miss rate, the main thread applies it to the
+            // miss counters after the sweep
+            all_misses = sample.wr_miss + sample.drd_miss;
+            wr_drd_cnt = sample.wr_cnt + sample.drd_cnt;
+            miss_rate = wr_drd_cnt > 0 ? all_misses/wr_drd_cnt : 0;
+			modify_miss_count(table, i, miss_rate);
+            miss_counters[i] = (miss_counters[i] + miss_rate) / 2;
+        }
+        propose_migrations(table, miss_counters, data->proposals);
+        write(data->wakeup_fd, &wakeup, sizeof(wakeup));
+    }
+
+    pthread_cleanup_pop(1);
+    return NULL;
+}
 
-            clear_counters();
+/*
+ * "Thread-function" that samples the counters of one tile. The thread is
+ * pinned to the cpu of the tile and follows it when the tile is bound to
+ * another cpu: the counters of the new cpu are set up at the next tick and
+ * sampled from the tick after that. At every tick the counts since the last
+ * one are published into the slot of the tile, with cpu -1 while the tile is
+ * offline or its counters can't be read. The slot has no other writer. Runs
+ * until poll_pmcs() cancels it.
+ */
+void *sample_tile(void *struct_with_all_args) {
+    struct sampler_thread_struct *data;
+    struct sample_struct sample;
+    int bound_cpu = -1;
+
+    data = (struct sampler_thread_struct *) struct_with_all_args;
+    for (uint64_t tick=1;;tick++) {
+        wait_for_tick(&data->epoch, tick, 0);
+        sample.tick = tick;
+        sample.cpu = get_tile_cpu(data->proctable, data->tile);
+        sample.wr_miss = sample.wr_cnt = sample.drd_miss = sample.drd_cnt = 0;
+
+        if (sample.cpu >= 0 && sample.cpu != bound_cpu) {
+            // Counting starts from now
+            bound_cpu = tmc_cpus_set_my_cpu(sample.cpu) >= 0
+                    && setup_cpu_counters(sample.cpu) == 0 ? sample.cpu : -1;
+            sample.cpu = -1;
         }
-        check_for_possible_migration(table);
-        sleep(POLLING_INTERVAL);
+        else if (sample.cpu >= 0 && read_cpu_counters(sample.cpu, &sample.wr_miss,
+                &sample.wr_cnt, &sample.drd_miss, &sample.drd_cnt) != 0) {
+            bound_cpu = sample.cpu = -1;
+        }
+        publish_sample(data->slots, data->tile, &sample);
+    }
+}
+
+/*
+ * Sleeps until a tick, POLLING_INTERVAL seconds apart from epoch on, plus a
+ * delay in milliseconds. Absolute wakeups keep all threads on the same ticks
+ * however long they take between them.
+ */
+static void wait_for_tick(struct timespec *epoch, uint64_t tick, long delay_ms) {
+    struct timespec wakeup = *epoch;
+
+    wakeup.tv_sec += tick * POLLING_INTERVAL + delay_ms / 1000;
+    wakeup.tv_nsec += (delay_ms % 1000) * 1000000L;
+    if (wakeup.tv_nsec >= 1000000000L) {
+        wakeup.tv_sec++;
+        wakeup.tv_nsec -= 1000000000L;
+    }
+    while (clock_nanosleep(CLOCK_MONOTONIC, TIMER_ABSTIME, &wakeup, NULL) != 0) {
     }
+}
+
+/*
+ * Cleanup handler of poll_pmcs(): cancels and joins the samplers it has
+ * started and frees its buffers.
+ */
+static void release_poll_state(void *arg) {
+    struct poll_state_struct *state = (struct poll_state_struct *) arg;
 
+    for (int i=0;i<state->num_threads;i++) {
+        pthread_cancel(state->threads[i]);
+    }
+    for (int i=0;i<state->num_threads;i++) {
+        pthread_join(state->threads[i], NULL);
+    }
+    free(state->threads);
+    free(state->samplers);
+    destroy_sample_slots(state->slots);
+    free(state->miss_counters);
 }
 
 /*
  * Only migrate processes if a tile has a miss-count-value higher than
  * two times the average miss-count-value.
+ *
+ * Runs in the polling thread, which never changes placement itself: the
+ * tiles to cool down are posted to the proposals ring, and a proposal is
+ * dropped if the ring is full (the next sweep proposes it again).
  */
-void check_for_possible_migration(proc_table table) {
-    float miss_cnt;
+void propose_migrations(proc_table table, float *miss_counters, spsc_ring proposals) {
+    struct migration_proposal_struct proposal;
+    float avg_miss_count = 0;
+    int online_tiles = 0;
+    int tile_cpus[table->num_tiles];
+    float scores[table->num_tiles];
+    float metric_sums[table->num_tiles];
+
+    // When jobs are counted on their own, tiles are compared by the sum of
+    // the job metrics like in the placement order, not by the cpu counters
+    if (table->job_metrics) {
+        for (int i=0;i<table->num_tiles;i++) {
+            metric_sums[i] = get_tile_metric_sum(table, i);
+        }
+        miss_counters = metric_sums;
+    }
+
+    // With a topology tiles are compared by contention score, so a tile is
+    // also cooled down when it shares a cache with busy tiles
+    for (int i=0;i<table->num_tiles;i++) {
+        tile_cpus[i] = get_tile_cpu(table, i);
+    }
+    if (table->topo != NULL) {
+        get_contention(table->topo, table->num_tiles, tile_cpus, miss_counters, scores);
+        miss_counters = scores;
+    }
+
+    // Offline tiles have no processes and are left out of the average
+    for (int i=0;i<table->num_tiles;i++) {
+        if (tile_cpus[i] >= 0) {
+            avg_miss_count += miss_counters[i];
+            online_tiles++;
+        }
+    }
+    if (online_tiles == 0) {
+        return;
+    }
+    avg_miss_count /= online_tiles;
 
     // Debugging - just print values from table
-    /*printf("lolgrate: avg_miss_count = %f\n", table->avg_miss_rate);
+    /*printf("lolgrate: avg_miss_count = %f\n", avg_miss_count);
     printf("lolgrate: processes/miss_cnt: ");
     for (int i=0;i<table->num_tiles;i++) {
-        printf("%i/%f ", i, table->miss_counters[i]);
+        printf("%i/%f ", i, miss_counters[i]);
     }
     printf("\n");
 	*/
     // 1.5 and 2 are magic values I just made up
     // They should most certainly be changed in some way.
     for (int i=0;i<table->num_tiles;i++) {
-        miss_cnt = table->miss_counters[i];
         // Cool down tile if miss rate is reasonably and the tile
         // has enough processes to migrate.
-        if (miss_cnt > (1.5*table->avg_miss_rate) && (get_pid_count(table, i) > 1)) {
+        if (miss_counters[i] > (1.5*avg_miss_count) && (get_pid_count(table, i) > 1)) {
+            proposal.tile = i;
+            proposal.miss_count = miss_counters[i];
+            proposal.avg_miss_count = avg_miss_count;
+            push_ring(proposals, &proposal);
+        }
+    }
+}
+
+/*
+ * Applies the migrations proposed by the polling thread. Runs in the main
+ * thread, so the proposals are checked against the current proc table:
+ * processes may have exited since the sweep. A hot tile is proposed again at
+ * every sweep until it has cooled down, so the ring is drained first and each
+ * tile is cooled down at most once per wakeup.
+ */
+void apply_migrations(proc_table table, spsc_ring proposals) {
+    struct migration_proposal_struct proposal;
+    int proposed[table->num_tiles];
+
+    memset(proposed, 0, sizeof(proposed));
+    while (pop_ring(proposals, &proposal) == 0) {
+        if (proposal.tile >= 0 && proposal.tile < table->num_tiles) {
+            proposed[proposal.tile] = 1;
+        }
+    }
+    for (int i=0;i<table->num_tiles;i++) {
+        if (proposed[i] && get_pid_count(table, i) > 1) {
             //printf("pid count for tile %i is %i", i, get_pid_count(table, i));
         	chill_it(table, i);
         	//migrate_smallest(table, i);
         }
-        /*else if (miss_cnt > (2*table->avg_miss_rate && (get_pid_count(table, i) > 2))) {
+        /*else if (get_pid_count(table, i) > 2) {
             cool_down_tile(table, i, 2);
         }*/
     }
@@ -117,7 +319,7 @@ void check_for_possible_migration(proc_table table) {
  * to a new tile.
  */
 void migrate_smallest(proc_table table, int tilenum) {
-	int new_tile = get_tile(cpus_ptr, table);
+	int new_tile;
 	int pids_on_old = get_pid_count(table, tilenum);
 	pid_t pids_to_move[pids_on_old];
 	get_pid_vector(table, tilenum, pids_to_move, pids_on_old);
@@ -131,6 +333,10 @@ void migrate_smallest(proc_table table, int tilenum) {
 		}
 	}
 
+	// Skip migration if no tile has room for the process
+	if ((new_tile = get_tile(table, min_val)) < 0) {
+		return;
+	}
 	migrate_process(table, smallest_pid, new_tile);
 }
 
@@ -139,13 +345,36 @@ void migrate_smallest(proc_table table, int tilenum) {
 /*
  * Moves processes from a tile to a new one until their total class values are
  * moderately balanced.
+ *
+ * When jobs are counted on their own, the job with the highest metric on the
+ * tile is moved, which is the one causing the misses.
  */
 void chill_it(proc_table table, int tilenum) {
 
-	int new_tile = get_tile(cpus_ptr, table);
+	int new_tile;
     pid_t pids_to_move[1];
+    int pid_count = get_pid_count(table, tilenum);
+    pid_t pids_on_tile[pid_count > 0 ? pid_count : 1];
+    proc_record rec, aggressor = NULL;
+
     get_pid_vector(table, tilenum, pids_to_move, 1);
-    
+    if (table->job_metrics) {
+        pid_count = get_pid_vector(table, tilenum, pids_on_tile, pid_count);
+        for (int i=0;i<pid_count;i++) {
+            rec = get_proc_record(table, pids_on_tile[i]);
+            if (rec != NULL && (aggressor == NULL || rec->metric > aggressor->metric)) {
+                aggressor = rec;
+            }
+        }
+        if (aggressor != NULL) {
+            pids_to_move[0] = aggressor->pid;
+        }
+    }
+
+    // Skip migration if no tile has room for the process
+    if ((new_tile = get_tile(table, get_class(table, pids_to_move[0]))) < 0) {
+        return;
+    }
     migrate_process(table, pids_to_move[0], new_tile);
 
 /*	int from_val = get_total_value_of_classes(table, tilenum);
@@ -184,27 +413,78 @@ void cool_down_tile(proc_table table, int tilenum, int how_much) {
     // Move the pids
     for (int i=0;(i<how_much && i<get_pid_count(table, tilenum));i++) {
         if (pids_to_move[i] > 0) { // Redundant check?
-            new_tile = get_tile(cpus_ptr, table);
+            new_tile = get_tile(table, get_class(table, pids_to_move[i]));
+            if (new_tile < 0) {
+                break;
+            }
             migrate_process(table, pids_to_move[i], new_tile);
         }
     }
 }
 
 /*
- * Moves a process a new tile.
+ * Moves pages of migrated processes to their new node, see page_mover.h.
+ * Needs the topology of the proc table. NULL only changes the cpu.
+ */
+void set_page_mover(page_mover mover) {
+    pages = mover;
+}
+
+/*
+ * Moves a process a new tile. With a page mover, its memory follows it when
+ * the new tile is on another node. If the process can't be moved, e.g. because
+ * the cpu of the tile has left the cpu set since the last update_cpus(), it
+ * stays where it is: the next update_cpus() takes the tile offline and
+ * evacuates it.
  */
 void migrate_process(proc_table table, int pid, int newtile) {
-    int oldtile = get_tile_num(table, pid);
+    int oldtile, oldcpu, newcpu;
     // set pid to new cpu
-    //printf("migrate_process: NUMBER OF CPUS is %i\n", tmc_cpus_count(cpus_ptr));
-    if (tmc_cpus_set_task_cpu((tmc_cpus_find_nth_cpu(cpus_ptr, newtile)), pid) < 0) {
-        tmc_task_die("Failure in tmc_cpus_set_task_cpu (in migrate_process)");
+    newcpu = get_tile_cpu(table, newtile);
+    if (newcpu < 0 || tmc_cpus_set_task_cpu(newcpu, pid) < 0) {
+        printf("Pid %i couldn't be moved to logical tile %i\n", pid, newtile);
+        return;
     }
     
     // Reorder proc_table
-    move_pid_to_tile(table, pid, newtile);
+    oldtile = move_pid_to_tile(table, pid, newtile);
+
+    oldcpu = oldtile >= 0 ? get_tile_cpu(table, oldtile) : -1;
+    if (pages != NULL && table->topo != NULL && (oldcpu < 0
+            || get_cpu_node(table->topo, oldcpu) != get_cpu_node(table->topo, newcpu))) {
+        move_process_pages(pages, pid, get_cpu_node(table->topo, newcpu));
+    }
 
     printf("Pid %i moved from logical tile %i to logical tile %i\n",
            pid, oldtile, newtile);
 }
 
+/*
+ * Moves all processes off a tile that has been taken offline. Each process
+ * goes to the tile get_tile() picks for it, or to the online tile with the
+ * least processes if no tile has room.
+ */
+void evacuate_tile(proc_table table, int tilenum) {
+    int pid_count = get_pid_count(table, tilenum);
+    int new_tile;
+
+    if (pid_count <= 0) {
+        return;
+    }
+    pid_t pids_to_move[pid_count];
+    get_pid_vector(table, tilenum, pids_to_move, pid_count);
+    for (int i=0;i<pid_count;i++) {
+        if ((new_tile = get_tile(table, get_class(table, pids_to_move[i]))) < 0) {
+            for (int j=0;j<table->num_tiles;j++) {
+                if (get_tile_cpu(table, j) >= 0 && (new_tile < 0
+                        || get_pid_count(table, j) < get_pid_count(table, new_tile))) {
+                    new_tile = j;
+                }
+            }
+        }
+        if (new_tile < 0) {
+            return;
+        }
+        migrate_process(table, pids_to_move[i], new_tile);
+    }
+}
@@ -1,18 +1,43 @@
 #ifndef MIGRATE_H
 #define MIGRATE_H
+#include <time.h>
+#include "spsc_ring.h"
+#include "page_mover.h"
+#include "sample_slots.h"
+
 // Struct to be sent to thread that polls pmcs
 struct poll_thread_struct {
     proc_table proctable;
     float *wr_miss_rates;
     float *drd_miss_rates;
-    cpu_set_t *cpus;
+    int wakeup_fd;  // eventfd signalled after every sweep
+    spsc_ring proposals;    // Migration proposals to the main thread
+};
+
+// Struct to be sent to the sampler thread of a tile
+struct sampler_thread_struct {
+    proc_table proctable;
+    sample_slots slots;     // The sampler writes slot tile
+    int tile;
+    struct timespec epoch;  // CLOCK_MONOTONIC time of tick 0
+};
+
+// Proposal from the polling thread to cool down a tile
+struct migration_proposal_struct {
+    int tile;
+    float miss_count;   // Contention score of the tile when proposed
+    float avg_miss_count;
 };
 #endif
 
 // Function prototypes
 void *poll_pmcs(void *struct_with_args);
-void check_for_possible_migration(proc_table table);
+void *sample_tile(void *struct_with_args);
+void propose_migrations(proc_table table, float *miss_counters, spsc_ring proposals);
+void apply_migrations(proc_table table, spsc_ring proposals);
 void migrate_smallest(proc_table table, int tilenum);
 void cool_down_tile(proc_table table, int tile_num, int how_much);
 void chill_it(proc_table table, int tilenum);
 void migrate_process(proc_table table, int pid, int new_tile);
+void evacuate_tile(proc_table table, int tilenum);
+void set_page_mover(page_mover mover);
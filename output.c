@@ -0,0 +1,328 @@
+/*
+ * output.c
+ *
+ * Implementation of the output capture module.
+ */
+
+#define _GNU_SOURCE // splice(), pipe2()
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <fcntl.h>
+#include <errno.h>
+#include <stdint.h>
+#include <pthread.h>
+#include <signal.h>
+#include <sys/ioctl.h>
+#include <sys/epoll.h>
+#include <sys/eventfd.h>
+
+#include "output.h"
+
+#define OUTPUT_MAX_EVENTS 16
+// Largest amount of data moved by one splice() call:
+#define SPLICE_CHUNK 65536
+// Most data moved from one stream per wakeup, so that a busy process can't
+// starve the others. The rest is moved on the next wakeup.
+#define STREAM_QUANTUM (4 * SPLICE_CHUNK)
+#define PATH_SIZE 512
+
+/* One captured stream (stdout or stderr) of a process. The destination file
+ * is opened by the I/O thread when the first data arrives. An empty path
+ * means the stream goes to the multiplexed log. */
+struct stream_struct {
+    int fd;             // Read end of the pipe
+    int out_fd;         // Destination file, -1 until opened
+    pid_t pid;
+    int stream;         // 0 for stdout, 1 for stderr
+    char path[PATH_SIZE];
+};
+
+struct output_mux_struct {
+    char *dir;          // Directory of per-process files, NULL for log
+    int log_fd;         // Multiplexed log, -1 if not used
+    int epoll_fd;
+    int stop_fd;        // eventfd that stops the I/O thread
+    pthread_t thread;
+    pthread_mutex_t lock;
+    pthread_cond_t drained;
+    int open_streams;
+};
+
+static const char *stream_names[] = {"out", "err"};
+
+static void *output_thread(void *arg);
+static int drain_to_file(struct stream_struct *s);
+static int drain_to_log(output_mux mux, struct stream_struct *s, uint32_t events);
+static ssize_t move_data(int from_fd, int to_fd, size_t length);
+static void close_stream(output_mux mux, struct stream_struct *s);
+
+output_mux create_output_mux(char *dir, char *log_file) {
+    output_mux mux;
+    struct epoll_event event;
+    sigset_t all_signals, old_mask;
+
+    if ((mux = malloc(sizeof(struct output_mux_struct))) == NULL) {
+        return NULL;
+    }
+    mux->dir = dir;
+    mux->log_fd = -1;
+    mux->open_streams = 0;
+    if (dir == NULL && (mux->log_fd = open(log_file,
+            O_WRONLY | O_CREAT | O_TRUNC | O_CLOEXEC, 0644)) == -1) {
+        free(mux);
+        return NULL;
+    }
+    if ((mux->epoll_fd = epoll_create(OUTPUT_MAX_EVENTS)) == -1
+            || (mux->stop_fd = eventfd(0, EFD_CLOEXEC)) == -1) {
+        free(mux);
+        return NULL;
+    }
+    fcntl(mux->epoll_fd, F_SETFD, FD_CLOEXEC);
+    event.events = EPOLLIN;
+    event.data.ptr = NULL;
+    if (epoll_ctl(mux->epoll_fd, EPOLL_CTL_ADD, mux->stop_fd, &event) != 0) {
+        free(mux);
+        return NULL;
+    }
+    pthread_mutex_init(&mux->lock, NULL);
+    pthread_cond_init(&mux->drained, NULL);
+
+    // The I/O thread never handles signals
+    sigfillset(&all_signals);
+    pthread_sigmask(SIG_BLOCK, &all_signals, &old_mask);
+    if (pthread_create(&mux->thread, NULL, output_thread, mux) != 0) {
+        pthread_sigmask(SIG_SETMASK, &old_mask, NULL);
+        free(mux);
+        return NULL;
+    }
+    pthread_sigmask(SIG_SETMASK, &old_mask, NULL);
+    return mux;
+}
+
+void destroy_output_mux(output_mux mux) {
+    uint64_t stop = 1;
+
+    if (mux == NULL) {
+        return;
+    }
+    pthread_mutex_lock(&mux->lock);
+    while (mux->open_streams > 0) {
+        pthread_cond_wait(&mux->drained, &mux->lock);
+    }
+    pthread_mutex_unlock(&mux->lock);
+    write(mux->stop_fd, &stop, sizeof(stop));
+    pthread_join(mux->thread, NULL);
+
+    close(mux->stop_fd);
+    close(mux->epoll_fd);
+    if (mux->log_fd != -1) {
+        close(mux->log_fd);
+    }
+    pthread_cond_destroy(&mux->drained);
+    pthread_mutex_destroy(&mux->lock);
+    free(mux);
+}
+
+int open_job_output(struct job_output_struct *out) {
+    int fds[2];
+
+    for (int i=0;i<2;i++) {
+        if (pipe2(fds, O_CLOEXEC) != 0) {
+            if (i == 1) {
+                close(out->read_fds[0]);
+                close(out->child_fds[0]);
+            }
+            return -1;
+        }
+        // Only the I/O thread's end is non-blocking
+        fcntl(fds[0], F_SETFL, O_NONBLOCK);
+        out->read_fds[i] = fds[0];
+        out->child_fds[i] = fds[1];
+    }
+    return 0;
+}
+
+int attach_job_output(output_mux mux, struct job_output_struct *out,
+        pid_t pid, cmd_entry cmd) {
+    struct stream_struct *s;
+    struct epoll_event event;
+    int status = 0;
+
+    for (int i=0;i<2;i++) {
+        close(out->child_fds[i]);
+        if ((s = malloc(sizeof(struct stream_struct))) == NULL) {
+            close(out->read_fds[i]);
+            status = -1;
+            continue;
+        }
+        s->fd = out->read_fds[i];
+        s->out_fd = -1;
+        s->pid = pid;
+        s->stream = i;
+        s->path[0] = '\0';
+        // A redirection in the workload wins over the capture destination
+        if (i == 0 && cmd->new_stdout != NULL) {
+            if (cmd->new_stdout[0] == '/') {
+                snprintf(s->path, PATH_SIZE, "%s", cmd->new_stdout);
+            }
+            else {
+                snprintf(s->path, PATH_SIZE, "%s/%s", cmd->dir, cmd->new_stdout);
+            }
+        }
+        else if (mux->dir != NULL) {
+            snprintf(s->path, PATH_SIZE, "%s/%i.%s", mux->dir, pid, stream_names[i]);
+        }
+
+        pthread_mutex_lock(&mux->lock);
+        mux->open_streams++;
+        pthread_mutex_unlock(&mux->lock);
+        event.events = EPOLLIN;
+        event.data.ptr = s;
+        if (epoll_ctl(mux->epoll_fd, EPOLL_CTL_ADD, s->fd, &event) != 0) {
+            close_stream(mux, s);
+            status = -1;
+        }
+    }
+    return status;
+}
+
+void discard_job_output(struct job_output_struct *out) {
+    for (int i=0;i<2;i++) {
+        close(out->child_fds[i]);
+        close(out->read_fds[i]);
+    }
+}
+
+/*
+ * Thread function. Moves data from the pipes to their destinations until
+ * stop_fd is signalled.
+ */
+static void *output_thread(void *arg) {
+    output_mux mux = (output_mux) arg;
+    struct epoll_event events[OUTPUT_MAX_EVENTS];
+    struct stream_struct *s;
+    int num_events, eof;
+
+    while (1) {
+        num_events = epoll_wait(mux->epoll_fd, events, OUTPUT_MAX_EVENTS, -1);
+        for (int i=0;i<num_events;i++) {
+            if ((s = events[i].data.ptr) == NULL) {
+                return NULL;
+            }
+            if (s->path[0] != '\0') {
+                eof = drain_to_file(s);
+            }
+            else {
+                eof = drain_to_log(mux, s, events[i].events);
+            }
+            if (eof) {
+                close_stream(mux, s);
+            }
+        }
+    }
+}
+
+/*
+ * Moves the available data of the stream to its own file, at most
+ * STREAM_QUANTUM bytes.
+ * Returns 1 when the stream has reached end of file, otherwise 0.
+ */
+static int drain_to_file(struct stream_struct *s) {
+    size_t budget = STREAM_QUANTUM;
+    ssize_t n;
+
+    if (s->out_fd == -1) {
+        s->out_fd = open(s->path, O_WRONLY | O_CREAT | O_TRUNC | O_CLOEXEC, 0644);
+        if (s->out_fd == -1) {
+            printf("failed to open output file %s\n", s->path);
+        }
+    }
+    while (budget > 0) {
+        if ((n = move_data(s->fd, s->out_fd,
+                budget < SPLICE_CHUNK ? budget : SPLICE_CHUNK)) == 0) {
+            return 1;
+        }
+        else if (n < 0) {
+            return errno != EAGAIN;
+        }
+        budget -= n;
+    }
+    return 0;
+}
+
+/*
+ * Moves the available data of the stream to the multiplexed log, at most
+ * STREAM_QUANTUM bytes, preceded by a header with pid, stream and length.
+ * events are those epoll reported for the stream.
+ * Returns 1 when the stream has reached end of file, otherwise 0.
+ */
+static int drain_to_log(output_mux mux, struct stream_struct *s, uint32_t events) {
+    char header[64];
+    int available, header_length;
+    ssize_t n;
+
+    if (ioctl(s->fd, FIONREAD, &available) != 0) {
+        return 1;
+    }
+    if (available == 0) {
+        // The writers had all gone when epoll reported the hangup, so no
+        // data can arrive after the pipe has been found empty
+        return (events & EPOLLHUP) != 0;
+    }
+    if (available > STREAM_QUANTUM) {
+        available = STREAM_QUANTUM;
+    }
+    header_length = snprintf(header, sizeof(header), "@%i %s %i\n",
+            s->pid, stream_names[s->stream], available);
+    write(mux->log_fd, header, header_length);
+    // The bytes counted above are in the pipe, so this never blocks
+    while (available > 0 && (n = move_data(s->fd, mux->log_fd, available)) > 0) {
+        available -= n;
+    }
+    return 0;
+}
+
+/*
+ * Moves up to length bytes from a pipe to a file, with splice() if the kernel
+ * supports it for the destination, otherwise through a buffer. Data is
+ * dropped if to_fd is -1.
+ * Returns the number of bytes moved, 0 at end of file and -1 on error.
+ */
+static ssize_t move_data(int from_fd, int to_fd, size_t length) {
+    char buf[4096];
+    ssize_t n;
+
+    if (to_fd != -1) {
+        n = splice(from_fd, NULL, to_fd, NULL, length,
+                SPLICE_F_MOVE | SPLICE_F_NONBLOCK);
+        if (n >= 0 || errno != EINVAL) {
+            return n;
+        }
+    }
+    if ((n = read(from_fd, buf, length < sizeof(buf) ? length : sizeof(buf))) > 0
+            && to_fd != -1) {
+        write(to_fd, buf, n);
+    }
+    return n;
+}
+
+/*
+ * Removes a stream from the I/O thread and frees it.
+ */
+static void close_stream(output_mux mux, struct stream_struct *s) {
+    epoll_ctl(mux->epoll_fd, EPOLL_CTL_DEL, s->fd, NULL);
+    close(s->fd);
+    if (s->out_fd != -1) {
+        close(s->out_fd);
+    }
+    free(s);
+
+    pthread_mutex_lock(&mux->lock);
+    if (--mux->open_streams == 0) {
+        pthread_cond_signal(&mux->drained);
+    }
+    pthread_mutex_unlock(&mux->lock);
+}
@@ -0,0 +1,60 @@
+/* output.h
+ *
+ * Capture of the stdout/stderr of started processes.
+ *
+ * Every captured process writes its stdout and stderr to pipes. A dedicated
+ * I/O thread drains the pipes with splice(), so the data is moved to the
+ * destination without being copied through the scheduler, and a slow disk
+ * only ever stalls the I/O thread. The destination is either one file per
+ * process and stream, or one multiplexed log shared by all processes.
+ *
+ * Per-process files are named <dir>/<pid>.out and <dir>/<pid>.err. A "> file"
+ * redirection in the workload replaces the .out file.
+ *
+ * In the multiplexed log every chunk of output is preceded by a header line
+ * "@<pid> <out|err> <length>\n" followed by exactly length bytes of output.
+ * */
+
+#ifndef _OUTPUT_H
+#define _OUTPUT_H
+
+#include <unistd.h>
+#include "cmd_list.h"
+
+/* Pipes of one process being started. child_fds are the write ends to be
+ * used as stdout (0) and stderr (1) of the process, read_fds the read ends. */
+struct job_output_struct
+{
+    int child_fds[2];
+    int read_fds[2];
+};
+
+/* Each capture instance is represented by an output_mux_struct. */
+struct output_mux_struct;
+
+/* Typedef for a user handle to a capture instance. */
+typedef struct output_mux_struct *output_mux;
+
+/* Creates a capture instance and starts its I/O thread. Output is written to
+ * per-process files in dir, or if dir is NULL, to the multiplexed log
+ * log_file. On success a handle is returned, otherwise NULL. */
+output_mux create_output_mux(char *dir, char *log_file);
+
+/* Waits until the output of all processes is drained, stops the I/O thread
+ * and frees allocated memory. */
+void destroy_output_mux(output_mux mux);
+
+/* Creates the pipes for a process that is about to be started. All
+ * descriptors are close-on-exec. On success 0 is returned, otherwise -1. */
+int open_job_output(struct job_output_struct *out);
+
+/* Hands the read ends to the I/O thread once the process has been started
+ * with the given pid, and closes the write ends in the scheduler.
+ * On success 0 is returned, otherwise -1. */
+int attach_job_output(output_mux mux, struct job_output_struct *out,
+        pid_t pid, cmd_entry cmd);
+
+/* Closes all pipes of a process that could not be started. */
+void discard_job_output(struct job_output_struct *out);
+
+#endif
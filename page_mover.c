@@ -0,0 +1,273 @@
+/*
+ * page_mover.c
+ *
+ * Implementation of the page mover module.
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <stdint.h>
+#include <errno.h>
+#include <unistd.h>
+#include <sys/syscall.h>
+#include <sys/timerfd.h>
+
+#include "page_mover.h"
+
+// Flag of move_pages(), from numaif.h
+#ifndef MPOL_MF_MOVE
+#define MPOL_MF_MOVE (1 << 1)
+#endif
+
+// Time between ticks, the budget of a tick is the rate times this
+#define MOVE_INTERVAL_MS 100
+// Pages queried and moved per call to move_pages()
+#define MOVE_BATCH 256
+// Pages looked at per tick, so that walking sparse address spaces is bounded
+// even when few pages are moved
+#define MAX_SCAN_PAGES (64 * 1024)
+// Longest line of /proc/<pid>/maps that is parsed, longer paths are skipped
+#define MAPS_LINE_SIZE 512
+
+/* A queued move. next is the lowest address not walked yet. */
+struct page_move_struct {
+    pid_t pid;
+    int node;
+    uintptr_t next;
+};
+
+struct page_mover_struct {
+    int timer_fd;
+    long page_size;
+    int pages_per_tick;
+    int armed;
+    struct page_move_struct *moves;
+    int num_moves;
+    int max_moves;
+};
+
+static int move_some_pages(page_mover mover, struct page_move_struct *move,
+        int *budget, int *scanned);
+static int move_range(page_mover mover, struct page_move_struct *move,
+        uintptr_t end, int *budget, int *scanned);
+static long sys_move_pages(pid_t pid, unsigned long count, void **pages,
+        const int *nodes, int *status, int flags);
+static void arm_timer(page_mover mover);
+
+page_mover create_page_mover(long long bytes_per_sec) {
+    page_mover mover;
+
+#ifndef SYS_move_pages
+    return NULL;
+#endif
+    if (bytes_per_sec <= 0 || (mover = malloc(sizeof(struct page_mover_struct))) == NULL) {
+        return NULL;
+    }
+    if ((mover->timer_fd = timerfd_create(CLOCK_MONOTONIC, TFD_CLOEXEC | TFD_NONBLOCK)) == -1) {
+        free(mover);
+        return NULL;
+    }
+    mover->page_size = sysconf(_SC_PAGESIZE);
+    mover->pages_per_tick = bytes_per_sec * MOVE_INTERVAL_MS / 1000 / mover->page_size;
+    if (mover->pages_per_tick < 1) {
+        mover->pages_per_tick = 1;
+    }
+    mover->armed = 0;
+    mover->moves = NULL;
+    mover->num_moves = 0;
+    mover->max_moves = 0;
+    return mover;
+}
+
+void destroy_page_mover(page_mover mover) {
+    if (mover == NULL) {
+        return;
+    }
+    close(mover->timer_fd);
+    free(mover->moves);
+    free(mover);
+}
+
+int get_page_mover_fd(page_mover mover) {
+    return mover->timer_fd;
+}
+
+int move_process_pages(page_mover mover, pid_t pid, int node) {
+    struct page_move_struct *moves;
+
+    // A process on its way to another node changes direction
+    for (int i=0;i<mover->num_moves;i++) {
+        if (mover->moves[i].pid == pid) {
+            mover->moves[i].node = node;
+            mover->moves[i].next = 0;
+            return 0;
+        }
+    }
+    if (mover->num_moves == mover->max_moves) {
+        if ((moves = realloc(mover->moves, sizeof(struct page_move_struct)
+                * (2 * mover->max_moves + 4))) == NULL) {
+            return -1;
+        }
+        mover->moves = moves;
+        mover->max_moves = 2 * mover->max_moves + 4;
+    }
+    mover->moves[mover->num_moves].pid = pid;
+    mover->moves[mover->num_moves].node = node;
+    mover->moves[mover->num_moves].next = 0;
+    mover->num_moves++;
+    arm_timer(mover);
+    return 0;
+}
+
+void cancel_page_move(page_mover mover, pid_t pid) {
+    for (int i=0;i<mover->num_moves;i++) {
+        if (mover->moves[i].pid == pid) {
+            memmove(&mover->moves[i], &mover->moves[i + 1],
+                    sizeof(struct page_move_struct) * (mover->num_moves - i - 1));
+            mover->num_moves--;
+            break;
+        }
+    }
+    arm_timer(mover);
+}
+
+int run_page_mover(page_mover mover) {
+    uint64_t ticks;
+    int budget = mover->pages_per_tick;
+    int scanned = 0;
+
+    // Missed ticks don't add up to a burst
+    read(mover->timer_fd, &ticks, sizeof(ticks));
+    while (mover->num_moves > 0 && budget > 0 && scanned < MAX_SCAN_PAGES) {
+        if (move_some_pages(mover, &mover->moves[0], &budget, &scanned) == 0) {
+            break;
+        }
+        // Done, or the process is gone
+        memmove(&mover->moves[0], &mover->moves[1],
+                sizeof(struct page_move_struct) * (mover->num_moves - 1));
+        mover->num_moves--;
+    }
+    arm_timer(mover);
+    return mover->pages_per_tick - budget;
+}
+
+/*
+ * Walks the mappings of a process from move->next on, moving pages until the
+ * budget is used up or MAX_SCAN_PAGES pages have been scanned.
+ * Returns 0 if the move should continue on the next tick, 1 if it is done or
+ * can't continue.
+ */
+static int move_some_pages(page_mover mover, struct page_move_struct *move,
+        int *budget, int *scanned) {
+    char path[64];
+    char line[MAPS_LINE_SIZE];
+    unsigned long start, end;
+    FILE *maps;
+    int result = 1;
+    int whole_line = 1;
+
+    snprintf(path, sizeof(path), "/proc/%i/maps", move->pid);
+    if ((maps = fopen(path, "r")) == NULL) {
+        return 1;
+    }
+    while (fgets(line, sizeof(line), maps) != NULL) {
+        // Only the start of a line is a mapping
+        if (!whole_line) {
+            whole_line = strchr(line, '\n') != NULL;
+            continue;
+        }
+        whole_line = strchr(line, '\n') != NULL;
+        if (sscanf(line, "%lx-%lx", &start, &end) != 2 || end <= move->next
+                || strstr(line, "[vsyscall]") != NULL) {
+            continue;
+        }
+        if (start > move->next) {
+            move->next = start;
+        }
+        if ((result = move_range(mover, move, end, budget, scanned)) <= 0) {
+            break;
+        }
+    }
+    fclose(maps);
+    return result != 0;
+}
+
+/*
+ * Moves the pages from move->next up to end that aren't on the node yet,
+ * within the budget. move->next is advanced past the pages handled.
+ * Returns 1 if the range is done, 0 if the budget or scan limit ran out, -1
+ * if the process can't be moved.
+ */
+static int move_range(page_mover mover, struct page_move_struct *move,
+        uintptr_t end, int *budget, int *scanned) {
+    void *pages[MOVE_BATCH];
+    void *to_move[MOVE_BATCH];
+    int status[MOVE_BATCH];
+    int nodes[MOVE_BATCH];
+    int count, num_to_move;
+
+    while (move->next < end) {
+        if (*budget <= 0 || *scanned >= MAX_SCAN_PAGES) {
+            return 0;
+        }
+        // Find out where a batch of pages is, without moving them
+        for (count=0;count<MOVE_BATCH && move->next+count*mover->page_size<end;count++) {
+            pages[count] = (void *) (move->next + count * mover->page_size);
+        }
+        if (sys_move_pages(move->pid, count, pages, NULL, status, 0) != 0) {
+            return -1;
+        }
+        // Move the resident ones on other nodes, as far as the budget goes
+        num_to_move = 0;
+        for (int i=0;i<count;i++) {
+            if (status[i] >= 0 && status[i] != move->node) {
+                if (num_to_move == *budget) {
+                    count = i;
+                    break;
+                }
+                nodes[num_to_move] = move->node;
+                to_move[num_to_move++] = pages[i];
+            }
+        }
+        if (num_to_move > 0 && sys_move_pages(move->pid, num_to_move, to_move,
+                nodes, status, MPOL_MF_MOVE) < 0 && errno != ENOENT) {
+            return -1;
+        }
+        *budget -= num_to_move;
+        *scanned += count;
+        move->next += count * mover->page_size;
+    }
+    return 1;
+}
+
+/*
+ * Calls move_pages(), see move_pages(2).
+ */
+static long sys_move_pages(pid_t pid, unsigned long count, void **pages,
+        const int *nodes, int *status, int flags) {
+#ifdef SYS_move_pages
+    return syscall(SYS_move_pages, pid, count, pages, nodes, status, flags);
+#else
+    errno = ENOSYS;
+    return -1;
+#endif
+}
+
+/*
+ * Arms the tick timer while moves are queued and disarms it otherwise.
+ */
+static void arm_timer(page_mover mover) {
+    struct itimerspec timer;
+
+    if ((mover->num_moves > 0) == mover->armed) {
+        return;
+    }
+    memset(&timer, 0, sizeof(timer));
+    if (mover->num_moves > 0) {
+        timer.it_interval.tv_nsec = MOVE_INTERVAL_MS * 1000000L;
+        timer.it_value = timer.it_interval;
+    }
+    timerfd_settime(mover->timer_fd, 0, &timer, NULL);
+    mover->armed = mover->num_moves > 0;
+}
@@ -0,0 +1,54 @@
+/* page_mover.h
+ *
+ * Moves the resident pages of migrated processes to the NUMA node of their
+ * new cpu, at a limited rate.
+ *
+ * A move is queued when a process is migrated and carried out a few pages at
+ * a time with move_pages(): on every tick the address space of the process is
+ * walked from where the last tick stopped (see /proc/<pid>/maps), pages
+ * already on the node are skipped and at most the page budget of a tick is
+ * moved, so that moving a large process doesn't saturate the interconnect.
+ * Moves are carried out in the order they were queued. A process that is
+ * migrated again before its move is done continues towards its new node.
+ *
+ * Pages allocated after the migration need no move: under the default memory
+ * policy they are allocated on the node of the cpu the process runs on. Linux
+ * has no call to change the policy of another process, so processes that set
+ * a policy of their own keep it.
+ * */
+
+#ifndef _PAGE_MOVER_H
+#define _PAGE_MOVER_H
+
+#include <unistd.h>
+
+/* Each mover instance is represented by a page_mover_struct. */
+struct page_mover_struct;
+
+/* Typedef for a user handle to a mover instance. */
+typedef struct page_mover_struct *page_mover;
+
+/* Creates a mover that moves at most bytes_per_sec bytes per second. On
+ * success a handle to the mover is returned, otherwise NULL (also if the
+ * system can't move pages). */
+page_mover create_page_mover(long long bytes_per_sec);
+
+/* Drops all queued moves and frees allocated memory. */
+void destroy_page_mover(page_mover mover);
+
+/* Returns a timer descriptor that is readable when run_page_mover() should be
+ * called. It is only armed while moves are queued. */
+int get_page_mover_fd(page_mover mover);
+
+/* Queues a move of the pages of a process to the specified node.
+ * Returns 0 on success, -1 on failure. */
+int move_process_pages(page_mover mover, pid_t pid, int node);
+
+/* Drops the queued move of a process, e.g. when it has exited. Must be called
+ * before its pid can be reused. */
+void cancel_page_move(page_mover mover, pid_t pid);
+
+/* Moves the pages of one tick. Returns the number of pages moved. */
+int run_page_mover(page_mover mover);
+
+#endif
@@ -38,6 +38,58 @@ clear_counters()
   __insn_mtspr(SPR_AUX_PERF_COUNT_1, 0);
 }
 
+/*
+ * Moves the calling thread to a cpu and sets up its counters.
+ * Returns 0 on success, -1 if the thread can't run on the cpu.
+ */
+int setup_cpu_counters(int cpu) {
+    if (tmc_cpus_set_my_cpu(cpu) < 0) {
+        return -1;
+    }
+    clear_counters();
+    setup_counters(LOCAL_WR_MISS, LOCAL_WR_CNT, LOCAL_DRD_MISS, LOCAL_DRD_CNT);
+    return 0;
+}
+
+/*
+ * Moves the calling thread to a cpu, reads its counters and clears them.
+ * Returns 0 on success, -1 if the thread can't run on the cpu.
+ */
+int read_cpu_counters(int cpu, int *wr_miss, int *wr_cnt, int *drd_miss, int *drd_cnt) {
+    if (tmc_cpus_set_my_cpu(cpu) < 0) {
+        return -1;
+    }
+    read_counters(wr_miss, wr_cnt, drd_miss, drd_cnt);
+    clear_counters();
+    return 0;
+}
+
+/*
+ * The SPRs count per tile, so there are no per-job counters.
+ */
+job_counters open_job_counters(pid_t pid) {
+    return NULL;
+}
+
+int open_exec_events(pid_t pid, int *fds) {
+    return -1;
+}
+
+job_counters adopt_job_counters(int *fds) {
+    for (int i=0;i<JOB_EVENTS;i++) {
+        close(fds[i]);
+    }
+    return NULL;
+}
+
+int read_job_counters(job_counters counters, long long *misses, long long *accesses,
+        long long *nsecs) {
+    return -1;
+}
+
+void close_job_counters(job_counters counters) {
+}
+
 /*
  * Setup counters for all tiles in cpu set
  */ 
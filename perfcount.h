@@ -1,3 +1,8 @@
+#ifndef _PERFCOUNT_H
+#define _PERFCOUNT_H
+
+#include <sys/types.h>
+
 #define SPR_PERF_COUNT_CTL  0x4207
 #define SPR_AUX_PERF_COUNT_CTL  0x6007
 
@@ -16,9 +21,47 @@
 #define LOCAL_DRD_MISS 0x34
 #define LOCAL_DRD_CNT 0x28
 
+/* Counter backends: perfcount.c programs the Tilera SPRs of the tile the
+ * calling thread runs on, perfcount_perf.c uses Linux perf_event_open() with
+ * one event group per cpu. The Makefile picks one (COUNTERS).
+ *
+ * The functions below address a cpu and count the four events set up by
+ * setup_all_counters(): write misses, writes, data read misses and data
+ * reads, or the nearest events perf offers. read_cpu_counters() returns the
+ * counts since the last read or setup, scaled up if the events were
+ * multiplexed. With the perf backend no thread has to move to the cpu. */
+int setup_cpu_counters(int cpu);
+int read_cpu_counters(int cpu, int *wr_miss, int *wr_cnt, int *drd_miss, int *drd_cnt);
+
+/* Per-job counter sessions, which count the cache misses and accesses of a
+ * process and of the threads and children it creates after the session is
+ * opened, on whatever cpu they run. read_job_counters() returns the counts
+ * since the last read or open, scaled up if the events were multiplexed, and
+ * the nanoseconds they cover. Only the perf backend has them, open fails with
+ * the Tilera backend.
+ *
+ * To count a job from its start, open_exec_events() opens the JOB_EVENTS
+ * events of a process that hasn't exec'd yet (0 for the calling one) into
+ * fds, disabled until its next exec. It only makes system calls, so a vfork()
+ * child can open its own events and pass the close-on-exec descriptors on.
+ * adopt_job_counters() makes a session of them, or closes them on failure. */
+#define JOB_EVENTS 2
+
+struct job_counters_struct;
+typedef struct job_counters_struct *job_counters;
+
+job_counters open_job_counters(pid_t pid);
+int open_exec_events(pid_t pid, int *fds);
+job_counters adopt_job_counters(int *fds);
+int read_job_counters(job_counters counters, long long *misses, long long *accesses,
+        long long *nsecs);
+void close_job_counters(job_counters counters);
+
 void clear_perf_counters();
 void setup_counters(int event1, int event2, int event3, int event4);
 void read_counters(int* event1, int* event2, int* event3, int* event4);
 void clear_counters(void);
 int setup_all_counters(cpu_set_t *cpus);
 int clear_all_counters(cpu_set_t *cpus);
+
+#endif
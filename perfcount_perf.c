@@ -0,0 +1,350 @@
+/*
+ * perfcount_perf.c
+ *
+ * Counter backend on Linux perf_event_open(), see perfcount.h.
+ *
+ * Each cpu gets one event group, counting all tasks on the cpu. The group is
+ * read with a single read() from any thread, together with the times it was
+ * enabled and running, so counts can be scaled up when the kernel multiplexes
+ * the group with other events. Counting per cpu needs perf_event_paranoid <= 0
+ * or CAP_PERFMON.
+ *
+ * The Tilera write miss and data read events have no portable equivalent.
+ * Last level cache misses and references take the place of the write events,
+ * and L1 data cache read misses and reads that of the data read events. An
+ * event the cpu doesn't support counts 0.
+ *
+ * Job sessions count last level cache misses and references of a process in
+ * user space, inherited by its threads and children, so they only need the
+ * permission to trace the process. Inherited events can't be read as a group,
+ * so each is read on its own.
+ */
+
+#define _GNU_SOURCE // sched_getcpu()
+
+#include <stdio.h>
+#include <stdint.h>
+#include <stdlib.h>
+#include <string.h>
+#include <limits.h>
+#include <unistd.h>
+#include <sched.h>
+#include <sys/ioctl.h>
+#include <sys/syscall.h>
+#include <linux/perf_event.h>
+
+#include <tmc/cpus.h>
+
+#include "perfcount.h"
+
+#define NUM_EVENTS 4
+
+#define L1D_READ(result) (PERF_COUNT_HW_CACHE_L1D | (PERF_COUNT_HW_CACHE_OP_READ << 8) \
+        | ((result) << 16))
+
+/* Events in the order of read_counters(). */
+static const struct {
+    uint32_t type;
+    uint64_t config;
+} events[NUM_EVENTS] = {
+    {PERF_TYPE_HARDWARE, PERF_COUNT_HW_CACHE_MISSES},
+    {PERF_TYPE_HARDWARE, PERF_COUNT_HW_CACHE_REFERENCES},
+    {PERF_TYPE_HW_CACHE, L1D_READ(PERF_COUNT_HW_CACHE_RESULT_MISS)},
+    {PERF_TYPE_HW_CACHE, L1D_READ(PERF_COUNT_HW_CACHE_RESULT_ACCESS)},
+};
+
+/* Layout of a group read with PERF_FORMAT_GROUP and both times. */
+struct group_read_struct {
+    uint64_t nr;
+    uint64_t time_enabled;
+    uint64_t time_running;
+    uint64_t values[NUM_EVENTS];
+};
+
+/* Event group of a cpu. */
+struct cpu_group_struct {
+    int open;
+    int fds[NUM_EVENTS];    // -1 for events that couldn't be opened
+    int slots[NUM_EVENTS];  // Position of each event in a group read, or -1
+    struct group_read_struct last;  // Read at the last read or setup
+};
+
+static struct cpu_group_struct groups[CPU_SETSIZE];
+
+/* Reading of a single event with both times. */
+struct event_read_struct {
+    uint64_t value;
+    uint64_t time_enabled;
+    uint64_t time_running;
+};
+
+/* Counter session of a job: misses and references. */
+struct job_counters_struct {
+    int fds[JOB_EVENTS];
+    struct event_read_struct last[JOB_EVENTS];  // At the last read, 0 at first
+};
+
+static int open_group(int cpu);
+static int read_group(int cpu, struct group_read_struct *values);
+static int open_job_event(int event, pid_t pid, int on_exec);
+
+int setup_cpu_counters(int cpu) {
+    if (cpu < 0 || cpu >= CPU_SETSIZE) {
+        return -1;
+    }
+    if (!groups[cpu].open && open_group(cpu) != 0) {
+        return -1;
+    }
+    // Start counting from now
+    return read_group(cpu, &groups[cpu].last);
+}
+
+int read_cpu_counters(int cpu, int *wr_miss, int *wr_cnt, int *drd_miss, int *drd_cnt) {
+    struct cpu_group_struct *group;
+    struct group_read_struct now;
+    int *counts[NUM_EVENTS] = {wr_miss, wr_cnt, drd_miss, drd_cnt};
+    uint64_t enabled, running;
+    double scaled;
+    int slot;
+
+    if (cpu < 0 || cpu >= CPU_SETSIZE || !groups[cpu].open || read_group(cpu, &now) != 0) {
+        return -1;
+    }
+    group = &groups[cpu];
+    enabled = now.time_enabled - group->last.time_enabled;
+    running = now.time_running - group->last.time_running;
+    for (int i=0;i<NUM_EVENTS;i++) {
+        *counts[i] = 0;
+        if ((slot = group->slots[i]) < 0 || running == 0) {
+            continue;
+        }
+        // The group only counted for running out of enabled nanoseconds
+        scaled = (double) (now.values[slot] - group->last.values[slot]) * enabled / running;
+        *counts[i] = scaled < INT_MAX ? (int) scaled : INT_MAX;
+    }
+    group->last = now;
+    return 0;
+}
+
+job_counters open_job_counters(pid_t pid) {
+    int fds[JOB_EVENTS];
+
+    for (int i=0;i<JOB_EVENTS;i++) {
+        if ((fds[i] = open_job_event(i, pid, 0)) < 0) {
+            while (--i >= 0) {
+                close(fds[i]);
+            }
+            return NULL;
+        }
+    }
+    return adopt_job_counters(fds);
+}
+
+int open_exec_events(pid_t pid, int *fds) {
+    for (int i=0;i<JOB_EVENTS;i++) {
+        if ((fds[i] = open_job_event(i, pid, 1)) < 0) {
+            while (--i >= 0) {
+                close(fds[i]);
+            }
+            return -1;
+        }
+    }
+    return 0;
+}
+
+job_counters adopt_job_counters(int *fds) {
+    job_counters counters;
+
+    if ((counters = malloc(sizeof(struct job_counters_struct))) == NULL) {
+        for (int i=0;i<JOB_EVENTS;i++) {
+            close(fds[i]);
+        }
+        return NULL;
+    }
+    // New events count from 0, a job's may already have counted since exec
+    memcpy(counters->fds, fds, sizeof(counters->fds));
+    memset(counters->last, 0, sizeof(counters->last));
+    return counters;
+}
+
+int read_job_counters(job_counters counters, long long *misses, long long *accesses,
+        long long *nsecs) {
+    struct event_read_struct now[JOB_EVENTS];
+    long long *counts[JOB_EVENTS] = {misses, accesses};
+    uint64_t enabled, running;
+
+    for (int i=0;i<JOB_EVENTS;i++) {
+        if (read(counters->fds[i], &now[i], sizeof(struct event_read_struct))
+                != sizeof(struct event_read_struct)) {
+            return -1;
+        }
+    }
+    for (int i=0;i<JOB_EVENTS;i++) {
+        enabled = now[i].time_enabled - counters->last[i].time_enabled;
+        running = now[i].time_running - counters->last[i].time_running;
+        *counts[i] = running == 0 ? 0 : (long long) ((double) (now[i].value
+                - counters->last[i].value) * enabled / running);
+        counters->last[i] = now[i];
+    }
+    *nsecs = enabled;
+    return 0;
+}
+
+void close_job_counters(job_counters counters) {
+    if (counters == NULL) {
+        return;
+    }
+    for (int i=0;i<JOB_EVENTS;i++) {
+        close(counters->fds[i]);
+    }
+    free(counters);
+}
+
+/*
+ * Opens a job event of a process in user space, inherited by its threads and
+ * children. With on_exec it is disabled until the process execs. Only makes
+ * system calls, so it can run in a vfork() child.
+ * Returns the descriptor, or -1 on error.
+ */
+static int open_job_event(int event, pid_t pid, int on_exec) {
+    struct perf_event_attr attr;
+
+    memset(&attr, 0, sizeof(attr));
+    attr.size = sizeof(attr);
+    attr.type = events[event].type;
+    attr.config = events[event].config;
+    attr.read_format = PERF_FORMAT_TOTAL_TIME_ENABLED | PERF_FORMAT_TOTAL_TIME_RUNNING;
+    attr.inherit = 1;
+    attr.exclude_kernel = 1;
+    attr.exclude_hv = 1;
+    attr.disabled = on_exec;
+    attr.enable_on_exec = on_exec;
+    return syscall(SYS_perf_event_open, &attr, pid, -1, -1, PERF_FLAG_FD_CLOEXEC);
+}
+
+/*
+ * Sets up counting on the cpu the calling thread runs on. The events are
+ * always those of perfcount.h.
+ */
+void setup_counters(int event1, int event2, int event3, int event4) {
+    setup_cpu_counters(sched_getcpu());
+}
+
+/*
+ * Reads the counters of the cpu the calling thread runs on.
+ */
+void read_counters(int* event1, int* event2, int* event3, int* event4) {
+    struct cpu_group_struct *group;
+    struct group_read_struct last;
+    int cpu = sched_getcpu();
+
+    if (cpu < 0 || cpu >= CPU_SETSIZE || !groups[cpu].open) {
+        *event1 = *event2 = *event3 = *event4 = 0;
+        return;
+    }
+    // Without clearing the counters
+    group = &groups[cpu];
+    last = group->last;
+    read_cpu_counters(cpu, event1, event2, event3, event4);
+    group->last = last;
+}
+
+/*
+ * Clears the counters of the cpu the calling thread runs on.
+ */
+void clear_counters(void) {
+    int cpu = sched_getcpu();
+
+    if (cpu >= 0 && cpu < CPU_SETSIZE && groups[cpu].open) {
+        read_group(cpu, &groups[cpu].last);
+    }
+}
+
+/*
+ * Setup counters for all cpus in cpu set
+ */
+int setup_all_counters(cpu_set_t *cpus) {
+    int num_of_cpus = tmc_cpus_count(cpus);
+    for (int i=0;i<num_of_cpus;i++) {
+        if (setup_cpu_counters(tmc_cpus_find_nth_cpu(cpus, i)) != 0) {
+            return -1;
+        }
+    }
+    return 0;
+}
+
+/*
+ * Clear counters for all cpus in cpu set
+ */
+int clear_all_counters(cpu_set_t *cpus) {
+    int cpu;
+    int num_of_cpus = tmc_cpus_count(cpus);
+    for (int i=0;i<num_of_cpus;i++) {
+        cpu = tmc_cpus_find_nth_cpu(cpus, i);
+        if (cpu < 0 || cpu >= CPU_SETSIZE || !groups[cpu].open
+                || read_group(cpu, &groups[cpu].last) != 0) {
+            return -1;
+        }
+    }
+    return 0;
+}
+
+/*
+ * Opens and enables the event group of a cpu. The first event that can be
+ * opened leads the group.
+ * Returns 0 on success, -1 if no event can be counted on the cpu.
+ */
+static int open_group(int cpu) {
+    struct cpu_group_struct *group = &groups[cpu];
+    struct perf_event_attr attr;
+    int leader = -1;
+    int num_open = 0;
+
+    for (int i=0;i<NUM_EVENTS;i++) {
+        memset(&attr, 0, sizeof(attr));
+        attr.size = sizeof(attr);
+        attr.type = events[i].type;
+        attr.config = events[i].config;
+        attr.read_format = PERF_FORMAT_GROUP | PERF_FORMAT_TOTAL_TIME_ENABLED
+                | PERF_FORMAT_TOTAL_TIME_RUNNING;
+        attr.disabled = leader == -1;
+        group->fds[i] = syscall(SYS_perf_event_open, &attr, -1, cpu, leader,
+                PERF_FLAG_FD_CLOEXEC);
+        group->slots[i] = group->fds[i] >= 0 ? num_open++ : -1;
+        if (leader == -1) {
+            leader = group->fds[i];
+        }
+    }
+    if (leader == -1) {
+        return -1;
+    }
+    if (ioctl(leader, PERF_EVENT_IOC_ENABLE, PERF_IOC_FLAG_GROUP) != 0) {
+        for (int i=0;i<NUM_EVENTS;i++) {
+            if (group->fds[i] >= 0) {
+                close(group->fds[i]);
+            }
+        }
+        return -1;
+    }
+    group->open = 1;
+    return 0;
+}
+
+/*
+ * Reads all counters of the group of a cpu at once.
+ * Returns 0 on success, otherwise -1.
+ */
+static int read_group(int cpu, struct group_read_struct *values) {
+    struct cpu_group_struct *group = &groups[cpu];
+    ssize_t length;
+
+    // The leader is the first open event
+    for (int i=0;i<NUM_EVENTS;i++) {
+        if (group->slots[i] == 0) {
+            memset(values, 0, sizeof(*values));
+            length = read(group->fds[i], values, sizeof(*values));
+            return length >= (ssize_t) (3 * sizeof(uint64_t)) ? 0 : -1;
+        }
+    }
+    return -1;
+}
@@ -5,423 +5,255 @@
 
 #include <stdio.h>
 #include <stdlib.h>
+#include <stdint.h>
 #include "pid_table.h"
 
+// A process ID of 0 marks an empty slot:
+#define EMPTY_PID 0
+
 /* Each table entry is represented by an entry_struct. This data type records a
- * process ID and the number of the tile allocated to the process. */
+ * process ID and the number of its process record. */
 struct entry_struct
 {
 	pid_t pid;
-	unsigned int cpu;
-	int class;
-};
-
-/* Each index is represented by an index_struct. This data type holds the
- * vector of data buckets, the number of available buckets and a count of the
- * number of entries stored at the index. */
-struct index_struct
-{
-	size_t entry_count;
-	size_t bucket_count;
-	struct entry_struct *buckets;
+	int record;
 };
 
 /* A pid_table instance is represented by the table_struct. This data type
- * contains the hash index vector and the size of the index. It also the
- * minimum number of buckets as specified on table creation. */
+ * contains the slot array, its size (always a power of two) and the number of
+ * entries stored. It also holds the minimum size as specified on table
+ * creation. */
 struct table_struct
 {
-	size_t index_size;
-	size_t min_buckets;
-	struct index_struct *index;
+	size_t slot_count;
+	size_t entry_count;
+	size_t min_slots;
+	struct entry_struct *slots;
 };
 
 // Function declarations, see below:
-static inline int hash_value(pid_table table, pid_t pid);
-static int insert_entry(pid_table table, pid_t pid, unsigned int cpu, int class);
-static int remove_entry(pid_table table, pid_t pid);
-static int grow_bucket_vector(pid_table table, int table_index);
-static int shrink_bucket_vector(pid_table table, int table_index);
+static inline size_t hash_value(pid_table table, pid_t pid);
+static inline size_t probe_distance(pid_table table, size_t slot);
+static struct entry_struct *find_entry(pid_table table, pid_t pid);
+static void insert_entry(pid_table table, struct entry_struct *entry);
+static int resize_table(pid_table table, size_t new_slot_count);
 
 // Create a new table:
 pid_table create_pid_table(size_t index_size, size_t bucket_count)
 {
-	int table_index;
 	struct table_struct *new_table;
-	struct index_struct *new_index;
-	struct entry_struct *new_buckets;
+	size_t slot_count;
 
 	if (index_size == 0 || bucket_count == 0)
 	{
 		return NULL ;
 	}
+	// Round the initial size up to a power of two:
+	slot_count = 1;
+	while (slot_count < index_size * bucket_count)
+	{
+		slot_count *= 2;
+	}
 	// Allocate table, return on error:
 	new_table = malloc(sizeof(struct table_struct));
 	if (new_table == NULL )
 	{
 		return NULL ;
 	}
-	// Allocate hash index, return on error:
-	new_index = malloc(index_size * sizeof(struct index_struct));
-	if (new_index == NULL )
+	// Allocate slots, all empty (pid 0):
+	new_table->slots = calloc(slot_count, sizeof(struct entry_struct));
+	if (new_table->slots == NULL )
 	{
+		free(new_table);
 		return NULL ;
 	}
-	// Initialize table and index, allocate data buckets. Return on error:
-	new_table->index_size = index_size;
-	new_table->min_buckets = bucket_count;
-	new_table->index = new_index;
-	for (table_index = 0; table_index < index_size; table_index++)
-	{
-		new_table->index[table_index].bucket_count = bucket_count;
-		new_table->index[table_index].entry_count = 0;
-		new_buckets = malloc(bucket_count * sizeof(struct entry_struct));
-		if (new_buckets == NULL )
-		{
-			return NULL ;
-		}
-		new_table->index[table_index].buckets = new_buckets;
-	}
+	new_table->slot_count = slot_count;
+	new_table->entry_count = 0;
+	new_table->min_slots = slot_count;
 	return new_table;
 }
 
 // Deallocate table and all entries:
 void destroy_pid_table(pid_table table)
 {
-	int table_index;
-
 	if (table == NULL )
 	{
 		return;
 	}
-	// Deallocate data bucket vectors:
-	for (table_index = 0; table_index < table->index_size; table_index++)
-	{
-		free(table->index[table_index].buckets);
-	}
-	// Deallocate hash index:
-	free(table->index);
-	// Deallocate table:
+	free(table->slots);
 	free(table);
 }
 
 // Add new pid to table:
-int add_pid_to_pid_table(pid_table table, pid_t pid, unsigned int cpu, int class)
+int add_pid_to_pid_table(pid_table table, pid_t pid, int record)
 {
-	if (table == NULL )
+	struct entry_struct entry;
+
+	if (table == NULL || pid <= 0 || find_entry(table, pid) != NULL )
+	{
+		return -1;
+	}
+	// Grow table at 3/4 load:
+	if (4 * (table->entry_count + 1) > 3 * table->slot_count
+			&& resize_table(table, 2 * table->slot_count) != 0)
 	{
 		return -1;
 	}
 	// Add entry to table:
-	return insert_entry(table, pid, cpu, class);
+	entry.pid = pid;
+	entry.record = record;
+	insert_entry(table, &entry);
+	table->entry_count++;
+	return 0;
 }
 
 // Remove pid from table:
 int remove_pid_from_pid_table(pid_table table, pid_t pid)
 {
-	if (table == NULL )
+	struct entry_struct *entry;
+	size_t slot, next_slot, mask;
+	int record;
+
+	if (table == NULL || (entry = find_entry(table, pid)) == NULL )
 	{
 		return -1;
 	}
-	// Remove entry from table:
-	return remove_entry(table, pid);
-}
-
-//Get tile number associated with specified pid:
-int get_cpu(pid_table table, pid_t pid)
-{
-	int table_index, bucket_index, low_limit, high_limit;
-
-	if (table == NULL )
+	record = entry->record;
+	// Shift following entries back until an empty slot or an entry in its
+	// home slot is reached:
+	mask = table->slot_count - 1;
+	slot = entry - table->slots;
+	next_slot = (slot + 1) & mask;
+	while (table->slots[next_slot].pid != EMPTY_PID
+			&& probe_distance(table, next_slot) != 0)
 	{
-		return -1;
+		table->slots[slot] = table->slots[next_slot];
+		slot = next_slot;
+		next_slot = (slot + 1) & mask;
 	}
-	// Get table index:
-	table_index = hash_value(table, pid);
-	// Find bucket index for entry (binary search):
-	low_limit = 0;
-	high_limit = ((int) table->index[table_index].entry_count) - 1;
-	while (low_limit <= high_limit)
+	table->slots[slot].pid = EMPTY_PID;
+	table->entry_count--;
+	// Shrink table below 1/8 load, down to the initial size. A failed shrink
+	// leaves the table as it is:
+	if (table->slot_count > table->min_slots
+			&& 8 * table->entry_count < table->slot_count)
 	{
-		// Calculate next index to test:
-		bucket_index = (low_limit + high_limit) / 2;
-		if (table->index[table_index].buckets[bucket_index].pid < pid)
-		{
-			// Adjust lower bound when current entry is smaller:
-			low_limit = bucket_index + 1;
-		}
-		else if (table->index[table_index].buckets[bucket_index].pid > pid)
-		{
-			// Adjust higher bound when current entry is bigger:
-			high_limit = bucket_index - 1;
-		}
-		else
-		{
-			// Return when a matching entry is found:
-			return table->index[table_index].buckets[bucket_index].cpu;
-		}
+		resize_table(table, table->slot_count / 2);
 	}
-	// No matching entry found, indicate error:
-	return -1;
+	return record;
 }
 
-// Set tile number for specified pid:
-int set_cpu(pid_table table, pid_t pid, unsigned int cpu)
+// Get record number associated with specified pid:
+int get_record_number(pid_table table, pid_t pid)
 {
-	int table_index, bucket_index, low_limit, high_limit;
+	struct entry_struct *entry;
 
-	if (table == NULL )
+	if (table == NULL || (entry = find_entry(table, pid)) == NULL )
 	{
 		return -1;
 	}
-	// Get table index:
-	table_index = hash_value(table, pid);
-	// Find bucket index for entry (binary search):
-	low_limit = 0;
-	high_limit = ((int) table->index[table_index].entry_count) - 1;
-	while (low_limit <= high_limit)
-	{
-		// Calculate next index to test:
-		bucket_index = (low_limit + high_limit) / 2;
-		if (table->index[table_index].buckets[bucket_index].pid < pid)
-		{
-			// Adjust lower bound when current entry is smaller:
-			low_limit = bucket_index + 1;
-		}
-		else if (table->index[table_index].buckets[bucket_index].pid > pid)
-		{
-			// Adjust higher bound when current entry is bigger:
-			high_limit = bucket_index - 1;
-		}
-		else
-		{
-			// Return when a matching entry is found:
-			table->index[table_index].buckets[bucket_index].cpu = cpu;
-			return 0;
-		}
-	}
-	// No matching entry found, indicate error:
-	return -1;
+	return entry->record;
 }
 
-/* Returns the hash value for the specified process ID. This value is simply
- * calculated as the modulo of the process ID and the table index size. */
-static inline int hash_value(pid_table table, pid_t pid)
+/* Returns the home slot of the specified process ID. The process ID is mixed
+ * with the 32-bit finalizer of MurmurHash3, so that every bit of the pid
+ * affects the low bits used as slot number. */
+static inline size_t hash_value(pid_table table, pid_t pid)
 {
-	return pid % table->index_size;
+	uint32_t h = (uint32_t) pid;
+
+	h ^= h >> 16;
+	h *= 0x85ebca6b;
+	h ^= h >> 13;
+	h *= 0xc2b2ae35;
+	h ^= h >> 16;
+	return h & (table->slot_count - 1);
 }
 
-/* Inserts a new entry to table. Entries inserted are kept sorted according to
- * process ID. This allows fast binary searching of the data buckets. */
-static int insert_entry(pid_table table, pid_t pid, unsigned int cpu, int class)
+/* Returns how far the entry in the specified (non-empty) slot is from its
+ * home slot. */
+static inline size_t probe_distance(pid_table table, size_t slot)
 {
-	int table_index, bucket_index, shift_index, low_limit, high_limit;
-
-	// Get table index:
-	table_index = hash_value(table, pid);
-	// Find bucket index for new entry (binary search):
-	bucket_index = 0;
-	low_limit = 0;
-	high_limit = ((int) table->index[table_index].entry_count) - 1;
-	while (low_limit <= high_limit)
-	{
-		// Calculate next index to test:
-		bucket_index = (low_limit + high_limit) / 2;
-		if (table->index[table_index].buckets[bucket_index].pid < pid)
-		{
-			// Move lower bound when existing entry is smaller:
-			low_limit = bucket_index + 1;
-		}
-		else if (table->index[table_index].buckets[bucket_index].pid > pid)
-		{
-			// Move upper bound when existing entry is bigger:
-			high_limit = bucket_index - 1;
-		}
-		else
-		{
-			// Break if existing entry is equal (should not happen...):
-			break;
-		}
-	}
-	// If bucket vector is not empty, index may need to be adjusted:
-	if (table->index[table_index].entry_count != 0
-			&& table->index[table_index].buckets[bucket_index].pid < pid)
-	{
-		bucket_index++;
-	}
-	// Grow bucket vector to ensure space:
-	if (grow_bucket_vector(table, table_index) != 0)
-	{
-		return -1;
-	}
-	// Shift entries upwards if not inserting on last index in bucket vector:
-	if (bucket_index < table->index[table_index].entry_count)
-	{
-		shift_index = table->index[table_index].entry_count;
-		while (shift_index > bucket_index)
-		{
-			table->index[table_index].buckets[shift_index] =
-					table->index[table_index].buckets[shift_index - 1];
-			shift_index--;
-		}
-	}
-	// Insert new entry:
-	table->index[table_index].entry_count++;
-	table->index[table_index].buckets[bucket_index].pid = pid;
-	table->index[table_index].buckets[bucket_index].cpu = cpu;
-	table->index[table_index].buckets[bucket_index].class = class;
-	return 0;
+	return (slot - hash_value(table, table->slots[slot].pid))
+			& (table->slot_count - 1);
 }
 
-/* Removes an entry with a matching process ID (only one such entry should ever
- * exist). Any entries following the removed entry are shifted one step in the
- * bucket vector to eliminate gaps. */
-static int remove_entry(pid_table table, pid_t pid)
+/* Returns a pointer to the entry with the specified process ID, or NULL if
+ * there is no such entry. The pointer is only valid until the table is
+ * modified. The search stops at an empty slot, or at an entry closer to its
+ * home slot than the searched entry would be. */
+static struct entry_struct *find_entry(pid_table table, pid_t pid)
 {
-	int table_index, bucket_index, shift_index, low_limit, high_limit;
+	size_t slot, distance, mask;
 
-	// Get table index:
-	table_index = hash_value(table, pid);
-	// Find entry bucket index (binary search):
-	low_limit = 0;
-	high_limit = ((int) table->index[table_index].entry_count) - 1;
-	while (low_limit <= high_limit)
+	mask = table->slot_count - 1;
+	slot = hash_value(table, pid);
+	for (distance = 0; table->slots[slot].pid != EMPTY_PID; distance++)
 	{
-		// Calculate next index to test:
-		bucket_index = (low_limit + high_limit) / 2;
-		if (table->index[table_index].buckets[bucket_index].pid < pid)
-		{
-			// Adjust lower bound when current entry is smaller:
-			low_limit = bucket_index + 1;
-		}
-		else if (table->index[table_index].buckets[bucket_index].pid > pid)
+		if (table->slots[slot].pid == pid)
 		{
-			// Adjust higher bound when current entry is bigger:
-			high_limit = bucket_index - 1;
+			return &table->slots[slot];
 		}
-		else
+		if (probe_distance(table, slot) < distance)
 		{
-			// Break when a matching entry is found:
 			break;
 		}
+		slot = (slot + 1) & mask;
 	}
-	// Return with error if no matching entry found:
-	if (low_limit > high_limit)
-	{
-		return -1;
-	}
-	// Remove found entry:
-	// If not last entry in bucket vector, shift subsequent entries:
-	if (bucket_index != table->index[table_index].entry_count - 1)
-	{
-		shift_index = bucket_index;
-		while (shift_index < table->index[table_index].entry_count - 1)
-		{
-			table->index[table_index].buckets[shift_index] =
-					table->index[table_index].buckets[shift_index + 1];
-			shift_index++;
-		}
-	}
-	table->index[table_index].entry_count--;
-	// Shrink bucket vector and return:
-	return shrink_bucket_vector(table, table_index);
-}
-
-/* Doubles the size of the bucket vector at the specified index if all buckets
- * are full. */
-static int grow_bucket_vector(struct table_struct *table, int table_index)
-{
-	size_t new_bucket_count;
-	struct entry_struct *new_buckets;
-
-	// Check if bucket vector should be grown (full), otherwise return:
-	if (table->index[table_index].entry_count
-			< table->index[table_index].bucket_count)
-	{
-		return 0;
-	}
-	// Double bucket count:
-	new_bucket_count = 2 * table->index[table_index].bucket_count;
-	// Reallocate bucket vector:
-	new_buckets = realloc(table->index[table_index].buckets,
-			new_bucket_count * sizeof(struct entry_struct));
-	if (new_buckets == NULL )
-	{
-		return -1;
-	}
-	table->index[table_index].bucket_count = new_bucket_count;
-	table->index[table_index].buckets = new_buckets;
-	return 0;
+	// No matching entry found:
+	return NULL ;
 }
 
-/* Shrinks (halves) the bucket vector at the specified index until it is at
- * least 25% full. */
-static int shrink_bucket_vector(pid_table table, int table_index)
+/* Inserts an entry that is not in the table. There must be at least one empty
+ * slot. Whenever the entry being placed is further from home than the entry
+ * in a slot, the two swap places and the displaced entry is placed next. */
+static void insert_entry(pid_table table, struct entry_struct *entry)
 {
-	size_t new_bucket_count;
-	struct entry_struct *new_buckets;
+	struct entry_struct carried, swap;
+	size_t slot, distance, slot_distance, mask;
 
-	// Check if bucket vector size should be shrunk, otherwise return:
-	if (table->index[table_index].bucket_count <= table->min_buckets
-			|| table->index[table_index].entry_count
-					>= (table->index[table_index].bucket_count / 4))
-	{
-		return 0;
-	}
-	// Calculated new bucket count:
-	new_bucket_count = table->index[table_index].bucket_count;
-	do
-	{
-		new_bucket_count = new_bucket_count / 2;
-	} while (new_bucket_count > table->min_buckets
-			&& (new_bucket_count / 4) > table->index[table_index].entry_count);
-	// Reallocate bucket vector:
-	new_buckets = realloc(table->index[table_index].buckets,
-			new_bucket_count * sizeof(struct entry_struct));
-	if (new_buckets == NULL )
+	mask = table->slot_count - 1;
+	carried = *entry;
+	slot = hash_value(table, carried.pid);
+	distance = 0;
+	while (table->slots[slot].pid != EMPTY_PID)
 	{
-		return -1;
+		slot_distance = probe_distance(table, slot);
+		if (slot_distance < distance)
+		{
+			swap = table->slots[slot];
+			table->slots[slot] = carried;
+			carried = swap;
+			distance = slot_distance;
+		}
+		slot = (slot + 1) & mask;
+		distance++;
 	}
-	table->index[table_index].bucket_count = new_bucket_count;
-	table->index[table_index].buckets = new_buckets;
-	return 0;
+	table->slots[slot] = carried;
 }
 
-//Get class number associated with specified pid:
-// Copy-paste of get_cpu
-int get_class_number(pid_table table, pid_t pid)
+/* Moves all entries to a new slot array of the specified size. */
+static int resize_table(pid_table table, size_t new_slot_count)
 {
-	int table_index, bucket_index, low_limit, high_limit;
+	struct entry_struct *old_slots, *new_slots;
+	size_t old_slot_count, slot;
 
-	if (table == NULL )
+	new_slots = calloc(new_slot_count, sizeof(struct entry_struct));
+	if (new_slots == NULL )
 	{
 		return -1;
 	}
-	// Get table index:
-	table_index = hash_value(table, pid);
-	// Find bucket index for entry (binary search):
-	low_limit = 0;
-	high_limit = ((int) table->index[table_index].entry_count) - 1;
-	while (low_limit <= high_limit)
+	old_slots = table->slots;
+	old_slot_count = table->slot_count;
+	table->slots = new_slots;
+	table->slot_count = new_slot_count;
+	for (slot = 0; slot < old_slot_count; slot++)
 	{
-		// Calculate next index to test:
-		bucket_index = (low_limit + high_limit) / 2;
-		if (table->index[table_index].buckets[bucket_index].pid < pid)
-		{
-			// Adjust lower bound when current entry is smaller:
-			low_limit = bucket_index + 1;
-		}
-		else if (table->index[table_index].buckets[bucket_index].pid > pid)
+		if (old_slots[slot].pid != EMPTY_PID)
 		{
-			// Adjust higher bound when current entry is bigger:
-			high_limit = bucket_index - 1;
-		}
-		else
-		{
-			// Return when a matching entry is found:
-			return table->index[table_index].buckets[bucket_index].class;
+			insert_entry(table, &old_slots[slot]);
 		}
 	}
-	// No matching entry found, indicate error:
-	return -1;
+	free(old_slots);
+	return 0;
 }
@@ -1,14 +1,17 @@
 /* pid_table.h
  *
- * A hash table module used to record process-to-tile (CPU core) allocation.
- * The table is indexed by a simple value calculated from the process ID modulo
- * the size of the hash index.
- * To improve the runtime execution performance, the data buckets on each index
- * are implemented with a dynamically growing vector. When creating a table, it
- * is therefore important to consider the initial size of both the hash index
- * and the data bucket vectors. These values should be properly adjusted to
- * ensure that the table will fit the expected number of elements in an
- * effective manner.
+ * A hash table module used to find the record of a process (see proc_table.h)
+ * by its process ID. Each entry maps a process ID to a record number.
+ * The table is a single flat array of entries with open addressing and
+ * robin-hood probing: an entry that is further from its home slot takes the
+ * place of one that is closer to its own. This keeps probe sequences short
+ * even at high load, and lets a lookup stop as soon as it reaches an entry
+ * closer to home than the one searched for. Removal shifts the following
+ * entries back one slot, so no tombstones are left behind.
+ * Process IDs are mixed with a full-avalanche hash, so consecutive pids are
+ * spread over the table. The table doubles when it is 3/4 full and halves
+ * when it is less than 1/8 full, but never below its initial size. The
+ * initial size should fit the expected number of live processes.
  */
 
 #ifndef _PID_TABLE_H
@@ -22,8 +25,8 @@ struct table_struct;
 /* Typedef for a user handle to a table instance (table pointer). */
 typedef struct table_struct *pid_table;
 
-/* Allocates a new table with the specified sizes for the hash index and the
- * data bucket vectors.
+/* Allocates a new table of index_size * bucket_count slots, rounded up to a
+ * power of two. It first grows when 3/4 of the slots are in use.
  * On success a handle to the table is returned, otherwise NULL. */
 pid_table create_pid_table(size_t index_size, size_t bucket_count);
 
@@ -31,24 +34,17 @@ pid_table create_pid_table(size_t index_size, size_t bucket_count);
  * are also freed during the operation. */
 void destroy_pid_table(pid_table table);
 
-/* Adds a new entry to the table with the specified process ID and allocated
- * tile. On success 0 is returned, otherwise -1. */
-int add_pid_to_pid_table(pid_table table, pid_t pid, unsigned int cpu, int class);
+/* Adds a new entry to the table with the specified process ID (which must be
+ * positive) and record number. On success 0 is returned, otherwise -1, also
+ * if the process ID is already in the table. */
+int add_pid_to_pid_table(pid_table table, pid_t pid, int record);
 
-/* Removes the entry with the specified process ID from the table. Returns 0 on
- * success, otherwise -1. */
+/* Removes the entry with the specified process ID from the table. Returns the
+ * record number of the removed entry on success, otherwise -1. */
 int remove_pid_from_pid_table(pid_table table, pid_t pid);
 
-/* Tries to find an entry with the specified process ID and return the number
- * of the tile allocated to the process. On success the tile number is returned,
- * otherwise -1. */
-int get_cpu(pid_table table, pid_t pid);
-
-/* Sets the tile number for the specified process ID to the specified value.
- * On success 0 is returned, otherwise -1. */
-int set_cpu(pid_table table, pid_t pid, unsigned int cpu);
-
-// Returns the class of a pid. Returns -1 if class is undefined for pid.
-int get_class_number(pid_table table, pid_t pid);
+/* Tries to find an entry with the specified process ID. On success the record
+ * number of the entry is returned, otherwise -1. */
+int get_record_number(pid_table table, pid_t pid);
 
 #endif /* _PID_TABLE_H */
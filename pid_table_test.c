@@ -8,12 +8,11 @@
 static const int index_size = 100;
 static const int bucket_count = 10;
 static const int num_entry = 100000;
-static const int num_cpu = 64;
 
 // Performs a test of the pid_table module:
 int main(int argc, char *argv[])
 {
-	int n, pid, cpu, new_cpu;
+	int n, pid;
 	pid_t pids[num_entry];
 	pid_table table;
 
@@ -32,21 +31,21 @@ int main(int argc, char *argv[])
 	printf("adding %i entries\n", num_entry);
 	for (n = 0; n < num_entry; n++)
 	{
-		pid = rand();
+		// Unique, positive pids in random steps:
+		pid = n * 8 + 1 + rand() % 8;
 		pids[n] = pid;
-		cpu = rand() % num_cpu;
-		if (add_pid_to_pid_table(table, pid, cpu) != 0)
+		if (add_pid_to_pid_table(table, pid, n) != 0
+				|| add_pid_to_pid_table(table, pid, n) != -1)
 		{
 			printf("failed!\n");
 			return 1;
 		}
 	}
 	printf("OK!\n");
-	printf("switching all cpus\n");
+	printf("finding all entries\n");
 	for (n = 0; n < num_entry; n++)
 	{
-		new_cpu = rand() % 64;
-		if (set_cpu(table, pids[n], new_cpu) != 0)
+		if (get_record_number(table, pids[n]) != n)
 		{
 			printf("failed!\n");
 			return 1;
@@ -57,7 +56,8 @@ int main(int argc, char *argv[])
 	printf("removing each entry\n");
 	for (n = 0; n < num_entry; n++)
 	{
-		if (remove_pid_from_pid_table(table, pids[n]) != 0)
+		if (remove_pid_from_pid_table(table, pids[n]) != n
+				|| get_record_number(table, pids[n]) != -1)
 		{
 			printf("failed!\n");
 			return 1;
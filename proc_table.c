@@ -3,6 +3,8 @@
  * */
 
 #include <stdlib.h>
+#include <string.h>
+#include <float.h>
 #include "pid_table.h"
 #include "tile_table.h"
 #include "proc_table.h"
@@ -11,6 +13,18 @@
 #define START_PIDS_PER_TILE 32
 #define START_PIDS_PER_INDEX 32
 #define PID_TABLE_INDEX_SIZE 64
+#define START_RECORDS 64
+
+static int new_record(proc_table table);
+static void free_record(proc_table table, int record);
+static void add_load(proc_table table, proc_record rec);
+static void remove_load(proc_table table, proc_record rec);
+static void update_tile(proc_table table, int tile_num);
+static void update_contention(proc_table table);
+static inline void write_begin(volatile unsigned int *seq);
+static inline void write_end(volatile unsigned int *seq);
+static inline unsigned int read_begin(volatile unsigned int *seq);
+static inline int read_retry(volatile unsigned int *seq, unsigned int start);
 
 proc_table create_proc_table(size_t num_tiles) {
 	proc_table table;
@@ -24,13 +38,66 @@ proc_table create_proc_table(size_t num_tiles) {
     if ((table->tile_table = create_tile_table(num_tiles, START_PIDS_PER_TILE)) == NULL) {
         return NULL;
     }
+    if ((table->records = malloc(sizeof(struct proc_record_struct)*START_RECORDS)) == NULL) {
+        return NULL;
+    }
+    // All records are unused, chained through their slots
+    for (int i=0;i<START_RECORDS;i++) {
+        table->records[i].slot = i + 1 < START_RECORDS ? i + 1 : -1;
+    }
+    table->max_records = START_RECORDS;
+    table->free_record = 0;
     if ((table->miss_counters = malloc(sizeof(int)*num_tiles)) == NULL) {
         return NULL;
     }
+    if ((table->reserved = malloc(sizeof(int)*num_tiles)) == NULL) {
+        return NULL;
+    }
+    if ((table->reserved_value = malloc(sizeof(int)*num_tiles)) == NULL) {
+        return NULL;
+    }
+    if (posix_memalign((void **) &table->load, CACHE_LINE_SIZE,
+                sizeof(struct tile_load_struct)*num_tiles) != 0
+            || posix_memalign((void **) &table->samples, CACHE_LINE_SIZE,
+                sizeof(struct tile_sample_struct)*num_tiles) != 0) {
+        return NULL;
+    }
+    if ((table->applied = calloc(num_tiles, sizeof(unsigned int))) == NULL) {
+        return NULL;
+    }
+    if ((table->tile_cpus = malloc(sizeof(int)*num_tiles)) == NULL) {
+        return NULL;
+    }
+    if ((table->contention = malloc(sizeof(float)*num_tiles)) == NULL) {
+        return NULL;
+    }
+    memset(table->load, 0, sizeof(struct tile_load_struct)*num_tiles);
+    memset(table->samples, 0, sizeof(struct tile_sample_struct)*num_tiles);
+    if (pthread_mutex_init(&table->lock, NULL) != 0) {
+        return NULL;
+    }
+    if ((table->by_misses = create_tile_heap(num_tiles)) == NULL
+            || (table->by_classes = create_tile_heap(num_tiles)) == NULL
+            || (table->by_occupancy = create_tile_heap(num_tiles)) == NULL) {
+        return NULL;
+    }
+    if ((table->empty_tiles = calloc((num_tiles + 63) / 64, sizeof(uint64_t))) == NULL) {
+        return NULL;
+    }
     table->num_tiles = num_tiles;
     for (int i=0;i<num_tiles;i++) {
+        table->empty_tiles[i / 64] |= 1ULL << (i % 64);
         table->miss_counters[i] = 0;
+        table->contention[i] = 0;
+        table->reserved[i] = 0;
+        table->reserved_value[i] = 0;
+        table->tile_cpus[i] = i;
     }
+    table->online_tiles = num_tiles;
+    table->topo = NULL;
+    table->job_metrics = 0;
+    table->max_pids_per_tile = 0;
+    table->max_class_value = 0;
     table->total_miss_rate = 0;
     table->avg_miss_rate = 0.0;
 	return table;
@@ -39,84 +106,515 @@ proc_table create_proc_table(size_t num_tiles) {
 void destroy_proc_table(proc_table table) {
     destroy_pid_table(table->pid_table);
     destroy_tile_table(table->tile_table);
+    free(table->records);
+    free(table->miss_counters);
+    free(table->reserved);
+    free(table->reserved_value);
+    free(table->load);
+    free(table->samples);
+    free(table->applied);
+    free(table->tile_cpus);
+    free(table->contention);
+    pthread_mutex_destroy(&table->lock);
+    destroy_tile_heap(table->by_misses);
+    destroy_tile_heap(table->by_classes);
+    destroy_tile_heap(table->by_occupancy);
+    free(table->empty_tiles);
     free(table);
 }
 
 int add_pid(proc_table table, pid_t pid, int tile_num, int class) {
-    if (add_pid_to_pid_table(table->pid_table, pid, tile_num, class) != 0) {
+    proc_record rec;
+    int record, slot;
+
+    pthread_mutex_lock(&table->lock);
+    if ((record = new_record(table)) < 0) {
+        pthread_mutex_unlock(&table->lock);
+        return -1;
+    }
+    if (add_pid_to_pid_table(table->pid_table, pid, record) != 0) {
+        free_record(table, record);
+        pthread_mutex_unlock(&table->lock);
         return -1;
     }
-    if (add_pid_to_tile_table(table->tile_table, pid, tile_num) != 0) {
+    if ((slot = add_record_to_tile_table(table->tile_table, record, tile_num)) < 0) {
+        remove_pid_from_pid_table(table->pid_table, pid);
+        free_record(table, record);
+        pthread_mutex_unlock(&table->lock);
         return -1;
     }
+    rec = &table->records[record];
+    rec->pid = pid;
+    rec->tile = tile_num;
+    rec->class = class;
+    rec->slot = slot;
+    rec->metric = 0;
+    rec->counters = NULL;
+    rec->info.seq = -1;
+    rec->info.arrival = 0;
+    rec->info.launch = 0;
+    rec->info.tiles_visited = 1;
+    add_load(table, rec);
+    pthread_mutex_unlock(&table->lock);
     return 0;
 }
 
 int remove_pid(proc_table table, pid_t pid) {
-    int cpu = get_cpu(table->pid_table, pid);
+    proc_record rec;
+    int record, moved;
 
-    if (remove_pid_from_pid_table(table->pid_table, pid) != 0) {
+    pthread_mutex_lock(&table->lock);
+    if ((record = remove_pid_from_pid_table(table->pid_table, pid)) < 0) {
+        pthread_mutex_unlock(&table->lock);
         return -1;
     }
-    if (remove_pid_from_tile_table(table->tile_table, pid, cpu) != 0) {
+    rec = &table->records[record];
+    if (remove_slot_from_tile_table(table->tile_table, rec->tile, rec->slot, &moved) != 0) {
+        pthread_mutex_unlock(&table->lock);
         return -1;
     }
+    if (moved >= 0) {
+        table->records[moved].slot = rec->slot;
+    }
+    remove_load(table, rec);
+    free_record(table, record);
+    pthread_mutex_unlock(&table->lock);
     return 0;
 }
 
+proc_record get_proc_record(proc_table table, pid_t pid) {
+    int record = get_record_number(table->pid_table, pid);
+
+    return record < 0 ? NULL : &table->records[record];
+}
+
 int move_pid_to_tile(proc_table table, pid_t pid, int new_tile_num) {
-    int old_cpu = get_cpu(table->pid_table, pid);
+    proc_record rec;
+    int old_tile, slot, moved;
 
-    // Fix pid_table
-    if (set_cpu(table->pid_table, pid, new_tile_num) != 0) {
+    pthread_mutex_lock(&table->lock);
+    if ((rec = get_proc_record(table, pid)) == NULL) {
+        pthread_mutex_unlock(&table->lock);
         return -1;
     }
-    // Fix tile_table
-    if (remove_pid_from_tile_table(table->tile_table, pid, old_cpu) != 0) {
-        return -1;
+    old_tile = rec->tile;
+    if (new_tile_num == old_tile) {
+        pthread_mutex_unlock(&table->lock);
+        return old_tile;
     }
-    if (add_pid_to_tile_table(table->tile_table, pid, new_tile_num) != 0) {
+    if ((slot = add_record_to_tile_table(table->tile_table, rec - table->records,
+            new_tile_num)) < 0) {
+        pthread_mutex_unlock(&table->lock);
         return -1;
     }
-    return 0;
+    remove_slot_from_tile_table(table->tile_table, old_tile, rec->slot, &moved);
+    if (moved >= 0) {
+        table->records[moved].slot = rec->slot;
+    }
+    remove_load(table, rec);
+    rec->tile = new_tile_num;
+    rec->slot = slot;
+    add_load(table, rec);
+    rec->info.tiles_visited++;
+    pthread_mutex_unlock(&table->lock);
+    return old_tile;
 }
 
 int get_pid_count(proc_table table, int tile_num) {
-    return get_pid_count_from_tile(table->tile_table, tile_num);
+    struct tile_load_struct load;
+
+    get_tile_load(table, tile_num, &load);
+    return load.pid_count;
+}
+
+void get_tile_load(proc_table table, int tile_num, struct tile_load_struct *load) {
+    struct tile_load_struct *tile_load = &table->load[tile_num];
+    unsigned int seq;
+
+    do {
+        seq = read_begin(&tile_load->seq);
+        load->pid_count = tile_load->pid_count;
+        load->class_value = tile_load->class_value;
+        load->metric_sum = tile_load->metric_sum;
+    } while (read_retry(&tile_load->seq, seq));
+    load->seq = seq;
 }
 
 int get_pid_vector(proc_table table, int tile_num, pid_t *array_of_pids, int num_pids) {
-    return get_pids(table->tile_table, tile_num, array_of_pids, num_pids);
+    int records[num_pids > 0 ? num_pids : 1];
+    int count;
+
+    pthread_mutex_lock(&table->lock);
+    if ((count = get_records(table->tile_table, tile_num, records, num_pids)) >= 0) {
+        for (int i=0;i<count;i++) {
+            array_of_pids[i] = table->records[records[i]].pid;
+        }
+    }
+    pthread_mutex_unlock(&table->lock);
+    return count < 0 ? -1 : count;
 }
 
 int get_tile_num(proc_table table, pid_t pid) {
-    return get_cpu(table->pid_table, pid);
+    proc_record rec;
+    int tile;
+
+    pthread_mutex_lock(&table->lock);
+    rec = get_proc_record(table, pid);
+    tile = rec == NULL ? -1 : rec->tile;
+    pthread_mutex_unlock(&table->lock);
+    return tile;
 }
 
 int get_class(proc_table table, pid_t pid) {
-	return get_class_number(table->pid_table, pid);
+    proc_record rec;
+    int class;
+
+    pthread_mutex_lock(&table->lock);
+    rec = get_proc_record(table, pid);
+    class = rec == NULL ? -1 : rec->class;
+    pthread_mutex_unlock(&table->lock);
+    return class;
+}
+
+int set_job_info(proc_table table, pid_t pid, struct job_info_struct *info) {
+    proc_record rec;
+
+    pthread_mutex_lock(&table->lock);
+    if ((rec = get_proc_record(table, pid)) == NULL) {
+        pthread_mutex_unlock(&table->lock);
+        return -1;
+    }
+    rec->info.seq = info->seq;
+    rec->info.arrival = info->arrival;
+    rec->info.launch = info->launch;
+    pthread_mutex_unlock(&table->lock);
+    return 0;
+}
+
+int get_job_info(proc_table table, pid_t pid, struct job_info_struct *info) {
+    proc_record rec;
+
+    pthread_mutex_lock(&table->lock);
+    if ((rec = get_proc_record(table, pid)) == NULL) {
+        pthread_mutex_unlock(&table->lock);
+        return -1;
+    }
+    *info = rec->info;
+    pthread_mutex_unlock(&table->lock);
+    return 0;
+}
+
+void reserve_tile(proc_table table, int tile_num, int class) {
+    pthread_mutex_lock(&table->lock);
+    table->reserved[tile_num]++;
+    table->reserved_value[tile_num] += class;
+    update_tile(table, tile_num);
+    pthread_mutex_unlock(&table->lock);
+}
+
+void release_tile(proc_table table, int tile_num, int class) {
+    pthread_mutex_lock(&table->lock);
+    table->reserved[tile_num]--;
+    table->reserved_value[tile_num] -= class;
+    update_tile(table, tile_num);
+    pthread_mutex_unlock(&table->lock);
+}
+
+int get_reserved_count(proc_table table, int tile_num) {
+    return table->reserved[tile_num];
+}
+
+void set_tile_limits(proc_table table, int max_pids, int max_class_value) {
+    table->max_pids_per_tile = max_pids;
+    table->max_class_value = max_class_value;
+}
+
+int tile_has_room(proc_table table, int tile_num, int class) {
+    int pid_count = get_pid_count(table, tile_num) + table->reserved[tile_num];
+
+    if (table->tile_cpus[tile_num] < 0) {
+        return 0;
+    }
+    if (pid_count == 0) {
+        return 1;
+    }
+    if (table->max_pids_per_tile > 0 && pid_count >= table->max_pids_per_tile) {
+        return 0;
+    }
+    if (table->max_class_value > 0
+            && get_total_value_of_classes(table, tile_num)
+               + table->reserved_value[tile_num] + class > table->max_class_value) {
+        return 0;
+    }
+    return 1;
 }
 
 int get_total_value_of_classes(proc_table table, unsigned int cpu) {
-	int total_value = 0;
-	int pid_count = get_pid_count(table, cpu);
-	pid_t all_pids[pid_count];
+    struct tile_load_struct load;
 
-	get_pid_vector(table, cpu, all_pids, pid_count);
-	for (int i=0;i<pid_count;i++) {
-		total_value += get_class(table, all_pids[i]);
-	}
+    get_tile_load(table, cpu, &load);
+    return load.class_value;
+}
+
+int set_job_metric(proc_table table, pid_t pid, float metric) {
+    proc_record rec;
+    struct tile_load_struct *load;
+
+    pthread_mutex_lock(&table->lock);
+    if ((rec = get_proc_record(table, pid)) == NULL) {
+        pthread_mutex_unlock(&table->lock);
+        return -1;
+    }
+    load = &table->load[rec->tile];
+    write_begin(&load->seq);
+    load->metric_sum += metric - rec->metric;
+    write_end(&load->seq);
+    rec->metric = metric;
+    pthread_mutex_unlock(&table->lock);
+    return 0;
+}
 
-	return total_value;
+float get_tile_metric_sum(proc_table table, int tile_num) {
+    struct tile_load_struct load;
+
+    get_tile_load(table, tile_num, &load);
+    return load.metric_sum;
 }
 
 void modify_miss_count(proc_table table, int tile_num, float new_miss_rate) {
-	// Delete old miss rate from total
-    table->total_miss_rate = table->total_miss_rate - table->miss_counters[tile_num];
-    // Calculate average miss rate for tile_num
-    table->miss_counters[tile_num] = (table->miss_counters[tile_num] + new_miss_rate) / 2;
-    // Add new mis rate to total
-    table->total_miss_rate = table->total_miss_rate + table->miss_counters[tile_num];
+    struct tile_sample_struct *sample = &table->samples[tile_num];
+
+    write_begin(&sample->seq);
+    sample->miss_rate = new_miss_rate;
+    sample->count++;
+    write_end(&sample->seq);
+}
+
+int update_miss_counts(proc_table table) {
+    struct tile_sample_struct *sample;
+    float new_miss_rate;
+    unsigned int seq, count;
+    int updated = 0;
+
+    pthread_mutex_lock(&table->lock);
+    for (int i=0;i<table->num_tiles;i++) {
+        sample = &table->samples[i];
+        do {
+            seq = read_begin(&sample->seq);
+            new_miss_rate = sample->miss_rate;
+            count = sample->count;
+        } while (read_retry(&sample->seq, seq));
+        // Samples taken just before a tile went offline are dropped
+        if (count == table->applied[i] || table->tile_cpus[i] < 0) {
+            table->applied[i] = count;
+            continue;
+        }
+        table->applied[i] = count;
+        // Delete old miss rate from total
+        table->total_miss_rate = table->total_miss_rate - table->miss_counters[i];
+        // Calculate average miss rate for tile i
+        table->miss_counters[i] = (table->miss_counters[i] + new_miss_rate) / 2;
+        // Add new mis rate to total
+        table->total_miss_rate = table->total_miss_rate + table->miss_counters[i];
+        updated++;
+    }
+    if (updated > 0 || table->job_metrics) {
+        update_contention(table);
+    }
     // Calculate average miss rate among all tiles
-    table->avg_miss_rate = table->total_miss_rate / table->num_tiles;
+    table->avg_miss_rate = table->online_tiles > 0
+            ? table->total_miss_rate / table->online_tiles : 0;
+    pthread_mutex_unlock(&table->lock);
+    return updated;
+}
+
+void set_tile_cpu(proc_table table, int tile_num, int cpu) {
+    pthread_mutex_lock(&table->lock);
+    if ((table->tile_cpus[tile_num] < 0) != (cpu < 0)) {
+        table->online_tiles += cpu < 0 ? -1 : 1;
+        // Only online tiles count in the average miss rate
+        if (cpu < 0) {
+            table->total_miss_rate -= table->miss_counters[tile_num];
+        }
+        else {
+            table->total_miss_rate += table->miss_counters[tile_num];
+        }
+    }
+    *(volatile int *) &table->tile_cpus[tile_num] = cpu;
+    // The tile joins or leaves the domains of its cpus
+    update_contention(table);
+    update_tile(table, tile_num);
+    pthread_mutex_unlock(&table->lock);
+}
+
+int get_tile_cpu(proc_table table, int tile_num) {
+    return *(volatile int *) &table->tile_cpus[tile_num];
+}
+
+void set_topology(proc_table table, topology topo) {
+    pthread_mutex_lock(&table->lock);
+    table->topo = topo;
+    update_contention(table);
+    pthread_mutex_unlock(&table->lock);
+}
+
+void use_job_metrics(proc_table table, int enable) {
+    pthread_mutex_lock(&table->lock);
+    table->job_metrics = enable;
+    update_contention(table);
+    pthread_mutex_unlock(&table->lock);
+}
+
+int find_empty_tile(proc_table table) {
+    for (int i=0;i<(table->num_tiles + 63) / 64;i++) {
+        if (table->empty_tiles[i] != 0) {
+            return i * 64 + __builtin_ctzll(table->empty_tiles[i]);
+        }
+    }
+    return -1;
+}
+
+/*
+ * Takes a record from the free list, doubling the pool if it is empty.
+ * Returns the record number, or -1 if the pool can't grow.
+ */
+static int new_record(proc_table table) {
+    struct proc_record_struct *records;
+    int record;
+
+    if (table->free_record < 0) {
+        if ((records = realloc(table->records,
+                sizeof(struct proc_record_struct) * 2 * table->max_records)) == NULL) {
+            return -1;
+        }
+        for (int i=table->max_records;i<2*table->max_records;i++) {
+            records[i].slot = i + 1 < 2 * table->max_records ? i + 1 : -1;
+        }
+        table->free_record = table->max_records;
+        table->records = records;
+        table->max_records *= 2;
+    }
+    record = table->free_record;
+    table->free_record = table->records[record].slot;
+    return record;
+}
+
+/*
+ * Returns a record to the free list.
+ */
+static void free_record(proc_table table, int record) {
+    table->records[record].slot = table->free_record;
+    table->free_record = record;
+}
+
+/*
+ * Adds a process to the totals of its tile.
+ */
+static void add_load(proc_table table, proc_record rec) {
+    struct tile_load_struct *load = &table->load[rec->tile];
+
+    write_begin(&load->seq);
+    load->pid_count++;
+    load->class_value += rec->class;
+    load->metric_sum += rec->metric;
+    write_end(&load->seq);
+    update_tile(table, rec->tile);
+}
+
+/*
+ * Removes a process from the totals of its tile.
+ */
+static void remove_load(proc_table table, proc_record rec) {
+    struct tile_load_struct *load = &table->load[rec->tile];
+
+    write_begin(&load->seq);
+    load->pid_count--;
+    load->class_value -= rec->class;
+    load->metric_sum -= rec->metric;
+    write_end(&load->seq);
+    update_tile(table, rec->tile);
+}
+
+/*
+ * Updates the placement order and the empty bit of a tile after its processes
+ * or reservations have changed. Offline tiles are ordered last and are never
+ * empty.
+ */
+static void update_tile(proc_table table, int tile_num) {
+    int occupancy = table->load[tile_num].pid_count + table->reserved[tile_num];
+    uint64_t bit = 1ULL << (tile_num % 64);
+
+    if (table->tile_cpus[tile_num] < 0) {
+        set_tile_score(table->by_classes, tile_num, FLT_MAX);
+        set_tile_score(table->by_occupancy, tile_num, FLT_MAX);
+        table->empty_tiles[tile_num / 64] &= ~bit;
+        return;
+    }
+    set_tile_score(table->by_classes, tile_num, table->load[tile_num].class_value);
+    set_tile_score(table->by_occupancy, tile_num, occupancy);
+    if (occupancy == 0) {
+        table->empty_tiles[tile_num / 64] |= bit;
+    }
+    else {
+        table->empty_tiles[tile_num / 64] &= ~bit;
+    }
+}
+
+/*
+ * Recomputes the contention scores of all tiles from the miss counters, or
+ * the job metric sums, and orders the tiles by them. Offline tiles are
+ * ordered last.
+ */
+static void update_contention(proc_table table) {
+    float metric_sums[table->num_tiles];
+    float *values = table->miss_counters;
+
+    if (table->job_metrics) {
+        for (int i=0;i<table->num_tiles;i++) {
+            metric_sums[i] = table->load[i].metric_sum;
+        }
+        values = metric_sums;
+    }
+    if (table->topo != NULL) {
+        get_contention(table->topo, table->num_tiles, table->tile_cpus,
+                values, table->contention);
+    }
+    else {
+        memcpy(table->contention, values, sizeof(float) * table->num_tiles);
+    }
+    for (int i=0;i<table->num_tiles;i++) {
+        set_tile_score(table->by_misses, i,
+                table->tile_cpus[i] < 0 ? FLT_MAX : table->contention[i]);
+    }
+}
+
+/*
+ * Seqlock of per-tile state. A writer makes seq odd while it changes the
+ * state, a reader copies the state between read_begin() and read_retry() and
+ * retries if seq was odd or has changed. Writers of the same state must be
+ * serialised.
+ */
+static inline void write_begin(volatile unsigned int *seq) {
+    (*seq)++;
+    __sync_synchronize();
+}
+
+static inline void write_end(volatile unsigned int *seq) {
+    __sync_synchronize();
+    (*seq)++;
+}
+
+static inline unsigned int read_begin(volatile unsigned int *seq) {
+    unsigned int start;
+
+    while ((start = *seq) & 1) {
+        ;
+    }
+    __sync_synchronize();
+    return start;
+}
+
+static inline int read_retry(volatile unsigned int *seq, unsigned int start) {
+    __sync_synchronize();
+    return *seq != start;
 }
@@ -1,13 +1,88 @@
 /* proc_table.h
  *
+ * Combined interface to pid_table/tile_table.
+ *
+ * Every process has one record, kept in a pool indexed by record number. The
+ * pid table maps a process ID to its record number, the tile table holds the
+ * record numbers of the processes on each tile. A record stores its slot in
+ * the vector of its tile, so any operation on a process costs one lookup in
+ * the pid table and removal from a tile needs no search.
+ *
+ * The table may be used by several threads. Changes and the lookups of
+ * records and tile vectors are serialised by a lock. The per-tile totals and
+ * miss rate samples are each on a cache line of their own under a seqlock,
+ * so they can be read from any thread without the lock and without false
+ * sharing between tiles. Miss rates are sampled by other threads with
+ * modify_miss_count() and only applied to the miss counters and the placement
+ * order by update_miss_counts(), in the scheduler thread. The placement state
+ * (reservations, limits, heaps, empty tiles) is only used by that thread.
+ *
+ * Each tile is bound to a cpu, which can change while the scheduler runs. A
+ * tile without a cpu is offline: it never has room and is ordered last by the
+ * heaps, but its processes stay in the table until they are moved.
+ *
+ * With a topology (see topology.h) tiles are ordered by their contention
+ * score, which also counts the misses of tiles sharing a core, cache or node,
+ * instead of by their own miss counter.
+ *
+ * When jobs are counted on their own (see use_job_metrics()), the sum of the
+ * job metrics of a tile takes the place of its miss counter in the placement
+ * order. A job's metric moves with it when it is migrated.
  * */
 
 #ifndef _PROC_TABLE_H
 #define _PROC_TABLE_H
 
 #include <unistd.h>
+#include <stdint.h>
+#include <pthread.h>
 #include "tile_table.h"
 #include "pid_table.h"
+#include "tile_heap.h"
+#include "topology.h"
+
+/* Bookkeeping of a job kept alongside its process record, used for the
+ * completion record written when the job is reaped. */
+struct job_info_struct {
+    int seq;                // Position of the job in the workload
+    long long arrival;      // Arrival time (microseconds since workload start)
+    long long launch;       // Launch time (microseconds since workload start)
+    int tiles_visited;      // Number of tiles the job has run on
+};
+
+/* Record of a process on a tile. */
+struct proc_record_struct {
+    pid_t pid;
+    int tile;
+    int class;
+    int slot;               // Position in the vector of the tile, or the next
+                            // free record while the record is unused
+    float metric;           // Job metric summed per tile, 0 until set
+    struct job_counters_struct *counters;   // Counter session of the job,
+                                            // NULL if none (see perfcount.h)
+    struct job_info_struct info;
+};
+
+// Per-tile state is padded to this size so tiles never share a cache line
+#define CACHE_LINE_SIZE 64
+
+/* Totals of the processes on a tile, kept up to date by add_pid(),
+ * remove_pid(), move_pid_to_tile() and set_job_metric(). */
+struct tile_load_struct {
+    unsigned int seq;       // Seqlock, odd while the totals are changed
+    int pid_count;
+    int class_value;        // Sum of the classes
+    float metric_sum;       // Sum of the job metrics
+} __attribute__((aligned(CACHE_LINE_SIZE)));
+
+/* Latest miss rate sampled on a tile by modify_miss_count(). */
+struct tile_sample_struct {
+    unsigned int seq;       // Seqlock, odd while the sample is written
+    unsigned int count;     // Number of samples taken
+    float miss_rate;
+} __attribute__((aligned(CACHE_LINE_SIZE)));
+
+typedef struct proc_record_struct *proc_record;
 
 //struct proc_table_struct;
 struct proc_table_struct {
@@ -15,13 +90,40 @@ struct proc_table_struct {
     tile_table tile_table;
     pid_table pid_table;
 
+    struct proc_record_struct *records;
+    int max_records;
+    int free_record;        // First unused record, -1 if the pool is full
+    struct tile_load_struct *load;  // Running totals per tile
+    struct tile_sample_struct *samples; // Miss rates sampled per tile
+    unsigned int *applied;  // Sample count applied to the miss counters
+    pthread_mutex_t lock;   // Serialises changes and record lookups
+
     float total_miss_rate;
     float avg_miss_rate;
     float *miss_counters;
+    int *reserved;  // Processes placed on a tile but not yet started
+    int *reserved_value;    // Total class value of the reserved processes
+
+    int *tile_cpus;         // cpu of each tile, -1 if the tile is offline
+    int online_tiles;       // Tiles with a cpu
+    topology topo;          // Contention domains of the cpus, NULL if flat
+    float *contention;      // Contention score of each tile
+    int job_metrics;        // Score tiles by their job metrics
+
+    int max_pids_per_tile;  // Admission limits, 0 for no limit
+    int max_class_value;
+
+    // Tiles ordered for placement, kept up to date with the values above
+    tile_heap by_misses;    // contention
+    tile_heap by_classes;   // Total class value
+    tile_heap by_occupancy; // Processes, including reserved ones
+    uint64_t *empty_tiles;  // Bit set for tiles without processes or
+                            // reservations
 };
 
 typedef struct proc_table_struct *proc_table;
 
+// Creates a table for num_tiles tiles, bound to cpus 0 to num_tiles - 1.
 proc_table create_proc_table(size_t num_tiles);
 
 void destroy_proc_table(proc_table table);
@@ -30,18 +132,83 @@ int add_pid(proc_table table, pid_t pid, int tile_num, int class);
 
 int remove_pid(proc_table table, pid_t pid);
 
+// Returns the record of a process, or NULL if the pid is unknown. The record
+// stays valid until the next add_pid() or remove_pid(), so it must only be
+// used by the thread that changes the table.
+proc_record get_proc_record(proc_table table, pid_t pid);
+
+// Moves a process to a new tile, counting a visited tile if the tile changes.
+// Returns the previous tile number on success, otherwise -1.
 int move_pid_to_tile(proc_table table, pid_t pid, int new_tile_num);
 
 int get_pid_count(proc_table table, int tile_num);
 
+// Copies the totals of a tile, consistent with each other. Can be used from
+// any thread without taking the lock.
+void get_tile_load(proc_table table, int tile_num, struct tile_load_struct *load);
+
 int get_pid_vector(proc_table table, int tile_num, pid_t *array_of_pids, int num_pid);
 
 int get_tile_num(proc_table table, pid_t pid);
 
 int get_class(proc_table table, pid_t pid);
 
+// Job info (workload position, arrival and launch time, tiles visited) kept
+// for the completion record of a process. set_job_info() keeps tiles_visited.
+int set_job_info(proc_table table, pid_t pid, struct job_info_struct *info);
+
+int get_job_info(proc_table table, pid_t pid, struct job_info_struct *info);
+
+// Reserve a tile for a process that is about to be started. The reservation
+// is dropped with release_tile() once the pid is known (or launch failed).
+void reserve_tile(proc_table table, int tile_num, int class);
+
+void release_tile(proc_table table, int tile_num, int class);
+
+int get_reserved_count(proc_table table, int tile_num);
+
+// Set the maximum number of processes and the maximum total class value
+// allowed on a tile. A limit of 0 means no limit.
+void set_tile_limits(proc_table table, int max_pids, int max_class_value);
+
+// Returns 1 if a process of the given class may be placed on the tile without
+// exceeding the limits, otherwise 0. An empty tile always has room.
+int tile_has_room(proc_table table, int tile_num, int class);
+
 int get_total_value_of_classes(proc_table table, unsigned int cpu);
 
+// Sets the job metric of a process (for example its own miss rate), which is
+// added to the metric sum of its tile.
+int set_job_metric(proc_table table, pid_t pid, float metric);
+
+float get_tile_metric_sum(proc_table table, int tile_num);
+
+// Publishes a miss rate sampled on a tile. Can be used from any thread, as
+// long as each tile is sampled by one thread at a time.
 void modify_miss_count(proc_table table, int tile_num, float amount);
 
+// Applies the miss rates sampled since the last call to the miss counters,
+// their average and the placement order. Returns the number of tiles updated.
+int update_miss_counts(proc_table table);
+
+// Binds a tile to a cpu, or takes it offline if cpu is -1. Processes on a
+// tile taken offline are not moved.
+void set_tile_cpu(proc_table table, int tile_num, int cpu);
+
+// Returns the cpu of a tile, or -1 if it is offline. Can be used from any
+// thread.
+int get_tile_cpu(proc_table table, int tile_num);
+
+// Sets the topology the contention scores are computed with, or NULL to use
+// the miss counters alone. The table doesn't take over the topology.
+void set_topology(proc_table table, topology topo);
+
+// Scores tiles by the sum of their job metrics instead of by their miss
+// counters, or by the miss counters again if enable is 0.
+void use_job_metrics(proc_table table, int enable);
+
+// Returns the lowest numbered empty tile (see empty_tiles), or -1 if no tile
+// is empty.
+int find_empty_tile(proc_table table);
+
 #endif
@@ -3,10 +3,44 @@
 #include <stdio.h>
 #include <stdlib.h>
 #include <time.h>
+#include <pthread.h>
 #include "proc_table.h"
 
 static const int num_entry = 20;
 static const int num_cpu = 10;
+static const int num_churn = 200000;
+
+static volatile int churning;
+
+// Reads tile totals while the main thread changes them. All processes have
+// class 2, so a consistent copy has twice as much class value as processes:
+static void *read_loads(void *arg) {
+	proc_table table = arg;
+	struct tile_load_struct load;
+	long torn = 0;
+
+	while (churning) {
+		for (int cpu = 0; cpu < num_cpu; cpu++) {
+			get_tile_load(table, cpu, &load);
+			if (load.class_value != 2 * load.pid_count) {
+				torn++;
+			}
+		}
+	}
+	return (void *) torn;
+}
+
+// Samples miss rates while the main thread applies them:
+static void *sample_misses(void *arg) {
+	proc_table table = arg;
+
+	while (churning) {
+		for (int cpu = 0; cpu < num_cpu; cpu++) {
+			modify_miss_count(table, cpu, 0.5);
+		}
+	}
+	return NULL;
+}
 
 // Performs a test of the pid_table module:
 int main(void) {
@@ -27,10 +61,10 @@ int main(void) {
 	// Add entries:
 	printf("Adding %i entries\n", num_entry);
 	for (n = 0; n < num_entry; n++) {
-		pid = rand();
+		pid = n * 8 + 1 + rand() % 8;
 		pids[n] = pid;
 		cpu = rand() % num_cpu;
-		if (add_pid(table, pid, cpu, 0) != 0) {
+		if (add_pid(table, pid, cpu, n % 3) != 0) {
 			printf("failed!\n");
 			return 1;
 		}
@@ -64,7 +98,8 @@ int main(void) {
 	printf("Switching all cpus\n");
 	for (n = 0; n < num_entry; n++) {
 		new_cpu = rand() % num_cpu;
-		if (move_pid_to_tile(table, pids[n], new_cpu) != 0) {
+		if (move_pid_to_tile(table, pids[n], new_cpu) < 0
+				|| get_tile_num(table, pids[n]) != new_cpu) {
 			printf("failed!\n");
 			return 1;
 		}
@@ -79,15 +114,67 @@ int main(void) {
 	}
 	printf("All pids printed\n\n");
 
-	// Remove elements:
+	// Remove elements, every tile must only list its own pids and keep the
+	// total of their classes:
 	printf("removing each entry\n");
 	for (n = 0; n < num_entry; n++) {
-		if (remove_pid(table, pids[n]) != 0) {
+		if (remove_pid(table, pids[n]) != 0 || get_tile_num(table, pids[n]) != -1) {
 			printf("failed!\n");
 			return 1;
 		}
+		for (cpu = 0; cpu < num_cpu; cpu++) {
+			int pid_count = get_pid_count(table, cpu);
+			pid_t array[pid_count + 1];
+
+			int class_value = 0;
+
+			get_pid_vector(table, cpu, array, pid_count);
+			for (int i = 0; i < pid_count; i++) {
+				if (get_tile_num(table, array[i]) != cpu) {
+					printf("Pid %u listed on wrong tile %u\n", array[i], cpu);
+					return 1;
+				}
+				class_value += get_class(table, array[i]);
+			}
+			if (get_total_value_of_classes(table, cpu) != class_value) {
+				printf("Wrong class value on tile %u\n", cpu);
+				return 1;
+			}
+		}
+	}
+	printf("OK!\n");
+
+	// Add, move and remove processes while other threads read the totals and
+	// sample miss rates:
+	printf("Changing the table while reading it from other threads\n");
+	pthread_t reader, sampler;
+	void *torn;
+	churning = 1;
+	pthread_create(&reader, NULL, read_loads, table);
+	pthread_create(&sampler, NULL, sample_misses, table);
+	for (n = 0; n < num_churn; n++) {
+		pid = 1000 + n % num_entry;
+		if (n % num_entry == 0) {
+			update_miss_counts(table);
+		}
+		if (n / num_entry % 2 == 0) {
+			add_pid(table, pid, rand() % num_cpu, 2);
+		}
+		else {
+			move_pid_to_tile(table, pid, rand() % num_cpu);
+			remove_pid(table, pid);
+		}
+	}
+	churning = 0;
+	pthread_join(reader, &torn);
+	pthread_join(sampler, NULL);
+	update_miss_counts(table);
+	if (torn != NULL || table->avg_miss_rate <= 0) {
+		printf("failed!\n");
+		return 1;
 	}
 	printf("OK!\n");
+
 	printf("destroying table\n");
 	destroy_proc_table(table);
 	printf("OK!\n");
@@ -0,0 +1,153 @@
+/*
+ * ready_queue.c
+ *
+ * Implementation of the ready queue module.
+ */
+
+#include <stdlib.h>
+#include <limits.h>
+
+#include "ready_queue.h"
+
+#define START_SIZE 64
+
+/* Heap element. The key is computed once on insertion, order breaks ties. */
+struct ready_item_struct {
+    long long key;              // Smaller keys are taken first
+    unsigned long long order;   // Insertion number
+    cmd_entry cmd;
+};
+
+struct ready_queue_struct {
+    int policy;
+    long long aging_period;
+    int size;
+    int max_size;
+    unsigned long long next_order;
+    struct ready_item_struct *items;
+};
+
+static long long ready_key(ready_queue q, cmd_entry cmd);
+static inline int item_before(struct ready_item_struct *a, struct ready_item_struct *b);
+
+ready_queue create_ready_queue(int policy, long long aging_period) {
+    ready_queue q;
+
+    if ((q = malloc(sizeof(struct ready_queue_struct))) == NULL) {
+        return NULL;
+    }
+    if ((q->items = malloc(sizeof(struct ready_item_struct) * START_SIZE)) == NULL) {
+        free(q);
+        return NULL;
+    }
+    q->policy = policy;
+    q->aging_period = aging_period;
+    q->size = 0;
+    q->max_size = START_SIZE;
+    q->next_order = 0;
+    return q;
+}
+
+void destroy_ready_queue(ready_queue q) {
+    if (q == NULL) {
+        return;
+    }
+    for (int i=0;i<q->size;i++) {
+        free_cmd_entry(q->items[i].cmd);
+    }
+    free(q->items);
+    free(q);
+}
+
+int push_ready(ready_queue q, cmd_entry cmd) {
+    struct ready_item_struct *items, item;
+    int i, parent;
+
+    if (q->size == q->max_size) {
+        items = realloc(q->items, sizeof(struct ready_item_struct) * 2 * q->max_size);
+        if (items == NULL) {
+            return -1;
+        }
+        q->items = items;
+        q->max_size *= 2;
+    }
+    item.key = ready_key(q, cmd);
+    item.order = q->next_order++;
+    item.cmd = cmd;
+
+    // Sift up
+    i = q->size++;
+    while (i > 0) {
+        parent = (i - 1) / 2;
+        if (!item_before(&item, &q->items[parent])) {
+            break;
+        }
+        q->items[i] = q->items[parent];
+        i = parent;
+    }
+    q->items[i] = item;
+    return 0;
+}
+
+cmd_entry peek_ready(ready_queue q) {
+    return q->size > 0 ? q->items[0].cmd : NULL;
+}
+
+cmd_entry pop_ready(ready_queue q) {
+    struct ready_item_struct last;
+    cmd_entry first;
+    int i, child;
+
+    if (q->size == 0) {
+        return NULL;
+    }
+    first = q->items[0].cmd;
+    last = q->items[--q->size];
+
+    // Sift the last item down from the root
+    i = 0;
+    while ((child = 2 * i + 1) < q->size) {
+        if (child + 1 < q->size && item_before(&q->items[child + 1], &q->items[child])) {
+            child++;
+        }
+        if (!item_before(&q->items[child], &last)) {
+            break;
+        }
+        q->items[i] = q->items[child];
+        i = child;
+    }
+    q->items[i] = last;
+    return first;
+}
+
+int get_ready_count(ready_queue q) {
+    return q->size;
+}
+
+/*
+ * Computes the heap key of an entry according to the policy of the queue.
+ */
+static long long ready_key(ready_queue q, cmd_entry cmd) {
+    switch (q->policy) {
+    case READY_RANK:
+        return -cmd->rank;
+    case READY_PRIORITY:
+        if (q->aging_period > 0) {
+            // Ordering by prio + (now - arrival) / aging_period, scaled by
+            // aging_period, with the now term dropped since it is common
+            return cmd->start_time - (long long) cmd->prio * q->aging_period;
+        }
+        return -cmd->prio;
+    case READY_DEADLINE:
+        return cmd->deadline >= 0 ? cmd->deadline : LLONG_MAX;
+    default:
+        return 0;
+    }
+}
+
+/*
+ * Returns 1 if item a should be taken before item b, otherwise 0.
+ */
+static inline int item_before(struct ready_item_struct *a, struct ready_item_struct *b) {
+    return a->key < b->key || (a->key == b->key && a->order < b->order);
+}
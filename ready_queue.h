@@ -0,0 +1,60 @@
+/* ready_queue.h
+ *
+ * The queue of processes that have arrived and wait for a tile, kept as a
+ * binary heap ordered by the selected policy:
+ *
+ *   READY_FIFO      arrival order
+ *   READY_RANK      longest critical path first (see dag.h)
+ *   READY_PRIORITY  highest prio= first, optionally with aging
+ *   READY_DEADLINE  earliest deadline= first, processes without a deadline
+ *                   last
+ *
+ * Processes that compare equal are taken in arrival order.
+ *
+ * With aging, the priority of a waiting process grows by one level for every
+ * aging period it has waited. Two processes that both wait keep their
+ * relative order as time passes, so the order is given by the constant key
+ * prio - arrival / aging_period and never needs to be recomputed.
+ * */
+
+#ifndef _READY_QUEUE_H
+#define _READY_QUEUE_H
+
+#include "cmd_list.h"
+
+#define READY_FIFO 0
+#define READY_RANK 1
+#define READY_PRIORITY 2
+#define READY_DEADLINE 3
+
+/* Each queue instance is represented by a ready_queue_struct. */
+struct ready_queue_struct;
+
+/* Typedef for a user handle to a queue instance. */
+typedef struct ready_queue_struct *ready_queue;
+
+/* Creates an empty queue with the given policy. aging_period is the time in
+ * microseconds after which a waiting process gains one priority level, 0
+ * disables aging. It is only used by READY_PRIORITY.
+ * On success a handle is returned, otherwise NULL. */
+ready_queue create_ready_queue(int policy, long long aging_period);
+
+/* Frees allocated memory, including the entries still in the queue. */
+void destroy_ready_queue(ready_queue q);
+
+/* Adds an entry returned by take_first(). Its start_time is used as the
+ * arrival time. The queue takes over ownership of the entry.
+ * On success 0 is returned, otherwise -1. */
+int push_ready(ready_queue q, cmd_entry cmd);
+
+/* Returns the first entry without removing it, or NULL if the queue is empty. */
+cmd_entry peek_ready(ready_queue q);
+
+/* Removes the first entry and returns it, or NULL if the queue is empty. The
+ * entry must later be freed with free_cmd_entry(). */
+cmd_entry pop_ready(ready_queue q);
+
+/* Returns the number of entries in the queue. */
+int get_ready_count(ready_queue q);
+
+#endif
@@ -0,0 +1,82 @@
+/*
+ * sample_slots.c
+ *
+ * Implementation of the sample slot array.
+ */
+
+#include <stdlib.h>
+#include <sched.h>
+
+#include "sample_slots.h"
+
+#define CACHE_LINE_SIZE 64
+
+struct slot_struct {
+    volatile unsigned seq;  // Odd while the sample is being written
+    struct sample_struct sample;
+} __attribute__((aligned(CACHE_LINE_SIZE)));
+
+struct sample_slots_struct {
+    int num_slots;
+    struct slot_struct *slots;
+};
+
+sample_slots create_sample_slots(int num_slots) {
+    sample_slots slots;
+
+    if (num_slots <= 0 || (slots = malloc(sizeof(struct sample_slots_struct))) == NULL) {
+        return NULL;
+    }
+    if (posix_memalign((void **) &slots->slots, CACHE_LINE_SIZE,
+            sizeof(struct slot_struct) * num_slots) != 0) {
+        free(slots);
+        return NULL;
+    }
+    slots->num_slots = num_slots;
+    for (int i=0;i<num_slots;i++) {
+        slots->slots[i].seq = 0;
+        slots->slots[i].sample.tick = 0;
+        slots->slots[i].sample.cpu = -1;
+        slots->slots[i].sample.wr_miss = 0;
+        slots->slots[i].sample.wr_cnt = 0;
+        slots->slots[i].sample.drd_miss = 0;
+        slots->slots[i].sample.drd_cnt = 0;
+    }
+    return slots;
+}
+
+void destroy_sample_slots(sample_slots slots) {
+    if (slots == NULL) {
+        return;
+    }
+    free(slots->slots);
+    free(slots);
+}
+
+void publish_sample(sample_slots slots, int slot, const struct sample_struct *sample) {
+    struct slot_struct *s = &slots->slots[slot];
+
+    s->seq++;
+    // Readers must see the odd count before any part of the new sample
+    __sync_synchronize();
+    s->sample = *sample;
+    // ...and the whole sample before the even count
+    __sync_synchronize();
+    s->seq++;
+}
+
+void read_sample(sample_slots slots, int slot, struct sample_struct *sample) {
+    struct slot_struct *s = &slots->slots[slot];
+    unsigned seq;
+
+    do {
+        // The writer is in the middle of a sample, it may have been preempted
+        while ((seq = s->seq) & 1) {
+            sched_yield();
+        }
+        __sync_synchronize();
+        *sample = s->sample;
+        // The copy is only whole if no write started meanwhile
+        __sync_synchronize();
+    } while (s->seq != seq);
+}
@@ -0,0 +1,47 @@
+/* sample_slots.h
+ *
+ * An array of slots, each holding the latest counter sample of one tile,
+ * written by one thread per slot and read by any thread without locks.
+ *
+ * Every slot is protected by a sequence count that the writer makes odd
+ * while it copies a sample in and even again when it is done. A reader
+ * retries until it has copied a slot between two equal, even counts, so it
+ * never sees a torn sample and never holds up the writer. Slots are on cache
+ * lines of their own, so writers on different tiles don't contend.
+ * */
+
+#ifndef _SAMPLE_SLOTS_H
+#define _SAMPLE_SLOTS_H
+
+#include <stdint.h>
+
+/* A counter sample, see read_cpu_counters() in perfcount.h. */
+struct sample_struct {
+    uint64_t tick;  // Tick the sample was taken at, 0 if none yet
+    int cpu;        // Cpu the counters were read on, -1 if there are none
+    int wr_miss;
+    int wr_cnt;
+    int drd_miss;
+    int drd_cnt;
+};
+
+/* Each slot array instance is represented by a sample_slots_struct. */
+struct sample_slots_struct;
+
+/* Typedef for a user handle to a slot array instance. */
+typedef struct sample_slots_struct *sample_slots;
+
+/* Creates num_slots slots holding no sample (tick 0, cpu -1). On success a
+ * handle is returned, otherwise NULL. */
+sample_slots create_sample_slots(int num_slots);
+
+/* Frees allocated memory. */
+void destroy_sample_slots(sample_slots slots);
+
+/* Copies a sample into a slot. Only called by the writer of the slot. */
+void publish_sample(sample_slots slots, int slot, const struct sample_struct *sample);
+
+/* Copies the latest sample out of a slot. Can be called from any thread. */
+void read_sample(sample_slots slots, int slot, struct sample_struct *sample);
+
+#endif
@@ -0,0 +1,104 @@
+/* sample_slots_test.c */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <pthread.h>
+#include "sample_slots.h"
+
+static const int num_slots = 4;
+static const int num_samples = 1000000;
+
+static volatile int writing = 1;
+
+// A sample that is torn if its fields don't all follow from the tick:
+static void make_sample(struct sample_struct *sample, int slot, int n) {
+	sample->tick = n;
+	sample->cpu = slot;
+	sample->wr_miss = n;
+	sample->wr_cnt = -n;
+	sample->drd_miss = 2 * n;
+	sample->drd_cnt = -2 * n;
+}
+
+static int is_whole(struct sample_struct *sample, int slot) {
+	int n = (int) sample->tick;
+
+	return sample->cpu == slot && sample->wr_miss == n && sample->wr_cnt == -n
+			&& sample->drd_miss == 2 * n && sample->drd_cnt == -2 * n;
+}
+
+// Publishes the ticks 1 to num_samples into the last slot:
+static void *write_samples(void *arg) {
+	sample_slots slots = arg;
+	struct sample_struct sample;
+
+	for (int n = 1; n <= num_samples; n++) {
+		make_sample(&sample, num_slots - 1, n);
+		publish_sample(slots, num_slots - 1, &sample);
+	}
+	writing = 0;
+	return NULL;
+}
+
+// Performs a test of the sample_slots module:
+int main(void) {
+	struct sample_struct sample;
+	sample_slots slots;
+	pthread_t writer;
+	uint64_t last_tick = 0;
+	int slot, reads = 0;
+
+	printf("Creating %i slots\n", num_slots);
+	if ((slots = create_sample_slots(num_slots)) == NULL) {
+		printf("failed!\n");
+		return 1;
+	}
+	for (slot = 0; slot < num_slots; slot++) {
+		read_sample(slots, slot, &sample);
+		if (sample.tick != 0 || sample.cpu != -1) {
+			printf("failed!\n");
+			return 1;
+		}
+	}
+	printf("OK!\n");
+
+	// Publish and read back from one thread:
+	printf("Publishing a sample to every slot\n");
+	for (slot = 0; slot < num_slots; slot++) {
+		make_sample(&sample, slot, slot + 1);
+		publish_sample(slots, slot, &sample);
+	}
+	for (slot = 0; slot < num_slots; slot++) {
+		read_sample(slots, slot, &sample);
+		if (sample.tick != slot + 1 || !is_whole(&sample, slot)) {
+			printf("failed!\n");
+			return 1;
+		}
+	}
+	printf("OK!\n");
+
+	// Samples must be read whole and never go back in time while written:
+	printf("Reading while %i samples are published\n", num_samples);
+	pthread_create(&writer, NULL, write_samples, slots);
+	while (writing) {
+		read_sample(slots, num_slots - 1, &sample);
+		if (!is_whole(&sample, num_slots - 1) || sample.tick < last_tick) {
+			printf("failed!\n");
+			return 1;
+		}
+		last_tick = sample.tick;
+		reads++;
+	}
+	pthread_join(writer, NULL);
+	read_sample(slots, num_slots - 1, &sample);
+	if (sample.tick != num_samples) {
+		printf("failed!\n");
+		return 1;
+	}
+	printf("OK! (%i reads)\n", reads);
+
+	printf("Destroying slots\n");
+	destroy_sample_slots(slots);
+	printf("OK!\n");
+	return 0;
+}
@@ -16,18 +16,31 @@
 #include "proc_table.h"
 #include "sched_algs.h"
 
+/* Placement request passed to has_room(). */
+struct placement_struct {
+    proc_table table;
+    int num_of_cpus;
+    int class;
+};
 
-int get_tile(cpu_set_t *cpus, proc_table table) {
-    return get_tile_from_counters(cpus, table);
+static int has_room(int tile, void *arg);
+static int is_empty(int tile, void *arg);
+
+/*
+ * Returns the tile a process of the given class should be placed on, or -1
+ * if every tile has reached its admission limits.
+ */
+int get_tile(proc_table table, int class) {
+    return get_tile_from_counters(table, class);
 }
 
 /**
  * Returns a suitable tile by class value.
  * Tries to get an empty tile, otherwise it returns
- * the tile with the lowest total class value.
+ * the tile with the lowest total class value that has room.
  */
-int get_tile_by_classes(cpu_set_t *cpus, proc_table table) {
-    int num_of_cpus = tmc_cpus_count(cpus);
+int get_tile_by_classes(proc_table table, int class) {
+    int num_of_cpus = table->num_tiles;
     //printf("get_tile: got cpu count %i\n", num_of_cpus);
     // If a tile it empty, its probably the most suitable tile...
     int empty_tile = get_empty_tile(num_of_cpus, table);
@@ -35,26 +48,18 @@ int get_tile_by_classes(cpu_set_t *cpus, proc_table table) {
         return empty_tile;
     }
 
-    int best_tile = 0;
-    int min_val = get_total_value_of_classes(table, 0);
-    for (int i=1;i<num_of_cpus;i++) {
-        if (get_total_value_of_classes(table, i) < min_val) {
-            best_tile = i;
-            min_val = get_total_value_of_classes(table, i);
-        }
-    }
-    // Return the tile with the lowest value (calculated above)
-    return best_tile;
-
+    // The tile with the lowest value that has room
+    struct placement_struct placement = {table, num_of_cpus, class};
+    return find_min_tile(table->by_classes, has_room, &placement);
 }
 /*
  * Returns a suitable tile.
  *
  * Tries to get an empty tile, otherwise find the tile with least data cache
- * write miss rate.
+ * write miss rate that has room.
  */
-int get_tile_by_miss_rate(cpu_set_t *cpus, proc_table table, float *wr_miss_rates) {
-    int num_of_cpus = tmc_cpus_count(cpus);
+int get_tile_by_miss_rate(proc_table table, float *wr_miss_rates, int class) {
+    int num_of_cpus = table->num_tiles;
     //printf("get_tile: got cpu count %i\n", num_of_cpus);
     // If a tile it empty, its probably the most suitable tile...
     int empty_tile = get_empty_tile(num_of_cpus, table);
@@ -64,12 +69,15 @@ int get_tile_by_miss_rate(cpu_set_t *cpus, proc_table table, float *wr_miss_rate
 
     // Otherwise, calculate the best tile through multiplying the tile's miss
     // rate by the number of processes running on that tile.
-    int best_tile = 0;
-    float min_val = get_pid_count(table, 0) * wr_miss_rates[0];
+    int best_tile = -1;
+    float min_val = 0;
     int temp_val;
-    for (int i=1;i<num_of_cpus;i++) {
+    for (int i=0;i<num_of_cpus;i++) {
+        if (!tile_has_room(table, i, class)) {
+            continue;
+        }
         temp_val = get_pid_count(table, i) * wr_miss_rates[i];
-        if (temp_val < min_val) {
+        if (best_tile < 0 || temp_val < min_val) {
             best_tile = i;
             min_val = temp_val;
         }
@@ -81,57 +89,49 @@ int get_tile_by_miss_rate(cpu_set_t *cpus, proc_table table, float *wr_miss_rate
 /*
  * Returns the tile with the least amount of contention. If there is
  * an empty tile, it will return that and skip all other calculations.
+ * With a topology the empty tile with the lowest contention score is
+ * returned, since empty tiles may still share a cache with busy ones.
+ * Tiles without room for the class are skipped, -1 is returned if no
+ * tile has room.
  */
-int get_tile_from_counters(cpu_set_t *cpus, proc_table table) {
-    int num_of_cpus = tmc_cpus_count(cpus);
+int get_tile_from_counters(proc_table table, int class) {
+    int num_of_cpus = table->num_tiles;
+    int empty_tile;
     //printf("get_tile_from_counters: CPU COUNT %i\n", num_of_cpus);
     // If a tile it empty, its probably the most suitable tile...
-    int empty_tile = get_empty_tile(num_of_cpus, table);
+    if (table->topo != NULL) {
+        empty_tile = find_min_tile(table->by_misses, is_empty, table);
+    }
+    else {
+        empty_tile = get_empty_tile(num_of_cpus, table);
+    }
     if (empty_tile >= 0) {
         return empty_tile;
     }
 
-    int best_tile = 0;
-    float min_val = table->miss_counters[0];
-    for (int i=1;i<num_of_cpus;i++) {
-        if (table->miss_counters[i] == 0.0) {
-            return i;
-        }
-        else if (table->miss_counters[i] < min_val) {
-            best_tile = i;
-            min_val = table->miss_counters[i];
-        }
-    }
-    return best_tile;
+    // The tile with the lowest contention score that has room
+    struct placement_struct placement = {table, num_of_cpus, class};
+    return find_min_tile(table->by_misses, has_room, &placement);
 }
 
 /*
- * Returns an empty tile (if there is one).
+ * Returns an empty tile (if there is one). Tiles reserved for processes that
+ * are being started are not empty.
  * Returns -1 if no tile is empty.
  */
 int get_empty_tile(int num_of_cpus, proc_table table) {
-    for (int i=0;i<num_of_cpus;i++) {
-        if (get_pid_count(table, i) == 0) {
-            return i;
-        }
-    }
-    return -1;
+    int tile = find_empty_tile(table);
+
+    return tile < num_of_cpus ? tile : -1;
 }
 
 /*
- * Returns the tile with least processes running.
+ * Returns the online tile with least processes running.
  */
 int get_least_occupied_tile(int num_of_cpus, proc_table table) {
-    int best_tile = 0;
-    int min_val = get_pid_count(table, 0);
+    struct placement_struct placement = {table, num_of_cpus, -1};
 
-    for (int i=1;i<num_of_cpus;i++) {
-        if (get_pid_count(table, i) < min_val) {
-            best_tile = i;
-            min_val = get_pid_count(table, i);
-        }
-    }
-    return best_tile;
+    return find_min_tile(table->by_occupancy, has_room, &placement);
 }
 
 /*
@@ -191,3 +191,26 @@ int get_tile_from_wr_miss_array(int num_of_cpus, float *wr_miss_rates) {
     }
     return best_tile;
 }
+
+/*
+ * Returns non-zero if the tile is one of the first num_of_cpus tiles, is
+ * online and has room for the process to be placed. A class of -1 skips the
+ * room check.
+ */
+static int has_room(int tile, void *arg) {
+    struct placement_struct *placement = arg;
+
+    if (tile >= placement->num_of_cpus || get_tile_cpu(placement->table, tile) < 0) {
+        return 0;
+    }
+    return placement->class < 0 || tile_has_room(placement->table, tile, placement->class);
+}
+
+/*
+ * Accepts tiles without processes or reservations, see find_empty_tile().
+ */
+static int is_empty(int tile, void *arg) {
+    proc_table table = arg;
+
+    return (table->empty_tiles[tile / 64] >> (tile % 64)) & 1;
+}
@@ -0,0 +1,80 @@
+/*
+ * spsc_ring.c
+ *
+ * Implementation of the single-producer/single-consumer ring.
+ */
+
+#include <stdlib.h>
+#include <string.h>
+
+#include "spsc_ring.h"
+
+#define CACHE_LINE_SIZE 64
+
+struct spsc_ring_struct {
+    size_t mask;            // Capacity - 1, the capacity is a power of two
+    size_t elem_size;
+    char *elems;
+    // Free running indexes, the slot of an index is index & mask
+    volatile size_t head __attribute__((aligned(CACHE_LINE_SIZE)));  // Next to pop
+    volatile size_t tail __attribute__((aligned(CACHE_LINE_SIZE)));  // Next to push
+};
+
+spsc_ring create_spsc_ring(size_t capacity, size_t elem_size) {
+    spsc_ring ring;
+    size_t size = 1;
+
+    while (size < capacity) {
+        size *= 2;
+    }
+    if (capacity == 0 || elem_size == 0
+            || posix_memalign((void **) &ring, CACHE_LINE_SIZE,
+                sizeof(struct spsc_ring_struct)) != 0) {
+        return NULL;
+    }
+    if ((ring->elems = malloc(size * elem_size)) == NULL) {
+        free(ring);
+        return NULL;
+    }
+    ring->mask = size - 1;
+    ring->elem_size = elem_size;
+    ring->head = 0;
+    ring->tail = 0;
+    return ring;
+}
+
+void destroy_spsc_ring(spsc_ring ring) {
+    if (ring == NULL) {
+        return;
+    }
+    free(ring->elems);
+    free(ring);
+}
+
+int push_ring(spsc_ring ring, const void *elem) {
+    size_t tail = ring->tail;
+
+    if (tail - ring->head > ring->mask) {
+        return -1;
+    }
+    memcpy(ring->elems + (tail & ring->mask) * ring->elem_size, elem, ring->elem_size);
+    // The element must be written before the consumer can see it
+    __sync_synchronize();
+    ring->tail = tail + 1;
+    return 0;
+}
+
+int pop_ring(spsc_ring ring, void *elem) {
+    size_t head = ring->head;
+
+    if (head == ring->tail) {
+        return -1;
+    }
+    // The element must not be read before the tail that published it
+    __sync_synchronize();
+    memcpy(elem, ring->elems + (head & ring->mask) * ring->elem_size, ring->elem_size);
+    // ...and must be copied out before the producer may reuse the slot
+    __sync_synchronize();
+    ring->head = head + 1;
+    return 0;
+}
@@ -0,0 +1,39 @@
+/* spsc_ring.h
+ *
+ * A bounded ring of fixed-size elements passed from one producer thread to
+ * one consumer thread without locks. The producer only writes the tail index
+ * and the consumer only the head index, each on a cache line of its own, and
+ * an element is published by advancing the tail after it has been copied in.
+ *
+ * The ring never blocks: pushing to a full ring and popping from an empty
+ * ring fail right away.
+ * */
+
+#ifndef _SPSC_RING_H
+#define _SPSC_RING_H
+
+#include <stddef.h>
+
+/* Each ring instance is represented by a spsc_ring_struct. */
+struct spsc_ring_struct;
+
+/* Typedef for a user handle to a ring instance. */
+typedef struct spsc_ring_struct *spsc_ring;
+
+/* Creates an empty ring for at least capacity elements of elem_size bytes
+ * (rounded up to a power of two). On success a handle is returned, otherwise
+ * NULL. */
+spsc_ring create_spsc_ring(size_t capacity, size_t elem_size);
+
+/* Frees allocated memory. */
+void destroy_spsc_ring(spsc_ring ring);
+
+/* Copies an element into the ring. Only called by the producer.
+ * Returns 0 on success, -1 if the ring is full. */
+int push_ring(spsc_ring ring, const void *elem);
+
+/* Copies the oldest element out of the ring and removes it. Only called by
+ * the consumer. Returns 0 on success, -1 if the ring is empty. */
+int pop_ring(spsc_ring ring, void *elem);
+
+#endif
@@ -0,0 +1,92 @@
+/* spsc_ring_test.c */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <pthread.h>
+#include <sched.h>
+#include "spsc_ring.h"
+
+static const int ring_size = 16;
+static const int num_elems = 1000000;
+
+// An element that is torn if its two halves differ:
+struct test_elem {
+	int value;
+	int check;
+};
+
+// Pushes the numbers 0 to num_elems - 1, retrying while the ring is full:
+static void *produce(void *arg) {
+	spsc_ring ring = arg;
+	struct test_elem elem;
+
+	for (int n = 0; n < num_elems; n++) {
+		elem.value = n;
+		elem.check = -n;
+		while (push_ring(ring, &elem) != 0) {
+			sched_yield();
+		}
+	}
+	return NULL;
+}
+
+// Performs a test of the spsc_ring module:
+int main(void) {
+	struct test_elem elem;
+	spsc_ring ring;
+	pthread_t producer;
+	int n;
+
+	printf("Creating ring with %i elements\n", ring_size);
+	if ((ring = create_spsc_ring(ring_size, sizeof(struct test_elem))) == NULL) {
+		printf("failed!\n");
+		return 1;
+	}
+	printf("OK!\n");
+
+	// Fill and drain from one thread:
+	printf("Filling and draining the ring\n");
+	for (n = 0; n < ring_size; n++) {
+		elem.value = n;
+		elem.check = -n;
+		if (push_ring(ring, &elem) != 0) {
+			printf("failed!\n");
+			return 1;
+		}
+	}
+	if (push_ring(ring, &elem) == 0) {
+		printf("Pushed to a full ring\n");
+		return 1;
+	}
+	for (n = 0; n < ring_size; n++) {
+		if (pop_ring(ring, &elem) != 0 || elem.value != n) {
+			printf("failed!\n");
+			return 1;
+		}
+	}
+	if (pop_ring(ring, &elem) == 0) {
+		printf("Popped from an empty ring\n");
+		return 1;
+	}
+	printf("OK!\n");
+
+	// Elements must arrive whole and in order from another thread:
+	printf("Passing %i elements between threads\n", num_elems);
+	pthread_create(&producer, NULL, produce, ring);
+	for (n = 0; n < num_elems; n++) {
+		while (pop_ring(ring, &elem) != 0) {
+			sched_yield();
+		}
+		if (elem.value != n || elem.check != -n) {
+			printf("failed!\n");
+			return 1;
+		}
+	}
+	pthread_join(producer, NULL);
+	printf("OK!\n");
+
+	printf("Destroying ring\n");
+	destroy_spsc_ring(ring);
+	printf("OK!\n");
+	return 0;
+}
@@ -0,0 +1,240 @@
+/*
+ * submit.c
+ *
+ * Implementation of the submission server module.
+ */
+
+#define _GNU_SOURCE // accept4()
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <errno.h>
+#include <sys/socket.h>
+#include <sys/stat.h>
+#include <sys/un.h>
+#include <sys/epoll.h>
+
+#include "submit.h"
+
+#define SUBMIT_MAX_CLIENTS 64
+#define SUBMIT_MAX_EVENTS 16
+#define SUBMIT_START_BUFFER 4096
+// Largest batch accepted from one client:
+#define SUBMIT_MAX_BATCH (1 << 20)
+// epoll data of the listening socket, clients use their slot number:
+#define LISTENER_SLOT SUBMIT_MAX_CLIENTS
+
+/* A connected client. fd is -1 for a free slot. */
+struct client_struct {
+    int fd;
+    int complete;       // The client has shut down its side, batch is read
+    size_t length;
+    size_t size;
+    char *buffer;
+};
+
+struct submit_server_struct {
+    int listen_fd;
+    int epoll_fd;
+    char *path;
+    struct client_struct clients[SUBMIT_MAX_CLIENTS];
+};
+
+static void accept_clients(submit_server server);
+static int read_client(submit_server server, int slot);
+static void close_client(submit_server server, int slot);
+
+submit_server create_submit_server(char *path) {
+    submit_server server;
+    struct sockaddr_un addr;
+    struct epoll_event event;
+    struct stat path_stat;
+
+    if (strlen(path) >= sizeof(addr.sun_path)) {
+        return NULL;
+    }
+    // Only a stale socket is replaced, never another kind of file
+    if (lstat(path, &path_stat) == 0) {
+        if (!S_ISSOCK(path_stat.st_mode) || unlink(path) != 0) {
+            return NULL;
+        }
+    }
+    else if (errno != ENOENT) {
+        return NULL;
+    }
+    if ((server = malloc(sizeof(struct submit_server_struct))) == NULL) {
+        return NULL;
+    }
+    if ((server->path = malloc(strlen(path) + 1)) == NULL) {
+        free(server);
+        return NULL;
+    }
+    strcpy(server->path, path);
+    for (int i=0;i<SUBMIT_MAX_CLIENTS;i++) {
+        server->clients[i].fd = -1;
+    }
+
+    memset(&addr, 0, sizeof(addr));
+    addr.sun_family = AF_UNIX;
+    strcpy(addr.sun_path, path);
+    server->epoll_fd = -1;
+    if ((server->listen_fd = socket(AF_UNIX,
+            SOCK_STREAM | SOCK_NONBLOCK | SOCK_CLOEXEC, 0)) == -1
+            || bind(server->listen_fd, (struct sockaddr *) &addr, sizeof(addr)) != 0
+            || listen(server->listen_fd, SOMAXCONN) != 0
+            || (server->epoll_fd = epoll_create1(EPOLL_CLOEXEC)) == -1) {
+        destroy_submit_server(server);
+        return NULL;
+    }
+    event.events = EPOLLIN;
+    event.data.u32 = LISTENER_SLOT;
+    if (epoll_ctl(server->epoll_fd, EPOLL_CTL_ADD, server->listen_fd, &event) != 0) {
+        destroy_submit_server(server);
+        return NULL;
+    }
+    return server;
+}
+
+void destroy_submit_server(submit_server server) {
+    if (server == NULL) {
+        return;
+    }
+    for (int i=0;i<SUBMIT_MAX_CLIENTS;i++) {
+        if (server->clients[i].fd != -1) {
+            close_client(server, i);
+        }
+    }
+    if (server->listen_fd != -1) {
+        close(server->listen_fd);
+        unlink(server->path);
+    }
+    if (server->epoll_fd != -1) {
+        close(server->epoll_fd);
+    }
+    free(server->path);
+    free(server);
+}
+
+int get_submit_fd(submit_server server) {
+    return server->epoll_fd;
+}
+
+int poll_submissions(submit_server server) {
+    struct epoll_event events[SUBMIT_MAX_EVENTS];
+    int num_events, slot;
+    int complete = 0;
+
+    num_events = epoll_wait(server->epoll_fd, events, SUBMIT_MAX_EVENTS, 0);
+    for (int i=0;i<num_events;i++) {
+        slot = events[i].data.u32;
+        if (slot == LISTENER_SLOT) {
+            accept_clients(server);
+        }
+        else if (read_client(server, slot) != 0) {
+            reply_submission(server, slot, "rejected: batch too large\n");
+        }
+    }
+    for (int i=0;i<SUBMIT_MAX_CLIENTS;i++) {
+        if (server->clients[i].fd != -1 && server->clients[i].complete) {
+            complete++;
+        }
+    }
+    return complete;
+}
+
+char *next_submission(submit_server server, int *conn) {
+    for (int i=0;i<SUBMIT_MAX_CLIENTS;i++) {
+        if (server->clients[i].fd != -1 && server->clients[i].complete) {
+            *conn = i;
+            return server->clients[i].buffer;
+        }
+    }
+    return NULL;
+}
+
+void reply_submission(submit_server server, int conn, char *reply) {
+    // The reply is a single short line, it fits in the socket buffer
+    send(server->clients[conn].fd, reply, strlen(reply), MSG_NOSIGNAL | MSG_DONTWAIT);
+    close_client(server, conn);
+}
+
+/*
+ * Accepts all pending connections. Connections beyond SUBMIT_MAX_CLIENTS
+ * are closed right away.
+ */
+static void accept_clients(submit_server server) {
+    struct epoll_event event;
+    int fd, slot;
+
+    while ((fd = accept4(server->listen_fd, NULL, NULL,
+            SOCK_NONBLOCK | SOCK_CLOEXEC)) != -1) {
+        for (slot=0;slot<SUBMIT_MAX_CLIENTS;slot++) {
+            if (server->clients[slot].fd == -1) {
+                break;
+            }
+        }
+        if (slot == SUBMIT_MAX_CLIENTS
+                || (server->clients[slot].buffer = malloc(SUBMIT_START_BUFFER)) == NULL) {
+            close(fd);
+            continue;
+        }
+        server->clients[slot].fd = fd;
+        server->clients[slot].complete = 0;
+        server->clients[slot].length = 0;
+        server->clients[slot].size = SUBMIT_START_BUFFER;
+        event.events = EPOLLIN;
+        event.data.u32 = slot;
+        if (epoll_ctl(server->epoll_fd, EPOLL_CTL_ADD, fd, &event) != 0) {
+            close_client(server, slot);
+        }
+    }
+}
+
+/*
+ * Reads everything available from a client. The batch is complete at end of
+ * file, the client is then removed from the epoll set until it is replied to.
+ * Returns 0 on success, -1 if the batch is too large.
+ */
+static int read_client(submit_server server, int slot) {
+    struct client_struct *client = &server->clients[slot];
+    char *buffer;
+    ssize_t n;
+
+    while (1) {
+        // Keep room for the terminating NUL
+        if (client->length + 1 == client->size) {
+            if (client->size >= SUBMIT_MAX_BATCH
+                    || (buffer = realloc(client->buffer, 2 * client->size)) == NULL) {
+                return -1;
+            }
+            client->buffer = buffer;
+            client->size *= 2;
+        }
+        n = read(client->fd, client->buffer + client->length,
+                client->size - client->length - 1);
+        if (n > 0) {
+            client->length += n;
+        }
+        else if (n == -1 && errno == EAGAIN) {
+            return 0;
+        }
+        else {
+            // End of file, or an error which ends the batch early
+            client->buffer[client->length] = '\0';
+            client->complete = 1;
+            epoll_ctl(server->epoll_fd, EPOLL_CTL_DEL, client->fd, NULL);
+            return 0;
+        }
+    }
+}
+
+/*
+ * Closes a client connection and frees its slot.
+ */
+static void close_client(submit_server server, int slot) {
+    close(server->clients[slot].fd);
+    free(server->clients[slot].buffer);
+    server->clients[slot].fd = -1;
+}
@@ -0,0 +1,51 @@
+/* submit.h
+ *
+ * Runtime submission of processes over a Unix domain socket.
+ *
+ * A client connects, writes a batch of lines in the workload file format (see
+ * cmd_list.h) and shuts down its side of the connection. The batch is handed
+ * to the scheduler once it is complete, and the scheduler's reply line is
+ * written back before the connection is closed. START is the delay from the
+ * time of submission.
+ *
+ * All sockets are non-blocking and are polled through a single epoll
+ * descriptor, so the scheduler's event loop only has to watch
+ * get_submit_fd(). A slow client never blocks the scheduler.
+ * */
+
+#ifndef _SUBMIT_H
+#define _SUBMIT_H
+
+/* Each server instance is represented by a submit_server_struct. */
+struct submit_server_struct;
+
+/* Typedef for a user handle to a server instance. */
+typedef struct submit_server_struct *submit_server;
+
+/* Creates a server listening on a socket at the specified path. An existing
+ * socket file at the path is replaced, any other file is left alone and the
+ * server isn't created. On success a handle to the server is returned,
+ * otherwise NULL. */
+submit_server create_submit_server(char *path);
+
+/* Closes all connections and the socket, removes the socket file and frees
+ * allocated memory. */
+void destroy_submit_server(submit_server server);
+
+/* Returns a descriptor that is readable when there is I/O to do. */
+int get_submit_fd(submit_server server);
+
+/* Accepts new connections and reads from connected clients without blocking.
+ * Returns the number of batches that are complete, 0 if none. */
+int poll_submissions(submit_server server);
+
+/* Returns the text of a complete batch and stores its connection in conn, or
+ * returns NULL if there is none. The text stays valid until the batch is
+ * replied to, and may be modified by the caller. */
+char *next_submission(submit_server server, int *conn);
+
+/* Writes a reply to the client of a complete batch and closes the
+ * connection. */
+void reply_submission(submit_server server, int conn, char *reply);
+
+#endif
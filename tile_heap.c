@@ -0,0 +1,193 @@
+/*
+ * tile_heap.c
+ *
+ * Implementation of the tile heap module.
+ */
+
+#include <stdlib.h>
+
+#include "tile_heap.h"
+
+struct tile_heap_struct {
+    int num_tiles;
+    float *scores;      // Score of each tile
+    int *tiles;         // Heap of tile numbers
+    int *positions;     // Position of each tile in the heap
+    int *frontier;      // Heap of positions, used by find_min_tile()
+};
+
+static inline int tile_before(tile_heap heap, int a, int b);
+static void sift_up(tile_heap heap, int pos);
+static void sift_down(tile_heap heap, int pos);
+static void swap_tiles(tile_heap heap, int a, int b);
+static void push_frontier(tile_heap heap, int *size, int pos);
+static int pop_frontier(tile_heap heap, int *size);
+
+tile_heap create_tile_heap(int num_tiles) {
+    tile_heap heap;
+
+    if (num_tiles <= 0 || (heap = malloc(sizeof(struct tile_heap_struct))) == NULL) {
+        return NULL;
+    }
+    heap->num_tiles = num_tiles;
+    heap->scores = malloc(sizeof(float) * num_tiles);
+    heap->tiles = malloc(sizeof(int) * num_tiles);
+    heap->positions = malloc(sizeof(int) * num_tiles);
+    heap->frontier = malloc(sizeof(int) * num_tiles);
+    if (heap->scores == NULL || heap->tiles == NULL || heap->positions == NULL
+            || heap->frontier == NULL) {
+        destroy_tile_heap(heap);
+        return NULL;
+    }
+    // Equal scores, so tile order is heap order
+    for (int i=0;i<num_tiles;i++) {
+        heap->scores[i] = 0;
+        heap->tiles[i] = i;
+        heap->positions[i] = i;
+    }
+    return heap;
+}
+
+void destroy_tile_heap(tile_heap heap) {
+    if (heap == NULL) {
+        return;
+    }
+    free(heap->scores);
+    free(heap->tiles);
+    free(heap->positions);
+    free(heap->frontier);
+    free(heap);
+}
+
+void set_tile_score(tile_heap heap, int tile, float score) {
+    float old_score = heap->scores[tile];
+
+    heap->scores[tile] = score;
+    if (score < old_score) {
+        sift_up(heap, heap->positions[tile]);
+    }
+    else if (score > old_score) {
+        sift_down(heap, heap->positions[tile]);
+    }
+}
+
+float get_tile_score(tile_heap heap, int tile) {
+    return heap->scores[tile];
+}
+
+int find_min_tile(tile_heap heap, int (*accept)(int tile, void *arg), void *arg) {
+    int size = 0;
+    int pos;
+
+    if (accept == NULL) {
+        return heap->tiles[0];
+    }
+    // Best-first walk of the heap: the frontier holds the positions whose
+    // parents were rejected, ordered by their tiles
+    push_frontier(heap, &size, 0);
+    while (size > 0) {
+        pos = pop_frontier(heap, &size);
+        if (accept(heap->tiles[pos], arg)) {
+            return heap->tiles[pos];
+        }
+        if (2 * pos + 1 < heap->num_tiles) {
+            push_frontier(heap, &size, 2 * pos + 1);
+        }
+        if (2 * pos + 2 < heap->num_tiles) {
+            push_frontier(heap, &size, 2 * pos + 2);
+        }
+    }
+    return -1;
+}
+
+/*
+ * Returns non-zero if tile a comes before tile b.
+ */
+static inline int tile_before(tile_heap heap, int a, int b) {
+    if (heap->scores[a] != heap->scores[b]) {
+        return heap->scores[a] < heap->scores[b];
+    }
+    return a < b;
+}
+
+static void sift_up(tile_heap heap, int pos) {
+    int parent;
+
+    while (pos > 0) {
+        parent = (pos - 1) / 2;
+        if (!tile_before(heap, heap->tiles[pos], heap->tiles[parent])) {
+            break;
+        }
+        swap_tiles(heap, pos, parent);
+        pos = parent;
+    }
+}
+
+static void sift_down(tile_heap heap, int pos) {
+    int child;
+
+    while ((child = 2 * pos + 1) < heap->num_tiles) {
+        if (child + 1 < heap->num_tiles
+                && tile_before(heap, heap->tiles[child + 1], heap->tiles[child])) {
+            child++;
+        }
+        if (!tile_before(heap, heap->tiles[child], heap->tiles[pos])) {
+            break;
+        }
+        swap_tiles(heap, pos, child);
+        pos = child;
+    }
+}
+
+/*
+ * Swaps the tiles at two heap positions.
+ */
+static void swap_tiles(tile_heap heap, int a, int b) {
+    int tile = heap->tiles[a];
+
+    heap->tiles[a] = heap->tiles[b];
+    heap->tiles[b] = tile;
+    heap->positions[heap->tiles[a]] = a;
+    heap->positions[heap->tiles[b]] = b;
+}
+
+/*
+ * Adds a heap position to the frontier of find_min_tile(). The frontier never
+ * holds more positions than there are tiles.
+ */
+static void push_frontier(tile_heap heap, int *size, int pos) {
+    int *frontier = heap->frontier;
+    int i, parent;
+
+    for (i=(*size)++;i>0;i=parent) {
+        parent = (i - 1) / 2;
+        if (!tile_before(heap, heap->tiles[pos], heap->tiles[frontier[parent]])) {
+            break;
+        }
+        frontier[i] = frontier[parent];
+    }
+    frontier[i] = pos;
+}
+
+/*
+ * Removes and returns the heap position of the first tile in the frontier.
+ */
+static int pop_frontier(tile_heap heap, int *size) {
+    int *frontier = heap->frontier;
+    int first = frontier[0];
+    int last = frontier[--(*size)];
+    int i, child;
+
+    for (i=0;(child=2*i+1)<*size;i=child) {
+        if (child + 1 < *size && tile_before(heap, heap->tiles[frontier[child + 1]],
+                heap->tiles[frontier[child]])) {
+            child++;
+        }
+        if (!tile_before(heap, heap->tiles[frontier[child]], heap->tiles[last])) {
+            break;
+        }
+        frontier[i] = frontier[child];
+    }
+    frontier[i] = last;
+    return first;
+}
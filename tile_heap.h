@@ -0,0 +1,40 @@
+/* tile_heap.h
+ *
+ * Tiles ordered by a score, kept as an indexed binary min-heap: the position
+ * of every tile in the heap is recorded, so the score of any tile can be
+ * changed in O(log tiles) and the tile with the lowest score is found
+ * without scanning all tiles. Tiles with equal scores are ordered by tile
+ * number, lowest first.
+ *
+ * Searches may skip tiles that don't qualify (for example tiles without room
+ * for a process). The heap is then visited in score order, so the cost only
+ * grows with the number of skipped tiles.
+ * */
+
+#ifndef _TILE_HEAP_H
+#define _TILE_HEAP_H
+
+/* Each heap instance is represented by a tile_heap_struct. */
+struct tile_heap_struct;
+
+/* Typedef for a user handle to a heap instance. */
+typedef struct tile_heap_struct *tile_heap;
+
+/* Creates a heap of tiles 0 to num_tiles - 1, all with score 0.
+ * On success a handle is returned, otherwise NULL. */
+tile_heap create_tile_heap(int num_tiles);
+
+/* Frees allocated memory. */
+void destroy_tile_heap(tile_heap heap);
+
+/* Sets the score of a tile. */
+void set_tile_score(tile_heap heap, int tile, float score);
+
+/* Returns the score of a tile. */
+float get_tile_score(tile_heap heap, int tile);
+
+/* Returns the tile with the lowest score for which accept(tile, arg) returns
+ * non-zero, or -1 if there is none. If accept is NULL every tile qualifies. */
+int find_min_tile(tile_heap heap, int (*accept)(int tile, void *arg), void *arg);
+
+#endif
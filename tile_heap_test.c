@@ -0,0 +1,64 @@
+/* tile_heap_test.c */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <time.h>
+#include "tile_heap.h"
+
+static const int num_tiles = 256;
+static const int num_updates = 100000;
+
+// Accepts the tiles marked in the array passed as arg:
+static int is_marked(int tile, void *arg) {
+	return ((char *) arg)[tile];
+}
+
+// Performs a test of the tile_heap module:
+int main(void) {
+	int n, tile, best, marked_best;
+	float scores[num_tiles];
+	char marked[num_tiles];
+	tile_heap heap;
+
+	printf("Creating tile heap with %i tiles\n", num_tiles);
+	if ((heap = create_tile_heap(num_tiles)) == NULL) {
+		printf("failed!\n");
+		return 1;
+	}
+	printf("OK!\n");
+	srand(time(NULL));
+	for (n = 0; n < num_tiles; n++) {
+		scores[n] = 0;
+	}
+
+	// Change random scores and compare the heap to a linear scan:
+	printf("Updating %i scores\n", num_updates);
+	for (n = 0; n < num_updates; n++) {
+		tile = rand() % num_tiles;
+		scores[tile] = rand() % 32;
+		set_tile_score(heap, tile, scores[tile]);
+
+		best = 0;
+		marked_best = -1;
+		for (int i = 0; i < num_tiles; i++) {
+			marked[i] = rand() % 8 == 0;
+			if (scores[i] < scores[best]) {
+				best = i;
+			}
+			if (marked[i] && (marked_best < 0 || scores[i] < scores[marked_best])) {
+				marked_best = i;
+			}
+		}
+		if (find_min_tile(heap, NULL, NULL) != best
+				|| find_min_tile(heap, is_marked, marked) != marked_best) {
+			printf("failed!\n");
+			return 1;
+		}
+	}
+	printf("OK!\n");
+
+	printf("Destroying tile heap\n");
+	destroy_tile_heap(heap);
+	printf("OK!\n");
+	return 0;
+}
@@ -7,14 +7,14 @@
 #include "tile_table.h"
 
 /* Each position in the table index represents a tile (CPU) and is implemented
- * with an index_struct. This data type holds the vector of process IDs running
- * on the tile. It also contains a count of the number of entries in the process
- * ID vector as well as its capacity. */
+ * with an index_struct. This data type holds the vector of record numbers of
+ * the processes running on the tile. It also contains a count of the number of
+ * entries in the vector as well as its capacity. */
 struct index_struct
 {
 	size_t entry_count;
 	size_t bucket_count;
-	pid_t *buckets;
+	int *buckets;
 };
 
 /* A tile_table instance is represented by the tile_table_struct. This data type
@@ -38,7 +38,7 @@ tile_table create_tile_table(size_t num_cpu, size_t num_pid)
 	int table_index;
 	struct tile_table_struct *new_table;
 	struct index_struct *new_index;
-	pid_t *new_bucket;
+	int *new_bucket;
 
 	if (num_cpu == 0)
 	{
@@ -62,7 +62,7 @@ tile_table create_tile_table(size_t num_cpu, size_t num_pid)
 	new_table->index = new_index;
 	for (table_index = 0; table_index < num_cpu; table_index++)
 	{
-		new_bucket = malloc(num_pid * sizeof(pid_t));
+		new_bucket = malloc(num_pid * sizeof(int));
 		if (new_bucket == NULL )
 		{
 			return NULL ;
@@ -93,61 +93,47 @@ void destroy_tile_table(tile_table table)
 	free(table);
 }
 
-// Add pid to list of running processes on specified tile:
-int add_pid_to_tile_table(tile_table table, pid_t pid, unsigned int cpu)
+// Add record to list of running processes on specified tile:
+int add_record_to_tile_table(tile_table table, int record, unsigned int cpu)
 {
 	if (table == NULL || cpu >= table->index_size
 			|| grow_bucket_vector(table, cpu) != 0)
 	{
 		return -1;
 	}
-	// Add pid to tile, on last position in vector:
-	table->index[cpu].buckets[table->index[cpu].entry_count] = pid;
-	table->index[cpu].entry_count++;
-	return 0;
+	// Add record to tile, on last position in vector:
+	table->index[cpu].buckets[table->index[cpu].entry_count] = record;
+	return table->index[cpu].entry_count++;
 }
 
-// Remove pid from list of running processes on specified tile:
-int remove_pid_from_tile_table(tile_table table, pid_t pid, unsigned int cpu)
+// Remove record at specified slot from list of running processes on tile:
+int remove_slot_from_tile_table(tile_table table, unsigned int cpu, int slot,
+		int *moved)
 {
-	int bucket_index, shift_index;
+	size_t last;
 
-	if (table == NULL || cpu >= table->index_size)
-	{
-		return -1;
-	}
-	// Find pid index in bucket vector:
-	for (bucket_index = 0; bucket_index < table->index[cpu].entry_count;
-			bucket_index++)
-	{
-		if (table->index[cpu].buckets[bucket_index] == pid)
-		{
-			break;
-		}
-	}
-	// No pid found, return error:
-	if (bucket_index == table->index[cpu].entry_count)
+	if (table == NULL || cpu >= table->index_size || slot < 0
+			|| slot >= table->index[cpu].entry_count)
 	{
 		return -1;
 	}
-	// Remove entry from table:
-	if (bucket_index != table->index[cpu].entry_count - 1)
+	// Fill the slot with the last entry of the vector:
+	last = table->index[cpu].entry_count - 1;
+	*moved = -1;
+	if (slot != last)
 	{
-		shift_index = bucket_index;
-		while (shift_index < table->index[cpu].entry_count - 1)
-		{
-			table->index[cpu].buckets[shift_index] =
-					table->index[cpu].buckets[shift_index + 1];
-			shift_index++;
-		}
+		table->index[cpu].buckets[slot] = table->index[cpu].buckets[last];
+		*moved = table->index[cpu].buckets[slot];
 	}
 	table->index[cpu].entry_count--;
-	// Shrink bucket vector and return:
-	return (shrink_bucket_vector(table, cpu));
+	// Shrink bucket vector. The record is removed either way, a failed
+	// shrink leaves the vector as it is:
+	shrink_bucket_vector(table, cpu);
+	return 0;
 }
 
 // Get number of processes running on tile:
-int get_pid_count_from_tile(tile_table table, unsigned int cpu)
+int get_record_count_from_tile(tile_table table, unsigned int cpu)
 {
 	if (table == NULL || cpu >= table->index_size)
 	{
@@ -156,33 +142,34 @@ int get_pid_count_from_tile(tile_table table, unsigned int cpu)
 	return table->index[cpu].entry_count;
 }
 
-// Get list of all pids running on a given tile:
-int get_pids(tile_table table, unsigned int cpu, pid_t *pids, size_t num_pid)
+// Get list of all records running on a given tile:
+int get_records(tile_table table, unsigned int cpu, int *records,
+		size_t num_records)
 {
-	int pid_index;
+	int record_index;
 
 	if (table == NULL || cpu >= table->index_size)
 	{
 		return -1;
 	}
-	// Copy running pids to parameter array:
-	for (pid_index = 0;
-			pid_index < table->index[cpu].entry_count && pid_index < num_pid;
-			pid_index++)
+	// Copy record numbers to parameter array:
+	for (record_index = 0;
+			record_index < table->index[cpu].entry_count
+					&& record_index < num_records; record_index++)
 	{
-		pids[pid_index] = table->index[cpu].buckets[pid_index];
+		records[record_index] = table->index[cpu].buckets[record_index];
 	}
-	return pid_index;
+	return record_index;
 }
 
-/* Doubles the size of the process ID vector at the specified tile if the
- * vector is full. */
+/* Doubles the size of the record vector at the specified tile if the vector is
+ * full. */
 static int grow_bucket_vector(tile_table table, unsigned int cpu)
 {
 	size_t new_bucket_count;
-	pid_t *new_buckets;
+	int *new_buckets;
 
-	// Check if pid vector should be grown (full), otherwise return:
+	// Check if record vector should be grown (full), otherwise return:
 	if (table->index[cpu].entry_count < table->index[cpu].bucket_count)
 	{
 		return 0;
@@ -191,7 +178,7 @@ static int grow_bucket_vector(tile_table table, unsigned int cpu)
 	new_bucket_count = 2 * table->index[cpu].bucket_count;
 	// Reallocate bucket vector:
 	new_buckets = realloc(table->index[cpu].buckets,
-			new_bucket_count * sizeof(pid_t));
+			new_bucket_count * sizeof(int));
 	if (new_buckets == NULL )
 	{
 		return -1;
@@ -206,7 +193,7 @@ static int grow_bucket_vector(tile_table table, unsigned int cpu)
 static int shrink_bucket_vector(tile_table table, unsigned int cpu)
 {
 	size_t new_bucket_count;
-	pid_t *new_buckets;
+	int *new_buckets;
 
 	// Check if bucket vector size should be shrunk, otherwise return:
 	if (table->index[cpu].bucket_count <= table->min_buckets
@@ -224,7 +211,7 @@ static int shrink_bucket_vector(tile_table table, unsigned int cpu)
 			&& (new_bucket_count / 4) > table->index[cpu].entry_count);
 	// Reallocate bucket vector:
 	new_buckets = realloc(table->index[cpu].buckets,
-			new_bucket_count * sizeof(pid_t));
+			new_bucket_count * sizeof(int));
 	if (new_buckets == NULL )
 	{
 		return -1;
@@ -1,7 +1,10 @@
 /* tile_table.h
  *
  * A hash table module used for recording the processes running on each tile
- * (CPU core).
+ * (CPU core). Processes are stored by the number of their process record (see
+ * proc_table.h). Each record keeps its slot in the vector of its tile, so a
+ * process is removed by moving the last entry of the vector into its slot,
+ * without searching or shifting.
  * The table is index by tile number starting from zero. To improve the
  * runtime performance, especially targeting memory efficiency, the data
  * buckets on each position in the hash index are implemented with a vector that
@@ -30,22 +33,27 @@ tile_table create_tile_table(size_t num_cpu, size_t num_pid);
  * are also freed during the operation. */
 void destroy_tile_table(tile_table table);
 
-/* Adds the specified process ID to the list of running processes on the
- * specified tile. On success 0 is returned, otherwise -1. */
-int add_pid_to_tile_table(tile_table table, pid_t pid, unsigned int cpu);
+/* Adds the specified record number to the list of running processes on the
+ * specified tile. On success the slot of the record in the list is returned,
+ * otherwise -1. */
+int add_record_to_tile_table(tile_table table, int record, unsigned int cpu);
 
-/* Removes the specified process ID from the list of running processes on the
- * specified tile. Returns 0 on success, otherwise -1. */
-int remove_pid_from_tile_table(tile_table table, pid_t pid, unsigned int cpu);
+/* Removes the record in the specified slot from the list of running processes
+ * on the specified tile. The last record of the list is moved into the slot,
+ * its number is stored in moved (-1 if the slot was the last one).
+ * Returns 0 on success, -1 if there is no such slot. */
+int remove_slot_from_tile_table(tile_table table, unsigned int cpu, int slot,
+		int *moved);
 
 /* Returns the number of processes running of the specified tile or -1 if the
  * an error occurred. */
-int get_pid_count_from_tile(tile_table table, unsigned int cpu);
-
-/* Returns the process IDs of all processes running on the specified tile. The
- * IDs are copied to the user specified array, pids, with a maximum number of
- * IDs to copy specified by num_pids.
- * On success the number of process IDs copied is returned, otherwise -1. */
-int get_pids(tile_table table, unsigned int cpu, pid_t *pids, size_t num_pids);
+int get_record_count_from_tile(tile_table table, unsigned int cpu);
+
+/* Returns the record numbers of all processes running on the specified tile.
+ * The numbers are copied to the user specified array, records, with a maximum
+ * number to copy specified by num_records.
+ * On success the number of record numbers copied is returned, otherwise -1. */
+int get_records(tile_table table, unsigned int cpu, int *records,
+		size_t num_records);
 
 #endif /* _TILE_TABLE_H */
@@ -1,4 +1,4 @@
-/* pid_table_test.c */
+/* tile_table_test.c */
 
 #include <stdio.h>
 #include <stdlib.h>
@@ -12,9 +12,9 @@ static const int num_entry = 1000;
 // Performs a test of the tile_table module:
 int main(int argc, char *argv[])
 {
-	int n, pid, cpu;
+	int n, cpu, slot, moved;
 	int entry_cpu[num_entry];
-	pid_t entry_pid[num_entry];
+	int entry_slot[num_entry];
 	tile_table table;
 
 	// Create table:
@@ -32,11 +32,11 @@ int main(int argc, char *argv[])
 	printf("adding %i entries\n", num_entry);
 	for (n = 0; n < num_entry; n++)
 	{
-		pid = rand();
 		cpu = rand() % num_cpu;
-		entry_pid[n] = pid;
 		entry_cpu[n] = cpu;
-		if (add_pid_to_tile_table(table, pid, cpu) != 0)
+		slot = add_record_to_tile_table(table, n, cpu);
+		entry_slot[n] = slot;
+		if (slot < 0)
 		{
 			printf("failed!\n");
 			return 1;
@@ -47,11 +47,17 @@ int main(int argc, char *argv[])
 	printf("removing each entry\n");
 	for (n = 0; n < num_entry; n++)
 	{
-		if (remove_pid_from_tile_table(table, entry_pid[n], entry_cpu[n]) != 0)
+		if (remove_slot_from_tile_table(table, entry_cpu[n], entry_slot[n],
+				&moved) != 0)
 		{
 			printf("failed!\n");
 			return 1;
 		}
+		// The moved record now lives in the freed slot:
+		if (moved >= 0)
+		{
+			entry_slot[moved] = entry_slot[n];
+		}
 	}
 	printf("OK!\n");
 	// Destroy table
@@ -0,0 +1,349 @@
+/*
+ * topology.c
+ *
+ * Implementation of the topology module.
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <stdarg.h>
+#include <limits.h>
+#include <dirent.h>
+
+#include "topology.h"
+
+// Contention domains of a cpu, from the closest out
+#define LEVEL_SMT 0
+#define LEVEL_L2 1
+#define LEVEL_LLC 2
+#define NUM_LEVELS 3
+
+// Weight of another tile's misses on each level, and on the same node. The
+// weights add up, so an SMT sibling also counts on the L2, LLC and node.
+static const float level_weights[NUM_LEVELS] = {0.5, 0.25, 0.125};
+#define NODE_WEIGHT 0.0625
+
+// Node distances used when sysfs has none, as in the kernel
+#define LOCAL_DISTANCE 10
+#define REMOTE_DISTANCE 20
+
+// Largest sysfs file read, a distance row of many nodes fits
+#define SYSFS_BUF_SIZE 4096
+
+struct topology_struct {
+    int num_cpus;
+    int *domains;           // Domain of each cpu on each level, named by the
+                            // lowest cpu in it
+    int num_nodes;
+    int *nodes;             // Node of each cpu
+    float *node_weights;    // Weight of the misses on node k for a cpu on
+                            // node m, at m * num_nodes + k
+};
+
+static int read_sysfs(char *buf, size_t size, char *format, ...);
+static int count_entries(char *dir_name, char *prefix);
+static int parse_cpu_list(char *list, char *cpus, int num_cpus);
+static int read_domain(topology topo, char *cpus, int cpu, char *list);
+static void read_caches(topology topo, char *root, char *cpus, int cpu);
+static int read_nodes(topology topo, char *root, char *cpus);
+
+topology create_topology(char *root) {
+    char path[PATH_MAX];
+    char buf[SYSFS_BUF_SIZE];
+    char *cpus;
+    topology topo;
+    int num_cpus;
+
+    snprintf(path, sizeof(path), "%s/devices/system/cpu", root);
+    if ((num_cpus = count_entries(path, "cpu")) <= 0) {
+        return NULL;
+    }
+    if ((topo = malloc(sizeof(struct topology_struct))) == NULL) {
+        return NULL;
+    }
+    topo->num_cpus = num_cpus;
+    topo->domains = malloc(sizeof(int) * num_cpus * NUM_LEVELS);
+    topo->nodes = calloc(num_cpus, sizeof(int));
+    topo->node_weights = NULL;
+    cpus = malloc(num_cpus);
+    if (topo->domains == NULL || topo->nodes == NULL || cpus == NULL) {
+        free(cpus);
+        destroy_topology(topo);
+        return NULL;
+    }
+
+    for (int cpu=0;cpu<num_cpus;cpu++) {
+        // Unshared unless sysfs says otherwise
+        for (int l=0;l<NUM_LEVELS;l++) {
+            topo->domains[cpu * NUM_LEVELS + l] = cpu;
+        }
+        if (read_sysfs(buf, sizeof(buf), "%s/devices/system/cpu/cpu%i/topology/thread_siblings_list",
+                root, cpu) == 0) {
+            topo->domains[cpu * NUM_LEVELS + LEVEL_SMT] = read_domain(topo, cpus, cpu, buf);
+        }
+        read_caches(topo, root, cpus, cpu);
+    }
+    if (read_nodes(topo, root, cpus) != 0) {
+        free(cpus);
+        destroy_topology(topo);
+        return NULL;
+    }
+    free(cpus);
+    return topo;
+}
+
+void destroy_topology(topology topo) {
+    if (topo == NULL) {
+        return;
+    }
+    free(topo->domains);
+    free(topo->nodes);
+    free(topo->node_weights);
+    free(topo);
+}
+
+int get_topology_cpus(topology topo) {
+    return topo->num_cpus;
+}
+
+int get_cpu_node(topology topo, int cpu) {
+    return cpu >= 0 && cpu < topo->num_cpus ? topo->nodes[cpu] : 0;
+}
+
+int get_topology_nodes(topology topo) {
+    return topo->num_nodes;
+}
+
+void get_contention(topology topo, int num_tiles, int *tile_cpus,
+        float *miss_counters, float *scores) {
+    int num_cpus = topo->num_cpus;
+    int num_nodes = topo->num_nodes;
+    float sums[NUM_LEVELS * num_cpus + num_nodes];
+    float *node_sums = &sums[NUM_LEVELS * num_cpus];
+    float *weights;
+    int cpu, node;
+
+    // Sum the miss counters of each domain
+    for (int i=0;i<NUM_LEVELS*num_cpus+num_nodes;i++) {
+        sums[i] = 0;
+    }
+    for (int t=0;t<num_tiles;t++) {
+        if ((cpu = tile_cpus[t]) < 0 || cpu >= num_cpus) {
+            continue;
+        }
+        for (int l=0;l<NUM_LEVELS;l++) {
+            sums[l * num_cpus + topo->domains[cpu * NUM_LEVELS + l]] += miss_counters[t];
+        }
+        node_sums[topo->nodes[cpu]] += miss_counters[t];
+    }
+
+    // Add the weighted sums of the other tiles in the domains of each tile
+    for (int t=0;t<num_tiles;t++) {
+        scores[t] = miss_counters[t];
+        if ((cpu = tile_cpus[t]) < 0 || cpu >= num_cpus) {
+            continue;
+        }
+        for (int l=0;l<NUM_LEVELS;l++) {
+            scores[t] += level_weights[l] * (sums[l * num_cpus
+                    + topo->domains[cpu * NUM_LEVELS + l]] - miss_counters[t]);
+        }
+        node = topo->nodes[cpu];
+        weights = &topo->node_weights[node * num_nodes];
+        for (int k=0;k<num_nodes;k++) {
+            scores[t] += weights[k] * (node_sums[k]
+                    - (k == node ? miss_counters[t] : 0));
+        }
+    }
+}
+
+/*
+ * Reads a sysfs file, whose path is given as a printf format, into buf and
+ * strips the trailing newline.
+ * Returns 0 on success, -1 if the file can't be read.
+ */
+static int read_sysfs(char *buf, size_t size, char *format, ...) {
+    char path[PATH_MAX];
+    va_list args;
+    FILE *file;
+    size_t length;
+
+    va_start(args, format);
+    vsnprintf(path, sizeof(path), format, args);
+    va_end(args);
+    if ((file = fopen(path, "r")) == NULL) {
+        return -1;
+    }
+    length = fread(buf, 1, size - 1, file);
+    fclose(file);
+    buf[length] = '\0';
+    if (length > 0 && buf[length - 1] == '\n') {
+        buf[length - 1] = '\0';
+    }
+    return 0;
+}
+
+/*
+ * Returns the highest N + 1 of the entries named <prefix>N in a directory,
+ * 0 if there are none, or -1 if the directory can't be read.
+ */
+static int count_entries(char *dir_name, char *prefix) {
+    DIR *dir;
+    struct dirent *entry;
+    size_t prefix_length = strlen(prefix);
+    int count = 0;
+    int n, end;
+
+    if ((dir = opendir(dir_name)) == NULL) {
+        return -1;
+    }
+    while ((entry = readdir(dir)) != NULL) {
+        // Skip e.g. cpufreq and cpuidle
+        if (strncmp(entry->d_name, prefix, prefix_length) == 0
+                && sscanf(entry->d_name + prefix_length, "%d%n", &n, &end) == 1
+                && entry->d_name[prefix_length + end] == '\0' && n >= count) {
+            count = n + 1;
+        }
+    }
+    closedir(dir);
+    return count;
+}
+
+/*
+ * Parses a cpu list like "0-3,8,10-11" and marks the cpus in it. Cpus beyond
+ * num_cpus are ignored.
+ * Returns the number of cpus marked, or -1 if the list is malformed.
+ */
+static int parse_cpu_list(char *list, char *cpus, int num_cpus) {
+    int first, last, end;
+    int marked = 0;
+
+    memset(cpus, 0, num_cpus);
+    while (*list != '\0') {
+        if (sscanf(list, "%d%n", &first, &end) != 1 || first < 0) {
+            return -1;
+        }
+        list += end;
+        last = first;
+        if (*list == '-') {
+            if (sscanf(list + 1, "%d%n", &last, &end) != 1 || last < first) {
+                return -1;
+            }
+            list += end + 1;
+        }
+        for (int cpu=first;cpu<=last && cpu<num_cpus;cpu++) {
+            marked += !cpus[cpu];
+            cpus[cpu] = 1;
+        }
+        if (*list == ',') {
+            list++;
+        }
+        else if (*list != '\0') {
+            return -1;
+        }
+    }
+    return marked;
+}
+
+/*
+ * Returns the domain given by a cpu list that should contain cpu: the lowest
+ * cpu in it, or cpu itself if the list is malformed.
+ */
+static int read_domain(topology topo, char *cpus, int cpu, char *list) {
+    if (parse_cpu_list(list, cpus, topo->num_cpus) <= 0 || !cpus[cpu]) {
+        return cpu;
+    }
+    for (int i=0;i<topo->num_cpus;i++) {
+        if (cpus[i]) {
+            return i;
+        }
+    }
+    return cpu;
+}
+
+/*
+ * Reads the L2 and last level cache domains of a cpu. Instruction caches are
+ * skipped. Without a cache above L2 the L2 is the last level cache.
+ */
+static void read_caches(topology topo, char *root, char *cpus, int cpu) {
+    char buf[SYSFS_BUF_SIZE];
+    int *domains = &topo->domains[cpu * NUM_LEVELS];
+    int level, llc_level = 0;
+
+    for (int index=0;read_sysfs(buf, sizeof(buf), "%s/devices/system/cpu/cpu%i/cache/index%i/level",
+            root, cpu, index) == 0;index++) {
+        if ((level = atoi(buf)) < 2) {
+            continue;
+        }
+        if (read_sysfs(buf, sizeof(buf), "%s/devices/system/cpu/cpu%i/cache/index%i/type",
+                root, cpu, index) == 0 && strcmp(buf, "Instruction") == 0) {
+            continue;
+        }
+        if (read_sysfs(buf, sizeof(buf), "%s/devices/system/cpu/cpu%i/cache/index%i/shared_cpu_list",
+                root, cpu, index) != 0) {
+            continue;
+        }
+        if (level == 2) {
+            domains[LEVEL_L2] = read_domain(topo, cpus, cpu, buf);
+        }
+        if (level >= llc_level) {
+            domains[LEVEL_LLC] = read_domain(topo, cpus, cpu, buf);
+            llc_level = level;
+        }
+    }
+}
+
+/*
+ * Reads the node of every cpu and the distances between the nodes, and sets
+ * the node weights from them.
+ * Returns 0 on success, -1 if allocation fails.
+ */
+static int read_nodes(topology topo, char *root, char *cpus) {
+    char path[PATH_MAX];
+    char buf[SYSFS_BUF_SIZE];
+    char *next;
+    int num_nodes, distance, end;
+
+    snprintf(path, sizeof(path), "%s/devices/system/node", root);
+    if ((num_nodes = count_entries(path, "node")) <= 0) {
+        num_nodes = 1;
+    }
+    topo->num_nodes = num_nodes;
+    int distances[num_nodes * num_nodes];
+    if ((topo->node_weights = malloc(sizeof(float) * num_nodes * num_nodes)) == NULL) {
+        return -1;
+    }
+
+    for (int m=0;m<num_nodes;m++) {
+        for (int k=0;k<num_nodes;k++) {
+            distances[m * num_nodes + k] = m == k ? LOCAL_DISTANCE : REMOTE_DISTANCE;
+        }
+        if (read_sysfs(buf, sizeof(buf), "%s/devices/system/node/node%i/cpulist", root, m) == 0
+                && parse_cpu_list(buf, cpus, topo->num_cpus) > 0) {
+            for (int cpu=0;cpu<topo->num_cpus;cpu++) {
+                if (cpus[cpu]) {
+                    topo->nodes[cpu] = m;
+                }
+            }
+        }
+        // One row of the distance table, e.g. "10 21"
+        if (read_sysfs(buf, sizeof(buf), "%s/devices/system/node/node%i/distance", root, m) == 0) {
+            next = buf;
+            for (int k=0;k<num_nodes && sscanf(next, "%d%n", &distance, &end) == 1;k++) {
+                if (distance > 0) {
+                    distances[m * num_nodes + k] = distance;
+                }
+                next += end;
+            }
+        }
+    }
+
+    // Misses on a farther node weigh less
+    for (int m=0;m<num_nodes;m++) {
+        for (int k=0;k<num_nodes;k++) {
+            topo->node_weights[m * num_nodes + k] = NODE_WEIGHT
+                    * distances[m * num_nodes + m] / distances[m * num_nodes + k];
+        }
+    }
+    return 0;
+}
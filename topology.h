@@ -0,0 +1,55 @@
+/* topology.h
+ *
+ * A model of which cpus contend for the same hardware, read from sysfs.
+ *
+ * Every cpu belongs to one contention domain on each level: the core it
+ * shares with its SMT siblings, the L2 cache and the last level cache it
+ * shares with other cores, and its NUMA node. The domains are read from
+ * devices/system/cpu/cpuN/topology/thread_siblings_list,
+ * devices/system/cpu/cpuN/cache/indexK/{level,type,shared_cpu_list} and
+ * devices/system/node/nodeM/{cpulist,distance} under a configurable root, so
+ * the model can be built from a fake tree. Anything missing is taken as
+ * unshared: without a cache map every cpu is its own L2 and LLC domain, and
+ * without nodes all cpus are on one node.
+ *
+ * The contention score of a tile is its own miss counter plus the miss
+ * counters of the tiles it shares domains with, summed per domain and
+ * weighted by how close the domain is: an SMT sibling weighs more than a core
+ * on the same LLC, which weighs more than a core on the same node. Tiles on
+ * other nodes are weighted by the node distance.
+ * */
+
+#ifndef _TOPOLOGY_H
+#define _TOPOLOGY_H
+
+/* Each topology instance is represented by a topology_struct. */
+struct topology_struct;
+
+/* Typedef for a user handle to a topology instance. */
+typedef struct topology_struct *topology;
+
+/* Reads the topology of all cpus from the sysfs tree at root, e.g. "/sys".
+ * On success a handle to the topology is returned, otherwise NULL (also if
+ * root has no cpus). */
+topology create_topology(char *root);
+
+/* Frees allocated memory. */
+void destroy_topology(topology topo);
+
+/* Returns the number of cpus in the topology (the highest cpu number + 1). */
+int get_topology_cpus(topology topo);
+
+/* Returns the NUMA node of a cpu, 0 for cpus beyond the topology. */
+int get_cpu_node(topology topo, int cpu);
+
+/* Returns the number of NUMA nodes, at least 1. */
+int get_topology_nodes(topology topo);
+
+/* Computes the contention score of each of num_tiles tiles, given the cpu of
+ * each tile (-1 for offline tiles, which contribute nothing and whose score
+ * is their own miss counter) and their miss counters. The scores are stored
+ * in scores. Can be used from any thread. */
+void get_contention(topology topo, int num_tiles, int *tile_cpus,
+        float *miss_counters, float *scores);
+
+#endif
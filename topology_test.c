@@ -0,0 +1,185 @@
+/* topology_test.c */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <stdarg.h>
+#include <math.h>
+#include <limits.h>
+#include <unistd.h>
+#include <sys/stat.h>
+#include "topology.h"
+
+#define NUM_CPUS 8
+
+static char root[] = "/tmp/topology_test.XXXXXX";
+
+// Writes a file below root, creating the directories on the way:
+static int write_file(char *content, char *format, ...) {
+	char path[PATH_MAX];
+	char *slash;
+	va_list args;
+	FILE *file;
+	int length;
+
+	length = snprintf(path, sizeof(path), "%s/", root);
+	va_start(args, format);
+	vsnprintf(path + length, sizeof(path) - length, format, args);
+	va_end(args);
+	for (slash = strchr(path + strlen(root) + 1, '/'); slash != NULL; slash = strchr(slash + 1, '/')) {
+		*slash = '\0';
+		mkdir(path, 0755);
+		*slash = '/';
+	}
+	if ((file = fopen(path, "w")) == NULL) {
+		return -1;
+	}
+	fprintf(file, "%s\n", content);
+	fclose(file);
+	return 0;
+}
+
+// Builds a fake sysfs tree with two nodes of two cores with two threads each.
+// Each core has an L1 and an L2, each node an L3:
+static int make_sysfs(void) {
+	char pair[16], node[16];
+
+	for (int cpu = 0; cpu < NUM_CPUS; cpu++) {
+		snprintf(pair, sizeof(pair), "%i-%i", cpu & ~1, cpu | 1);
+		snprintf(node, sizeof(node), "%i-%i", cpu & ~3, cpu | 3);
+		if (write_file(pair, "devices/system/cpu/cpu%i/topology/thread_siblings_list", cpu) != 0
+				|| write_file("1", "devices/system/cpu/cpu%i/cache/index0/level", cpu) != 0
+				|| write_file("Data", "devices/system/cpu/cpu%i/cache/index0/type", cpu) != 0
+				|| write_file(pair, "devices/system/cpu/cpu%i/cache/index0/shared_cpu_list", cpu) != 0
+				|| write_file("1", "devices/system/cpu/cpu%i/cache/index1/level", cpu) != 0
+				|| write_file("Instruction", "devices/system/cpu/cpu%i/cache/index1/type", cpu) != 0
+				|| write_file(pair, "devices/system/cpu/cpu%i/cache/index1/shared_cpu_list", cpu) != 0
+				|| write_file("2", "devices/system/cpu/cpu%i/cache/index2/level", cpu) != 0
+				|| write_file("Unified", "devices/system/cpu/cpu%i/cache/index2/type", cpu) != 0
+				|| write_file(pair, "devices/system/cpu/cpu%i/cache/index2/shared_cpu_list", cpu) != 0
+				|| write_file("3", "devices/system/cpu/cpu%i/cache/index3/level", cpu) != 0
+				|| write_file("Unified", "devices/system/cpu/cpu%i/cache/index3/type", cpu) != 0
+				|| write_file(node, "devices/system/cpu/cpu%i/cache/index3/shared_cpu_list", cpu) != 0) {
+			return -1;
+		}
+	}
+	// Not a cpu:
+	if (write_file("", "devices/system/cpu/cpufreq/boost") != 0) {
+		return -1;
+	}
+	if (write_file("0-3", "devices/system/node/node0/cpulist") != 0
+			|| write_file("10 21", "devices/system/node/node0/distance") != 0
+			|| write_file("4-7", "devices/system/node/node1/cpulist") != 0
+			|| write_file("21 10", "devices/system/node/node1/distance") != 0) {
+		return -1;
+	}
+	return 0;
+}
+
+// Compares the scores to the expected ones:
+static int check_scores(float *scores, float *expected) {
+	for (int i = 0; i < NUM_CPUS; i++) {
+		if (fabsf(scores[i] - expected[i]) > 1e-5) {
+			printf("tile %i: score %f, expected %f\n", i, scores[i], expected[i]);
+			return -1;
+		}
+	}
+	return 0;
+}
+
+// Performs a test of the topology module:
+int main(void) {
+	int tile_cpus[NUM_CPUS];
+	float miss_counters[NUM_CPUS], scores[NUM_CPUS];
+	float node = 0.0625, remote = 0.0625 * 10 / 21;
+	float llc = 0.125 + node, sibling = 0.5 + 0.25 + llc;
+	float expected[NUM_CPUS] = {sibling, 1, llc, llc, remote, remote, remote, remote};
+	float flat[NUM_CPUS] = {node, 1, node, node, node, node, node, node};
+	char command[PATH_MAX + 128];
+	topology topo;
+
+	printf("Creating fake sysfs\n");
+	if (mkdtemp(root) == NULL || make_sysfs() != 0) {
+		printf("failed!\n");
+		return 1;
+	}
+	printf("OK!\n");
+
+	printf("Reading topology from %s\n", root);
+	if ((topo = create_topology(root)) == NULL || get_topology_cpus(topo) != NUM_CPUS) {
+		printf("failed!\n");
+		return 1;
+	}
+	printf("OK!\n");
+
+	// Misses on cpu 1 only, weighted by how close the other cpus are:
+	printf("Computing contention scores\n");
+	for (int i = 0; i < NUM_CPUS; i++) {
+		tile_cpus[i] = i;
+		miss_counters[i] = i == 1;
+	}
+	get_contention(topo, NUM_CPUS, tile_cpus, miss_counters, scores);
+	if (check_scores(scores, expected) != 0) {
+		printf("failed!\n");
+		return 1;
+	}
+	printf("OK!\n");
+
+	// Tiles bound to other cpus follow their cpus:
+	printf("Computing contention scores of rebound tiles\n");
+	for (int i = 0; i < NUM_CPUS; i++) {
+		tile_cpus[i] = NUM_CPUS - 1 - i;
+		miss_counters[i] = i == 6;
+	}
+	get_contention(topo, NUM_CPUS, tile_cpus, miss_counters, scores);
+	if (scores[6] != 1 || fabsf(scores[7] - sibling) > 1e-5
+			|| fabsf(scores[4] - llc) > 1e-5 || fabsf(scores[0] - remote) > 1e-5) {
+		printf("failed!\n");
+		return 1;
+	}
+	printf("OK!\n");
+
+	// An offline tile contributes nothing:
+	printf("Computing contention scores with an offline tile\n");
+	for (int i = 0; i < NUM_CPUS; i++) {
+		tile_cpus[i] = i;
+		miss_counters[i] = i == 1;
+	}
+	tile_cpus[1] = -1;
+	get_contention(topo, NUM_CPUS, tile_cpus, miss_counters, scores);
+	for (int i = 0; i < NUM_CPUS; i++) {
+		if (scores[i] != miss_counters[i]) {
+			printf("failed!\n");
+			return 1;
+		}
+	}
+	printf("OK!\n");
+	destroy_topology(topo);
+
+	// Without cache maps and nodes every cpu is on its own, on one node:
+	printf("Reading topology without caches and nodes\n");
+	snprintf(command, sizeof(command), "cd %s && rm -r devices/system/node "
+			"devices/system/cpu/cpu*/cache devices/system/cpu/cpu*/topology", root);
+	if (system(command) != 0 || (topo = create_topology(root)) == NULL) {
+		printf("failed!\n");
+		return 1;
+	}
+	tile_cpus[1] = 1;
+	get_contention(topo, NUM_CPUS, tile_cpus, miss_counters, scores);
+	if (check_scores(scores, flat) != 0) {
+		printf("failed!\n");
+		return 1;
+	}
+	printf("OK!\n");
+	destroy_topology(topo);
+
+	printf("Reading topology from a missing root\n");
+	if (create_topology("/nonexistent") != NULL) {
+		printf("failed!\n");
+		return 1;
+	}
+	printf("OK!\n");
+
+	snprintf(command, sizeof(command), "rm -r %s", root);
+	return system(command) != 0;
+}
@@ -0,0 +1,41 @@
+/*
+ * wlconv.c
+ *
+ * Converts a text workload file to the binary workload format, see
+ * cmd_list.h.
+ *
+ * usage: ./wlconv <text-workload-file> <binary-workload-file>
+ *
+ * Commands keep the order of the text file, so their sequence numbers in job
+ * records are the same as for the text file. The scheduler sorts them by
+ * start time when loading, in a single pass if the file is sorted already.
+ */
+#include <stdio.h>
+
+#include "cmd_list.h"
+
+int main(int argc, char *argv[]) {
+    cmd_list list;
+    cmd_entry cmd;
+    int count = 0;
+
+    if (argc != 3) {
+        printf("usage: %s <text-workload-file> <binary-workload-file>\n", argv[0]);
+        return 1;
+    }
+    if ((list = create_cmd_list(argv[1])) == NULL) {
+        printf("Failed to read %s\n", argv[1]);
+        return 1;
+    }
+    for (cmd = get_first(list); cmd != NULL; cmd = cmd->next) {
+        count++;
+    }
+    if (write_binary_workload(list, argv[2]) != 0) {
+        printf("Failed to write %s\n", argv[2]);
+        return 1;
+    }
+    printf("Converted %i commands\n", count);
+    destroy_cmd_list(list);
+    return 0;
+}
+
@@ -5,6 +5,9 @@
 #include <sys/types.h>
 #include <sys/stat.h>
 #include <fcntl.h>
+#include <string.h>
+
+#include "cmd_list.h"
 
 int cmpfunc(const void *a, const void *b);
 
@@ -20,15 +23,19 @@ char *cmds[] = {"1 /opt/benchmarks/SPEC2006/benchspec/CPU2006/429.mcf/run/build_
                };
 
 /*
- * Usage: ./wlgen <number_of_entries> <max_start_time> <output-workload-file>
+ * Usage: ./wlgen [-b] <number_of_entries> <max_start_time> <output-workload-file>
  *
  * This creates a "random" workload with random start times from the given number
- * and the array of commands initialized above.
+ * and the array of commands initialized above. With -b the workload is written
+ * in the binary workload format (see cmd_list.h) instead of as text.
  */
 int main(int argc, char *argv[]) {
+    int binary = argc > 1 && strcmp(argv[1], "-b") == 0;
 
+    argv += binary;
+    argc -= binary;
     if (argc != 4) {
-        printf("usage: /wlgen <number_of_entries> <max_start_time> <output-workload-file>\n");
+        printf("usage: /wlgen [-b] <number_of_entries> <max_start_time> <output-workload-file>\n");
         return -1;
     }
     int size_of_cmds = sizeof(cmds)/sizeof(cmds[0]);
@@ -43,11 +50,28 @@ int main(int argc, char *argv[]) {
     }
     qsort(times, num_of_entries, sizeof(int), cmpfunc);
 
+    char cmd[512];
+    if (binary) {
+        cmd_list list = create_empty_cmd_list();
+        cmd_entry entry;
+        for (int i=0;i<num_of_entries;i++) {
+            sprintf(cmd, "%d %s", times[i], cmds[rand() % size_of_cmds]);
+            entry = parse_cmd_line(cmd);
+            entry->seq = i;
+            add_last(list, entry);
+        }
+        if (write_binary_workload(list, workload) != 0) {
+            printf("Failed to write %s\n", workload);
+            return -1;
+        }
+        destroy_cmd_list(list);
+        return 0;
+    }
+
     // Open file in append-mode
     FILE *fp;
     fp=fopen(workload, "w");
 
-    char cmd[512];
     for (int i=0;i<num_of_entries;i++) {
         sprintf(cmd, "%d %s\n", times[i], cmds[rand() % size_of_cmds]);
         fprintf(fp, cmd);
@@ -0,0 +1,570 @@
+/*
+ * zygote.c
+ *
+ * Implementation of the zygote module.
+ */
+
+#define _GNU_SOURCE // sched_setaffinity()
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <fcntl.h>
+#include <signal.h>
+#include <sched.h>
+#include <sys/types.h>
+#include <sys/socket.h>
+#include <sys/wait.h>
+#include <sys/prctl.h>
+
+// Tilera
+#include <tmc/cpus.h>
+
+#include "zygote.h"
+
+// Largest message sent to a zygote, and largest argument vector:
+#define ZYGOTE_MSG_SIZE 4096
+#define ZYGOTE_MAX_ARGS 128
+// Size of the buffer for the directory a zygote waits in:
+#define ZYGOTE_DIR_SIZE 512
+
+// Option of prctl(), from linux/prctl.h (Linux 3.4)
+#ifndef PR_SET_CHILD_SUBREAPER
+#define PR_SET_CHILD_SUBREAPER 36
+#endif
+
+/* Message sent to a zygote. The header is followed by NUL-terminated strings:
+ * working directory, stdin redirection ("" for none), stdout redirection (""
+ * for none), command and argc arguments. If num_fds is 2 the header carries
+ * the job's stdout and stderr as SCM_RIGHTS. */
+struct zygote_msg_header {
+    int length;     // Length of the strings following the header
+    int argc;
+    int num_fds;
+};
+
+/* Request to the template to fork a zygote, answered by the zygote's pid (-1
+ * on failure) with the scheduler end of its socket as SCM_RIGHTS. */
+struct zygote_request {
+    int cpu;
+    char dir[ZYGOTE_DIR_SIZE];
+};
+
+/* One zygote per tile. pid is -1 when the tile has no idle zygote. */
+struct zygote_struct {
+    pid_t pid;
+    int fd;                         // Scheduler end of the zygote's socket
+    int cpu_num;                    // Cpu of the tile, -1 if none
+    cpu_set_t cpu;                  // Affinity mask with the tile's cpu only
+    char dir[ZYGOTE_DIR_SIZE];      // Directory the zygote waits in
+};
+
+struct zygote_pool_struct {
+    int num_tiles;
+    struct zygote_struct *zygotes;
+    pid_t template_pid;     // -1 if zygotes are forked by the scheduler
+    int template_fd;        // Scheduler end of the template's socket
+};
+
+static void stop_zygote(struct zygote_struct *z);
+static int fork_zygote(zygote_pool pool, int tile_num);
+static int start_template(zygote_pool pool);
+static int request_zygote(zygote_pool pool, int tile_num);
+static void template_main(int fd);
+static pid_t spawn_zygote(int template_fd, struct zygote_request *request, int *sock);
+static void zygote_main(int fd, cpu_set_t *cpu, char *dir);
+static int read_header(int fd, struct zygote_msg_header *header, int *fds);
+static int read_full(int fd, void *buf, size_t length);
+
+zygote_pool create_zygote_pool(cpu_set_t *cpus, int num_tiles) {
+    zygote_pool pool;
+
+    if ((pool = malloc(sizeof(struct zygote_pool_struct))) == NULL) {
+        return NULL;
+    }
+    if ((pool->zygotes = malloc(sizeof(struct zygote_struct) * num_tiles)) == NULL) {
+        free(pool);
+        return NULL;
+    }
+    pool->num_tiles = num_tiles;
+    pool->template_pid = -1;
+    pool->template_fd = -1;
+    // Zygotes forked by the template are adopted by the scheduler, so that
+    // their jobs are its children. Without subreapers the scheduler forks
+    // the zygotes itself.
+    if (prctl(PR_SET_CHILD_SUBREAPER, 1, 0, 0, 0) == 0 && start_template(pool) != 0) {
+        free(pool->zygotes);
+        free(pool);
+        return NULL;
+    }
+    for (int i=0;i<num_tiles;i++) {
+        pool->zygotes[i].pid = -1;
+        pool->zygotes[i].fd = -1;
+        pool->zygotes[i].cpu_num = -1;
+        pool->zygotes[i].dir[0] = '\0';
+        if (i < tmc_cpus_count(cpus)) {
+            set_zygote_cpu(pool, i, tmc_cpus_find_nth_cpu(cpus, i));
+        }
+    }
+    if (refill_zygote_pool(pool) < 0) {
+        destroy_zygote_pool(pool);
+        return NULL;
+    }
+    return pool;
+}
+
+void destroy_zygote_pool(zygote_pool pool) {
+    if (pool == NULL) {
+        return;
+    }
+    for (int i=0;i<pool->num_tiles;i++) {
+        stop_zygote(&pool->zygotes[i]);
+    }
+    // The template exits when its socket is closed
+    if (pool->template_pid > 0) {
+        close(pool->template_fd);
+        waitpid(pool->template_pid, NULL, 0);
+    }
+    free(pool->zygotes);
+    free(pool);
+}
+
+pid_t zygote_launch(zygote_pool pool, int tile_num, cmd_entry cmd, int *out_fds,
+        job_counters *counters) {
+    struct zygote_struct *z = &pool->zygotes[tile_num];
+    char msg[ZYGOTE_MSG_SIZE];
+    struct zygote_msg_header *header = (struct zygote_msg_header *) msg;
+    char *strings[ZYGOTE_MAX_ARGS + 4];
+    int num_strings = 0;
+    size_t length = sizeof(struct zygote_msg_header);
+    size_t str_length;
+    char control[CMSG_SPACE(2 * sizeof(int))];
+    struct msghdr mh;
+    struct iovec iov;
+    struct cmsghdr *cmsg;
+    int event_fds[JOB_EVENTS];
+    pid_t pid;
+
+    if (counters != NULL) {
+        *counters = NULL;
+    }
+    // The zygote of the tile may be used by an earlier job of the batch
+    if (z->pid < 0 && (pool->template_pid < 0 || z->cpu_num < 0
+            || request_zygote(pool, tile_num) != 0)) {
+        return -1;
+    }
+    // Collect all strings of the message
+    strings[num_strings++] = cmd->dir;
+    strings[num_strings++] = cmd->new_stdin != NULL ? cmd->new_stdin : "";
+    // A captured stdout already goes to the redirection, if any
+    strings[num_strings++] = out_fds[0] == -1 && cmd->new_stdout != NULL
+            ? cmd->new_stdout : "";
+    strings[num_strings++] = cmd->cmd;
+    for (int i=0;cmd->argv[i] != NULL;i++) {
+        if (i == ZYGOTE_MAX_ARGS) {
+            return -1;
+        }
+        strings[num_strings++] = cmd->argv[i];
+    }
+    // Pack them after the header
+    for (int i=0;i<num_strings;i++) {
+        str_length = strlen(strings[i]) + 1;
+        if (length + str_length > ZYGOTE_MSG_SIZE) {
+            return -1;
+        }
+        memcpy(msg + length, strings[i], str_length);
+        length += str_length;
+    }
+    header->length = length - sizeof(struct zygote_msg_header);
+    header->argc = num_strings - 4;
+    header->num_fds = out_fds[0] == -1 ? 0 : 2;
+
+    memset(&mh, 0, sizeof(mh));
+    iov.iov_base = msg;
+    iov.iov_len = length;
+    mh.msg_iov = &iov;
+    mh.msg_iovlen = 1;
+    if (header->num_fds > 0) {
+        mh.msg_control = control;
+        mh.msg_controllen = sizeof(control);
+        cmsg = CMSG_FIRSTHDR(&mh);
+        cmsg->cmsg_level = SOL_SOCKET;
+        cmsg->cmsg_type = SCM_RIGHTS;
+        cmsg->cmsg_len = CMSG_LEN(2 * sizeof(int));
+        memcpy(CMSG_DATA(cmsg), out_fds, 2 * sizeof(int));
+    }
+
+    // The zygote hasn't exec'd yet, so its events start with the job
+    if (counters != NULL && open_exec_events(z->pid, event_fds) == 0) {
+        *counters = adopt_job_counters(event_fds);
+    }
+
+    // The zygote is used up whether or not the send succeeds
+    pid = z->pid;
+    z->pid = -1;
+    if (sendmsg(z->fd, &mh, MSG_NOSIGNAL) != length) {
+        close(z->fd);
+        z->fd = -1;
+        if (counters != NULL) {
+            close_job_counters(*counters);
+            *counters = NULL;
+        }
+        return -1;
+    }
+    close(z->fd);
+    z->fd = -1;
+    // The next zygote on this tile waits in the same directory
+    if (strlen(cmd->dir) < ZYGOTE_DIR_SIZE) {
+        strcpy(z->dir, cmd->dir);
+    }
+    return pid;
+}
+
+int refill_zygote_pool(zygote_pool pool) {
+    int forked = 0;
+
+    for (int i=0;i<pool->num_tiles;i++) {
+        if (pool->zygotes[i].pid < 0 && pool->zygotes[i].cpu_num >= 0) {
+            if ((pool->template_pid > 0 ? request_zygote(pool, i) : fork_zygote(pool, i)) != 0) {
+                return -1;
+            }
+            forked++;
+        }
+    }
+    return forked;
+}
+
+void set_zygote_cpu(zygote_pool pool, int tile_num, int cpu) {
+    struct zygote_struct *z = &pool->zygotes[tile_num];
+
+    if (z->cpu_num == cpu) {
+        return;
+    }
+    stop_zygote(z);
+    z->cpu_num = cpu;
+    CPU_ZERO(&z->cpu);
+    if (cpu >= 0) {
+        CPU_SET(cpu, &z->cpu);
+    }
+}
+
+/*
+ * Stops the idle zygote of a tile, if any. Idle zygotes exit when their
+ * socket is closed.
+ */
+static void stop_zygote(struct zygote_struct *z) {
+    if (z->pid > 0) {
+        close(z->fd);
+        waitpid(z->pid, NULL, 0);
+        z->pid = -1;
+        z->fd = -1;
+    }
+}
+
+/*
+ * Forks a new zygote for the specified tile from the scheduler itself, when
+ * there is no template.
+ * Returns 0 on success, otherwise -1.
+ */
+static int fork_zygote(zygote_pool pool, int tile_num) {
+    struct zygote_struct *z = &pool->zygotes[tile_num];
+    int sv[2];
+    pid_t pid;
+
+    if (socketpair(AF_UNIX, SOCK_STREAM | SOCK_CLOEXEC, 0, sv) != 0) {
+        return -1;
+    }
+    pid = fork();
+    if (pid < 0) {
+        close(sv[0]);
+        close(sv[1]);
+        return -1;
+    }
+    else if (pid == 0) {
+        // Drop the sockets of the other zygotes, or they never see EOF
+        close(sv[0]);
+        for (int i=0;i<pool->num_tiles;i++) {
+            if (pool->zygotes[i].fd >= 0) {
+                close(pool->zygotes[i].fd);
+            }
+        }
+        zygote_main(sv[1], &z->cpu, z->dir);
+    }
+    close(sv[1]);
+    z->pid = pid;
+    z->fd = sv[0];
+    return 0;
+}
+
+/*
+ * Forks the template, while the scheduler is still small and single threaded.
+ * Returns 0 on success, otherwise -1.
+ */
+static int start_template(zygote_pool pool) {
+    int sv[2];
+    pid_t pid;
+
+    // Requests and replies are never split or merged
+    if (socketpair(AF_UNIX, SOCK_SEQPACKET | SOCK_CLOEXEC, 0, sv) != 0) {
+        return -1;
+    }
+    pid = fork();
+    if (pid < 0) {
+        close(sv[0]);
+        close(sv[1]);
+        return -1;
+    }
+    else if (pid == 0) {
+        close(sv[0]);
+        template_main(sv[1]);
+    }
+    close(sv[1]);
+    pool->template_pid = pid;
+    pool->template_fd = sv[0];
+    return 0;
+}
+
+/*
+ * Asks the template for a new zygote for the specified tile and waits for it.
+ * Forking the small template costs far less than forking the scheduler.
+ * Returns 0 on success, otherwise -1.
+ */
+static int request_zygote(zygote_pool pool, int tile_num) {
+    struct zygote_struct *z = &pool->zygotes[tile_num];
+    struct zygote_request request;
+    char control[CMSG_SPACE(sizeof(int))];
+    struct msghdr mh;
+    struct iovec iov;
+    struct cmsghdr *cmsg;
+    pid_t pid;
+
+    memset(&request, 0, sizeof(request));
+    request.cpu = z->cpu_num;
+    strcpy(request.dir, z->dir);
+    if (send(pool->template_fd, &request, sizeof(request), MSG_NOSIGNAL) != sizeof(request)) {
+        return -1;
+    }
+
+    memset(&mh, 0, sizeof(mh));
+    iov.iov_base = &pid;
+    iov.iov_len = sizeof(pid);
+    mh.msg_iov = &iov;
+    mh.msg_iovlen = 1;
+    mh.msg_control = control;
+    mh.msg_controllen = sizeof(control);
+    if (recvmsg(pool->template_fd, &mh, MSG_CMSG_CLOEXEC) != sizeof(pid) || pid <= 0) {
+        return -1;
+    }
+    cmsg = CMSG_FIRSTHDR(&mh);
+    if (cmsg == NULL || cmsg->cmsg_level != SOL_SOCKET || cmsg->cmsg_type != SCM_RIGHTS
+            || cmsg->cmsg_len != CMSG_LEN(sizeof(int))) {
+        return -1;
+    }
+    memcpy(&z->fd, CMSG_DATA(cmsg), sizeof(int));
+    z->pid = pid;
+    return 0;
+}
+
+/*
+ * Body of the template. Forks a zygote for every request and sends back its
+ * pid and socket. Exits if the scheduler closes the socket. Never returns.
+ */
+static void template_main(int fd) {
+    struct zygote_request request;
+    char control[CMSG_SPACE(sizeof(int))];
+    struct msghdr mh;
+    struct iovec iov;
+    struct cmsghdr *cmsg;
+    pid_t pid;
+    int sock;
+
+    while (recv(fd, &request, sizeof(request), 0) == sizeof(request)) {
+        pid = spawn_zygote(fd, &request, &sock);
+
+        memset(&mh, 0, sizeof(mh));
+        iov.iov_base = &pid;
+        iov.iov_len = sizeof(pid);
+        mh.msg_iov = &iov;
+        mh.msg_iovlen = 1;
+        if (pid > 0) {
+            mh.msg_control = control;
+            mh.msg_controllen = sizeof(control);
+            cmsg = CMSG_FIRSTHDR(&mh);
+            cmsg->cmsg_level = SOL_SOCKET;
+            cmsg->cmsg_type = SCM_RIGHTS;
+            cmsg->cmsg_len = CMSG_LEN(sizeof(int));
+            memcpy(CMSG_DATA(cmsg), &sock, sizeof(int));
+        }
+        if (sendmsg(fd, &mh, MSG_NOSIGNAL) != sizeof(pid)) {
+            _exit(0);
+        }
+        if (pid > 0) {
+            close(sock);
+        }
+    }
+    _exit(0);
+}
+
+/*
+ * Forks a zygote from the template through a child that exits right away, so
+ * the zygote is orphaned and adopted by the scheduler, its subreaper. Once
+ * the child has been reaped the zygote sends its pid over its socket.
+ * Returns the pid of the zygote with the scheduler end of its socket in sock,
+ * or -1 on failure.
+ */
+static pid_t spawn_zygote(int template_fd, struct zygote_request *request, int *sock) {
+    cpu_set_t cpu;
+    int sv[2];
+    pid_t pid, zygote_pid;
+
+    request->dir[ZYGOTE_DIR_SIZE - 1] = '\0';
+    CPU_ZERO(&cpu);
+    if (request->cpu >= 0 && request->cpu < CPU_SETSIZE) {
+        CPU_SET(request->cpu, &cpu);
+    }
+    if (socketpair(AF_UNIX, SOCK_STREAM | SOCK_CLOEXEC, 0, sv) != 0) {
+        return -1;
+    }
+    pid = fork();
+    if (pid == 0) {
+        if (fork() == 0) {
+            close(template_fd);
+            close(sv[0]);
+            zygote_pid = getpid();
+            if (write(sv[1], &zygote_pid, sizeof(zygote_pid)) != sizeof(zygote_pid)) {
+                _exit(0);
+            }
+            zygote_main(sv[1], &cpu, request->dir);
+        }
+        _exit(0);
+    }
+    close(sv[1]);
+    if (pid < 0 || waitpid(pid, NULL, 0) != pid
+            || read_full(sv[0], &zygote_pid, sizeof(zygote_pid)) != 0) {
+        close(sv[0]);
+        return -1;
+    }
+    *sock = sv[0];
+    return zygote_pid;
+}
+
+/*
+ * Body of a zygote. Pins itself, waits in dir for a command and execs it.
+ * Exits if the scheduler closes the socket. The scheduler may have other
+ * threads, so only async-signal-safe functions are used. Never returns.
+ */
+static void zygote_main(int fd, cpu_set_t *cpu, char *dir) {
+    static char msg[ZYGOTE_MSG_SIZE];
+    static char *argv[ZYGOTE_MAX_ARGS + 1];
+    struct zygote_msg_header header;
+    char *job_dir, *job_stdin, *job_stdout, *job_cmd, *next;
+    sigset_t no_signals;
+    int stdin_fd, stdout_fd;
+    int out_fds[2];
+
+    sched_setaffinity(0, sizeof(cpu_set_t), cpu);
+    if (dir[0] != '\0' && chdir(dir) != 0) {
+        dir[0] = '\0';
+    }
+
+    // Wait for a command
+    if (read_header(fd, &header, out_fds) != 0
+            || header.length <= 0 || header.length > ZYGOTE_MSG_SIZE
+            || header.argc < 0 || header.argc > ZYGOTE_MAX_ARGS
+            || read_full(fd, msg, header.length) != 0) {
+        _exit(0);
+    }
+    close(fd);
+    msg[header.length - 1] = '\0';
+    job_dir = msg;
+    job_stdin = job_dir + strlen(job_dir) + 1;
+    job_stdout = job_stdin + strlen(job_stdin) + 1;
+    job_cmd = job_stdout + strlen(job_stdout) + 1;
+    next = job_cmd + strlen(job_cmd) + 1;
+    for (int i=0;i<header.argc;i++) {
+        argv[i] = next;
+        next += strlen(next) + 1;
+    }
+    argv[header.argc] = NULL;
+
+    // Start the job
+    sigemptyset(&no_signals);
+    sigprocmask(SIG_SETMASK, &no_signals, NULL);
+    if (strcmp(job_dir, dir) != 0 && chdir(job_dir) != 0) {
+        _exit(127);
+    }
+    if (job_stdin[0] != '\0') {
+        if ((stdin_fd = open(job_stdin, O_RDONLY)) == -1
+                || dup2(stdin_fd, 0) == -1) {
+            _exit(127);
+        }
+        close(stdin_fd);
+    }
+    if (job_stdout[0] != '\0') {
+        if ((stdout_fd = open(job_stdout, O_WRONLY | O_CREAT | O_TRUNC, 0644)) == -1
+                || dup2(stdout_fd, 1) == -1) {
+            _exit(127);
+        }
+        close(stdout_fd);
+    }
+    if (header.num_fds == 2) {
+        if (dup2(out_fds[0], 1) == -1 || dup2(out_fds[1], 2) == -1) {
+            _exit(127);
+        }
+        close(out_fds[0]);
+        close(out_fds[1]);
+    }
+    execv(job_cmd, argv);
+    _exit(127);
+}
+
+/*
+ * Reads a message header from fd together with the descriptors passed along
+ * with it, which are stored in fds.
+ * Returns 0 on success, -1 on error or end of file.
+ */
+static int read_header(int fd, struct zygote_msg_header *header, int *fds) {
+    char control[CMSG_SPACE(2 * sizeof(int))];
+    struct msghdr mh;
+    struct iovec iov;
+    struct cmsghdr *cmsg;
+    ssize_t n;
+
+    memset(&mh, 0, sizeof(mh));
+    iov.iov_base = header;
+    iov.iov_len = sizeof(*header);
+    mh.msg_iov = &iov;
+    mh.msg_iovlen = 1;
+    mh.msg_control = control;
+    mh.msg_controllen = sizeof(control);
+    fds[0] = fds[1] = -1;
+    if ((n = recvmsg(fd, &mh, 0)) <= 0) {
+        return -1;
+    }
+    // The descriptors arrive with the first byte of the message
+    cmsg = CMSG_FIRSTHDR(&mh);
+    if (cmsg != NULL && cmsg->cmsg_level == SOL_SOCKET
+            && cmsg->cmsg_type == SCM_RIGHTS
+            && cmsg->cmsg_len == CMSG_LEN(2 * sizeof(int))) {
+        memcpy(fds, CMSG_DATA(cmsg), 2 * sizeof(int));
+    }
+    return read_full(fd, (char *) header + n, sizeof(*header) - n);
+}
+
+/*
+ * Reads exactly length bytes from fd.
+ * Returns 0 on success, -1 on error or end of file.
+ */
+static int read_full(int fd, void *buf, size_t length) {
+    ssize_t n;
+
+    while (length > 0) {
+        if ((n = read(fd, buf, length)) <= 0) {
+            return -1;
+        }
+        buf = (char *) buf + n;
+        length -= n;
+    }
+    return 0;
+}
@@ -0,0 +1,64 @@
+/* zygote.h
+ *
+ * A pool of pre-forked helper processes ("zygotes"), one per tile.
+ *
+ * Each zygote is forked ahead of time, pinned to its tile and parked in the
+ * working directory of the last job started on the tile. To start a job the
+ * scheduler sends the command over the zygote's socket and the zygote execs it
+ * right away, so the job is started with a single exec and the zygote's pid
+ * becomes the job's pid.
+ *
+ * Zygotes are forked by a template, a small single-threaded child forked
+ * when the pool is created, so the large and threaded scheduler is never
+ * forked again. The scheduler is made the subreaper of its descendants
+ * (PR_SET_CHILD_SUBREAPER) and adopts each zygote, so jobs are still its
+ * children and are reaped by it. A job whose tile has no idle zygote, e.g.
+ * the second job of a batch on the tile, gets a new one from the template on
+ * the spot. Used zygotes are replaced by refill_zygote_pool(), outside the
+ * launch path. Where subreapers aren't supported the scheduler forks the
+ * zygotes itself, and jobs without an idle zygote are left to the launcher.
+ * */
+
+#ifndef _ZYGOTE_H
+#define _ZYGOTE_H
+
+#include <sched.h>
+#include <unistd.h>
+#include "cmd_list.h"
+#include "perfcount.h"
+
+/* Each pool instance is represented by a zygote_pool_struct. */
+struct zygote_pool_struct;
+
+/* Typedef for a user handle to a pool instance. */
+typedef struct zygote_pool_struct *zygote_pool;
+
+/* Creates a pool for num_tiles tiles and forks one zygote for each of the
+ * tiles, in order, that is bound to a cpu of the given cpu set. Tiles beyond
+ * the cpus of the set have no zygote until set_zygote_cpu() binds them. On
+ * success a handle to the pool is returned, otherwise NULL. */
+zygote_pool create_zygote_pool(cpu_set_t *cpus, int num_tiles);
+
+/* Stops all idle zygotes and frees allocated memory. */
+void destroy_zygote_pool(zygote_pool pool);
+
+/* Starts the command on the specified tile through the tile's zygote, which is
+ * requested from the template if the tile has none idle. out_fds are passed to
+ * the job as stdout and stderr, or {-1, -1} to keep the scheduler's. Unless
+ * counters is NULL the job's cache misses are counted from its exec on, and
+ * counters is set to the session, or NULL if none could be opened (see
+ * perfcount.h). Returns the pid of the started job, or -1 if the tile has no
+ * zygote or the command doesn't fit in a zygote message. */
+pid_t zygote_launch(zygote_pool pool, int tile_num, cmd_entry cmd, int *out_fds,
+        job_counters *counters);
+
+/* Forks new zygotes for all tiles bound to a cpu whose zygote has been used.
+ * Returns the number of zygotes forked, or -1 on error. */
+int refill_zygote_pool(zygote_pool pool);
+
+/* Binds the specified tile to another cpu, or to none if cpu is -1. The
+ * tile's idle zygote, which is pinned to the old cpu, is stopped. A new one is
+ * forked by the next refill_zygote_pool(). */
+void set_zygote_cpu(zygote_pool pool, int tile_num, int cpu);
+
+#endif